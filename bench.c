@@ -0,0 +1,694 @@
+#include "big_int.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Benchmarks every public operation over a sweep of bases (all four spans)
+ * and operand sizes, and prints one JSON document to stdout.
+ *
+ *   bench [--max-limbs N] [--min-time SECONDS] [--filter OP] [--label TEXT] [--huge]
+ *
+ * Sizes go 1, 10, 100, ... up to --max-limbs (default 10^8), capped per
+ * operation for the superlinear ones. Allocations are counted by
+ * interposing malloc and friends (glibc only, -1 elsewhere). --huge puts
+ * every number on bi_allocator_huge
+ */
+
+////////////////////////////////////////////// Allocation Counting
+#if defined(__GLIBC__)
+extern void* __libc_malloc(size_t n);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* p, size_t n);
+extern void __libc_free(void* p);
+
+static atomic_size_t bench_allocs;
+static atomic_size_t bench_alloc_bytes;
+
+void* malloc(size_t n)
+{
+  atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&bench_alloc_bytes, n, memory_order_relaxed);
+  return __libc_malloc(n);
+}
+
+void* calloc(size_t n, size_t size)
+{
+  atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&bench_alloc_bytes, n * size, memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t n)
+{
+  atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&bench_alloc_bytes, n, memory_order_relaxed);
+  return __libc_realloc(p, n);
+}
+
+void free(void* p)
+{
+  __libc_free(p);
+}
+
+#define BENCH_COUNTS_ALLOCS 1
+#else
+static size_t bench_allocs;
+static size_t bench_alloc_bytes;
+#define BENCH_COUNTS_ALLOCS 0
+#endif
+
+////////////////////////////////////////////// Operands
+static uint64_t bench_rand_state = 0x9E3779B97F4A7C15lu;
+
+static uint64_t bench_rand()
+{
+  bench_rand_state ^= bench_rand_state << 13;
+  bench_rand_state ^= bench_rand_state >> 7;
+  bench_rand_state ^= bench_rand_state << 17;
+  return bench_rand_state;
+}
+
+static int bench_init(struct big_uint* bi, uint64_t base)
+{
+  return base == BI_BASE_2_64 ? bi_init_bin(bi, 0) : bi_init(bi, 0, base);
+}
+
+static void bench_set_limb(struct big_uint* bi, size_t i, uint64_t v)
+{
+  uint8_t* data = bi->data;
+  switch (bi->span) {
+    case UI8: data[i] = (uint8_t)v; break;
+    case UI16: ((uint16_t*)data)[i] = (uint16_t)v; break;
+    case UI32: ((uint32_t*)data)[i] = (uint32_t)v; break;
+    case UI64: ((uint64_t*)data)[i] = v; break;
+  }
+}
+
+/**
+ * Makes bi a random [n] limb number (top limb non zero)
+ */
+static int bench_fill(struct big_uint* bi, size_t n)
+{
+  if (bi_reserve(bi, n))
+    return -1;
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t v = bi->base ? bench_rand() % bi->base : bench_rand();
+    if (i == n - 1 && !v)
+      v = 1;
+    bench_set_limb(bi, i, v);
+  }
+  bi->size = n;
+  return 0;
+}
+
+////////////////////////////////////////////// Cases
+struct bench_ctx {
+  uint64_t base;
+  size_t limbs;
+  struct big_uint a;
+  struct big_uint b;
+  struct big_uint d;
+  char* str;
+  struct bi_accum acc;
+  struct bi_batch batch;
+  struct bi_batch batch_b;
+  uint64_t* words;
+  struct bi_barrett barrett;
+  struct bi_mont_ctx mont;
+  struct bi_packed packed;
+  struct bi_packed packed_b;
+  struct big_uint* values;
+  struct bi_hashmap hashmap;
+  size_t next;
+  char path[64];
+};
+
+/**
+ * One operation. [setup] builds operands for ctx->limbs (untimed) and
+ * returns 1 for points the operation doesn't take, [run] is what gets
+ * timed, [teardown] frees whatever setup made
+ */
+struct bench_case {
+  const char* name;
+  size_t max_limbs;
+  int (*setup)(struct bench_ctx* ctx);
+  int (*run)(struct bench_ctx* ctx);
+  void (*teardown)(struct bench_ctx* ctx);
+};
+
+static int setup_ad(struct bench_ctx* ctx)
+{
+  int ret = bench_init(&ctx->a, ctx->base) || bench_init(&ctx->b, ctx->base)
+            || bench_init(&ctx->d, ctx->base);
+  return ret || bench_fill(&ctx->a, ctx->limbs) || bench_fill(&ctx->d, ctx->limbs);
+}
+
+static int setup_abd(struct bench_ctx* ctx)
+{
+  return setup_ad(ctx) || bench_fill(&ctx->b, ctx->limbs);
+}
+
+static void teardown_abd(struct bench_ctx* ctx)
+{
+  bi_free(&ctx->a);
+  bi_free(&ctx->b);
+  bi_free(&ctx->d);
+  free(ctx->str);
+  ctx->str = NULL;
+}
+
+static int setup_none(struct bench_ctx* ctx)
+{
+  (void)ctx;
+  return 0;
+}
+
+static void teardown_none(struct bench_ctx* ctx)
+{
+  (void)ctx;
+}
+
+static int run_init(struct bench_ctx* ctx)
+{
+  struct big_uint bi;
+  int ret = bench_init(&bi, ctx->base) || bi_add_sc(&bi, bench_rand());
+  bi_free(&bi);
+  return ret;
+}
+
+static int run_add_bi(struct bench_ctx* ctx)
+{
+  return bi_add_bi(&ctx->d, &ctx->a);
+}
+
+static int run_add_sc(struct bench_ctx* ctx)
+{
+  return bi_add_sc(&ctx->d, 0x123456789ABCDEFlu);
+}
+
+static int run_mul_divmod_sc(struct bench_ctx* ctx)
+{
+  // Dividing back out keeps d at [limbs] however many times it runs
+  uint64_t rem;
+  return bi_mul_sc(&ctx->d, 0x123456789ABCDEFlu)
+         || bi_divmod_sc(&ctx->d, 0x123456789ABCDEFlu, &rem);
+}
+
+static int run_mul_bi(struct bench_ctx* ctx)
+{
+  return bi_mul_bi(&ctx->d, &ctx->a, &ctx->b);
+}
+
+static int setup_divmod(struct bench_ctx* ctx)
+{
+  // a has twice b's limbs so the quotient is as long as the divisor
+  int ret = setup_abd(ctx);
+  return ret || bench_fill(&ctx->a, 2 * ctx->limbs);
+}
+
+static int run_divmod_bi(struct bench_ctx* ctx)
+{
+  return bi_divmod_bi(&ctx->d, NULL, &ctx->a, &ctx->b);
+}
+
+static int run_to_str(struct bench_ctx* ctx)
+{
+  free(ctx->str);
+  ctx->str = bi_to_str(&ctx->a);
+  return !ctx->str;
+}
+
+static int setup_from_str(struct bench_ctx* ctx)
+{
+  return setup_abd(ctx) || !(ctx->str = bi_to_str(&ctx->a));
+}
+
+static int run_from_str(struct bench_ctx* ctx)
+{
+  return bi_from_str(&ctx->d, ctx->str);
+}
+
+static int setup_convert_base(struct bench_ctx* ctx)
+{
+  // Into 2^64 from base 10, into 10 from everything else
+  int ret = bench_init(&ctx->a, ctx->base) || bench_init(&ctx->d, ctx->base)
+            || bench_init(&ctx->b, ctx->base == 10 ? BI_BASE_2_64 : 10);
+  return ret || bench_fill(&ctx->a, ctx->limbs);
+}
+
+static int run_convert_base(struct bench_ctx* ctx)
+{
+  return bi_convert_base(&ctx->b, &ctx->a);
+}
+
+static int setup_accum(struct bench_ctx* ctx)
+{
+  return setup_ad(ctx) || bi_accum_init(&ctx->acc, ctx->base);
+}
+
+static int run_accum_add_bi(struct bench_ctx* ctx)
+{
+  return bi_accum_add_bi(&ctx->acc, &ctx->a);
+}
+
+static void teardown_accum(struct bench_ctx* ctx)
+{
+  bi_accum_free(&ctx->acc);
+  teardown_abd(ctx);
+}
+
+static int setup_batch(struct bench_ctx* ctx)
+{
+  // [limbs] one limb counters, so it lines up with add_bi per limb
+  if (bi_batch_init(&ctx->batch, ctx->limbs, ctx->base)
+      || bi_batch_init(&ctx->batch_b, ctx->limbs, ctx->base)
+      || bench_init(&ctx->a, ctx->base))
+    return -1;
+  int ret = 0;
+  for (size_t j = 0; !ret && j < ctx->limbs; ++j)
+    ret = bench_fill(&ctx->a, 1) || bi_batch_set(&ctx->batch, j, &ctx->a)
+          || bi_batch_set(&ctx->batch_b, j, &ctx->a);
+  return ret;
+}
+
+static int run_batch_add(struct bench_ctx* ctx)
+{
+  return bi_batch_add(&ctx->batch, &ctx->batch_b);
+}
+
+static void teardown_batch(struct bench_ctx* ctx)
+{
+  bi_batch_free(&ctx->batch);
+  bi_batch_free(&ctx->batch_b);
+  bi_free(&ctx->a);
+}
+
+static int setup_barrett(struct bench_ctx* ctx)
+{
+  return setup_divmod(ctx) || bi_barrett_init(&ctx->barrett, &ctx->b);
+}
+
+static int run_barrett_divmod(struct bench_ctx* ctx)
+{
+  return bi_barrett_divmod(&ctx->d, NULL, &ctx->a, &ctx->barrett);
+}
+
+static void teardown_barrett(struct bench_ctx* ctx)
+{
+  bi_barrett_free(&ctx->barrett);
+  teardown_abd(ctx);
+}
+
+static int setup_powmod(struct bench_ctx* ctx)
+{
+  // The modulus b ends in a 1 (base - 1 on its own) to be coprime to the
+  // base, a is the number raised and d the exponent, all [limbs] long
+  if (ctx->base == 2 && ctx->limbs == 1)
+    return 1;
+  if (setup_abd(ctx))
+    return -1;
+  bench_set_limb(&ctx->b, 0, ctx->limbs > 1 ? 1 : ctx->base - 1);
+  return bi_mont_init(&ctx->mont, &ctx->b);
+}
+
+static int run_powmod(struct bench_ctx* ctx)
+{
+  struct big_uint out;
+  int ret = bench_init(&out, ctx->base) || bi_powmod(&out, &ctx->a, &ctx->d, &ctx->mont);
+  bi_free(&out);
+  return ret;
+}
+
+static void teardown_powmod(struct bench_ctx* ctx)
+{
+  bi_mont_free(&ctx->mont);
+  teardown_abd(ctx);
+}
+
+static int setup_packed(struct bench_ctx* ctx)
+{
+  if (ctx->base == BI_BASE_2_64)
+    return 1;
+  return setup_abd(ctx) || bi_packed_init(&ctx->packed, 0, ctx->base)
+         || bi_packed_init(&ctx->packed_b, 0, ctx->base)
+         || bi_pack(&ctx->packed, &ctx->d) || bi_pack(&ctx->packed_b, &ctx->a);
+}
+
+static int run_packed_add_bi(struct bench_ctx* ctx)
+{
+  return bi_packed_add_bi(&ctx->packed, &ctx->packed_b);
+}
+
+static int run_packed_add_sc(struct bench_ctx* ctx)
+{
+  return bi_packed_add_sc(&ctx->packed, 0x123456789ABCDEFlu);
+}
+
+static void teardown_packed(struct bench_ctx* ctx)
+{
+  bi_packed_free(&ctx->packed);
+  bi_packed_free(&ctx->packed_b);
+  teardown_abd(ctx);
+}
+
+static int setup_batch_sc(struct bench_ctx* ctx)
+{
+  if (setup_batch(ctx) || !(ctx->words = malloc(ctx->limbs * sizeof(uint64_t))))
+    return -1;
+  for (size_t j = 0; j < ctx->limbs; ++j)
+    ctx->words[j] = bench_rand();
+  return 0;
+}
+
+static int run_batch_add_sc(struct bench_ctx* ctx)
+{
+  return bi_batch_add_sc(&ctx->batch, ctx->words);
+}
+
+static void teardown_batch_sc(struct bench_ctx* ctx)
+{
+  free(ctx->words);
+  ctx->words = NULL;
+  teardown_batch(ctx);
+}
+
+#define BENCH_VALUES 16
+
+static int setup_values(struct bench_ctx* ctx)
+{
+  // BENCH_VALUES numbers of [limbs] limbs each
+  if (setup_ad(ctx) || !(ctx->values = calloc(BENCH_VALUES, sizeof(struct big_uint))))
+    return -1;
+  int ret = 0;
+  for (size_t j = 0; !ret && j < BENCH_VALUES; ++j)
+    ret = bench_init(&ctx->values[j], ctx->base) || bench_fill(&ctx->values[j], ctx->limbs);
+  return ret;
+}
+
+static int run_sum_parallel(struct bench_ctx* ctx)
+{
+  return bi_sum_parallel(&ctx->d, ctx->values, BENCH_VALUES, 0);
+}
+
+static int run_add_many(struct bench_ctx* ctx)
+{
+  const struct big_uint* terms[BENCH_VALUES];
+  for (size_t j = 0; j < BENCH_VALUES; ++j)
+    terms[j] = &ctx->values[j];
+  return bi_add_many(&ctx->d, terms, BENCH_VALUES);
+}
+
+static int run_prod_parallel(struct bench_ctx* ctx)
+{
+  return bi_prod_parallel(&ctx->d, ctx->values, BENCH_VALUES, 0);
+}
+
+static void teardown_values(struct bench_ctx* ctx)
+{
+  if (ctx->values)
+    for (size_t j = 0; j < BENCH_VALUES; ++j)
+      bi_free(&ctx->values[j]);
+  free(ctx->values);
+  ctx->values = NULL;
+  teardown_abd(ctx);
+}
+
+static int setup_equal(struct bench_ctx* ctx)
+{
+  // d is a copy of a, so comparing has to read every limb
+  return bench_init(&ctx->a, ctx->base) || bench_init(&ctx->b, ctx->base)
+         || bench_init(&ctx->d, ctx->base) || bench_fill(&ctx->a, ctx->limbs)
+         || bi_add_bi(&ctx->d, &ctx->a);
+}
+
+static int run_cmp(struct bench_ctx* ctx)
+{
+  return bi_cmp(&ctx->a, &ctx->d) != 0;
+}
+
+static int run_hash(struct bench_ctx* ctx)
+{
+  // Folded into the bench state so the call can't be dropped
+  bench_rand_state ^= bi_hash(&ctx->a) & 1;
+  return 0;
+}
+
+static int setup_hashmap(struct bench_ctx* ctx)
+{
+  int ret = setup_values(ctx) || bi_hashmap_init(&ctx->hashmap, ctx->base);
+  for (size_t j = 0; !ret && j < BENCH_VALUES; ++j)
+    ret = bi_hashmap_insert(&ctx->hashmap, &ctx->values[j]) < 0;
+  return ret;
+}
+
+static int run_hashmap_slot(struct bench_ctx* ctx)
+{
+  // Counting hits on keys that are all there already
+  uint64_t* v = bi_hashmap_slot(&ctx->hashmap, &ctx->values[ctx->next++ % BENCH_VALUES]);
+  if (!v)
+    return -1;
+  ++*v;
+  return 0;
+}
+
+static void teardown_hashmap(struct bench_ctx* ctx)
+{
+  bi_hashmap_free(&ctx->hashmap);
+  teardown_values(ctx);
+}
+
+static int run_add_view(struct bench_ctx* ctx)
+{
+  // The top half of a added half way up d, neither of them copied
+  struct bi_view v;
+  bi_view_init(&v, &ctx->a);
+  bi_view_slice(&v, ctx->limbs / 2, SIZE_MAX);
+  bi_view_shift(&v, ctx->limbs / 2);
+  return bi_add_view(&ctx->d, &v);
+}
+
+static int run_mul_view(struct bench_ctx* ctx)
+{
+  // a's two halves multiplied in place, so it lines up with bi_mul_bi at
+  // half the limbs
+  struct bi_view lo, hi;
+  bi_view_init(&lo, &ctx->a);
+  hi = lo;
+  bi_view_slice(&lo, 0, ctx->limbs / 2 ? ctx->limbs / 2 : 1);
+  bi_view_slice(&hi, ctx->limbs / 2, SIZE_MAX);
+  return bi_mul_view(&ctx->d, &lo, &hi);
+}
+
+static int setup_file(struct bench_ctx* ctx)
+{
+  snprintf(ctx->path, sizeof(ctx->path), "bench-%ld.bi", (long)getpid());
+  return setup_abd(ctx) || bi_save(&ctx->a, ctx->path);
+}
+
+static int run_save(struct bench_ctx* ctx)
+{
+  return bi_save(&ctx->a, ctx->path);
+}
+
+static int run_map(struct bench_ctx* ctx)
+{
+  // Verifying reads every limb, which is what a caller pays before use
+  struct bi_mapping map;
+  if (bi_map(&map, ctx->path, 1))
+    return -1;
+  bi_unmap(&map);
+  return 0;
+}
+
+static void teardown_file(struct bench_ctx* ctx)
+{
+  if (ctx->path[0])
+    unlink(ctx->path);
+  teardown_abd(ctx);
+}
+
+static int setup_digits(struct bench_ctx* ctx)
+{
+  // a's decimal digits in a file, read back by every run
+  snprintf(ctx->path, sizeof(ctx->path), "bench-%ld.txt", (long)getpid());
+  if (setup_abd(ctx) || !(ctx->str = bi_to_str(&ctx->a)))
+    return -1;
+  FILE* f = fopen(ctx->path, "w");
+  int ret = !f || fputs(ctx->str, f) < 0;
+  if (f)
+    ret = fclose(f) || ret;
+  return ret ? -1 : 0;
+}
+
+static int run_from_fd(struct bench_ctx* ctx)
+{
+  int fd = open(ctx->path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  int ret = bi_from_fd(&ctx->d, fd, 10);
+  close(fd);
+  return ret;
+}
+
+static const struct bench_case cases[] = {
+  { "bi_init",          1,         setup_none,     run_init,          teardown_none },
+  { "bi_add_bi",        (size_t)-1, setup_ad,      run_add_bi,        teardown_abd },
+  { "bi_add_sc",        (size_t)-1, setup_ad,      run_add_sc,        teardown_abd },
+  { "bi_add_view",      (size_t)-1, setup_ad,      run_add_view,      teardown_abd },
+  { "bi_mul_sc+bi_divmod_sc", (size_t)-1, setup_ad, run_mul_divmod_sc, teardown_abd },
+  { "bi_accum_add_bi",  (size_t)-1, setup_accum,   run_accum_add_bi,  teardown_accum },
+  { "bi_batch_add",     10000000,  setup_batch,    run_batch_add,     teardown_batch },
+  { "bi_batch_add_sc",  10000000,  setup_batch_sc, run_batch_add_sc,  teardown_batch_sc },
+  { "bi_packed_add_bi", (size_t)-1, setup_packed,  run_packed_add_bi, teardown_packed },
+  { "bi_packed_add_sc", (size_t)-1, setup_packed,  run_packed_add_sc, teardown_packed },
+  { "bi_sum_parallel",  10000000,  setup_values,   run_sum_parallel,  teardown_values },
+  { "bi_add_many",      10000000,  setup_values,   run_add_many,      teardown_values },
+  { "bi_mul_bi",        1000000,   setup_abd,      run_mul_bi,        teardown_abd },
+  { "bi_mul_view",      1000000,   setup_ad,       run_mul_view,      teardown_abd },
+  { "bi_prod_parallel", 100000,    setup_values,   run_prod_parallel, teardown_values },
+  { "bi_divmod_bi",     100000,    setup_divmod,   run_divmod_bi,     teardown_abd },
+  { "bi_barrett_divmod", 100000,   setup_barrett,  run_barrett_divmod, teardown_barrett },
+  { "bi_powmod",        100,       setup_powmod,   run_powmod,        teardown_powmod },
+  { "bi_to_str",        1000000,   setup_abd,      run_to_str,        teardown_abd },
+  { "bi_from_str",      1000000,   setup_from_str, run_from_str,      teardown_abd },
+  { "bi_from_fd",       1000000,   setup_digits,   run_from_fd,       teardown_file },
+  { "bi_convert_base",  1000000,   setup_convert_base, run_convert_base, teardown_abd },
+  { "bi_cmp",           (size_t)-1, setup_equal,   run_cmp,           teardown_abd },
+  { "bi_hash",          (size_t)-1, setup_equal,   run_hash,          teardown_abd },
+  { "bi_hashmap_slot",  10000000,  setup_hashmap,  run_hashmap_slot,  teardown_hashmap },
+  { "bi_save",          10000000,  setup_file,     run_save,          teardown_file },
+  { "bi_map",           10000000,  setup_file,     run_map,           teardown_file },
+};
+
+/**
+ * One base per span at least, plus the decimal and binary favourites
+ */
+static const uint64_t bases[] = {
+  2, 10, 10000, 1000000000, 1000000000000000000lu, BI_BASE_2_64
+};
+
+////////////////////////////////////////////// Driver
+static double now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static size_t span_of(uint64_t base)
+{
+  struct big_uint bi;
+  if (bench_init(&bi, base))
+    return 0;
+  size_t ret = bi.span;
+  bi_free(&bi);
+  return ret;
+}
+
+/**
+ * Runs one (case, base, limbs) point until [min_time] has gone by and
+ * prints it as a JSON object. 0 if the case skipped it
+ */
+static int bench_point(const struct bench_case* c, uint64_t base, size_t limbs, double min_time, int first)
+{
+  struct bench_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.base = base;
+  ctx.limbs = limbs;
+
+  int ret = c->setup(&ctx);
+  if (ret == 1) {
+    c->teardown(&ctx);
+    return 0;
+  }
+  size_t iters = 0;
+  size_t allocs = 0;
+  size_t alloc_bytes = 0;
+  double elapsed = 0;
+  if (!ret) {
+    size_t a0 = bench_allocs;
+    size_t b0 = bench_alloc_bytes;
+    double t0 = now();
+    do {
+      ret = c->run(&ctx);
+      iters++;
+      elapsed = now() - t0;
+    } while (!ret && elapsed < min_time);
+    allocs = bench_allocs - a0;
+    alloc_bytes = bench_alloc_bytes - b0;
+  }
+  c->teardown(&ctx);
+
+  size_t span = span_of(base);
+  double ns = iters ? elapsed * 1e9 / (double)iters : 0;
+  printf("%s\n    {\"op\": \"%s\", ", first ? "" : ",", c->name);
+  if (base == BI_BASE_2_64)
+    printf("\"base\": \"2^64\", ");
+  else
+    printf("\"base\": %" PRIu64 ", ", base);
+  printf("\"span\": %zu, \"limbs\": %zu, \"iters\": %zu, \"ok\": %s, ",
+         span, limbs, iters, ret ? "false" : "true");
+  printf("\"ns_per_op\": %.3f, \"ns_per_limb\": %.4f, \"limbs_per_sec\": %.4e, \"bytes_per_sec\": %.4e, ",
+         ns, ns / (double)limbs, ns ? 1e9 * (double)limbs / ns : 0, ns ? 1e9 * (double)(limbs * span) / ns : 0);
+  if (BENCH_COUNTS_ALLOCS && iters)
+    printf("\"allocs_per_op\": %.3f, \"alloc_bytes_per_op\": %.1f}",
+           (double)allocs / (double)iters, (double)alloc_bytes / (double)iters);
+  else
+    printf("\"allocs_per_op\": -1, \"alloc_bytes_per_op\": -1}");
+  fflush(stdout);
+  return 1;
+}
+
+static void usage(const char* argv0)
+{
+  fprintf(stderr, "usage: %s [--max-limbs N] [--min-time SECONDS] [--filter OP] [--label TEXT] [--huge]\n", argv0);
+}
+
+int main(int argc, char** argv)
+{
+  size_t max_limbs = 100000000;
+  double min_time = 0.2;
+  const char* filter = NULL;
+  const char* label = "";
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "--max-limbs"))
+      max_limbs = strtoull(argv[++i], NULL, 10);
+    else if (i + 1 < argc && !strcmp(argv[i], "--min-time"))
+      min_time = strtod(argv[++i], NULL);
+    else if (i + 1 < argc && !strcmp(argv[i], "--filter"))
+      filter = argv[++i];
+    else if (i + 1 < argc && !strcmp(argv[i], "--label"))
+      label = argv[++i];
+    else if (!strcmp(argv[i], "--huge"))
+      bi_set_default_allocator(&bi_allocator_huge);
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  printf("{\n  \"label\": \"");
+  for (const char* p = label; *p; ++p)
+    printf(*p == '"' || *p == '\\' ? "\\%c" : "%c", *p);
+  printf("\",\n  \"min_time\": %g,\n  \"max_limbs\": %zu,\n  \"counts_allocs\": %s,\n  \"pool_threads\": %zu,\n  \"allocator\": \"%s\",\n  \"results\": [",
+         min_time, max_limbs, BENCH_COUNTS_ALLOCS ? "true" : "false", bi_pool_threads(),
+         bi_get_default_allocator() == &bi_allocator_huge ? "huge" : "malloc");
+
+  int first = 1;
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+    if (filter && strcmp(filter, cases[c].name))
+      continue;
+    for (size_t b = 0; b < sizeof(bases) / sizeof(bases[0]); ++b)
+      for (size_t n = 1; n <= max_limbs && n <= cases[c].max_limbs; n *= 10)
+        if (bench_point(&cases[c], bases[b], n, min_time, first))
+          first = 0;
+  }
+  printf("\n  ]\n}\n");
+  return 0;
+}
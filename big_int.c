@@ -1,6 +1,9 @@
 //
 // Created by Theo Lincke on 4/1/24.
 //
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // mremap
+#endif
 #include "big_int.h"
 #include "test_big_int.h"
 #include <assert.h>
@@ -10,6 +13,20 @@
 #include <string.h>
 #include <strings.h>
 #include <inttypes.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
 
 /**
  * Calculates powers of 10 quickly
@@ -48,11 +65,199 @@ static enum span span_from_base(const uint64_t base);
 static uint64_t min_decs_needed(const uint64_t num);
 
 /**
- * Doubles the capacity of bi while keeping everything else the same
+ * Moves / extends bi's limbs to [bytes] of capacity while keeping everything
+ * else the same
  */
-static int double_capacity(struct big_uint* bi);
+static int grow_capacity(struct big_uint* bi, size_t bytes);
+
+/**
+ * Grows bi (by doublings, but in one step) until it can hold [size] elements
+ */
+static int ensure_capacity_big_enough(struct big_uint* bi, size_t size);
+
+/**
+ * Reads / writes the i'th element of [elem_bit_size] bits in a bit string
+ * of [dl] bytes (bit 0 is the low bit of the last byte)
+ */
+static uint64_t get_bits_span(const uint8_t* data, const size_t dl, const size_t elem_bit_size, const size_t i);
+static void set_bits_span(uint8_t* data, const size_t dl, const size_t elem_bit_size, const size_t i, uint64_t val);
+
+/**
+ * Reads / writes the i'th limb of a raw limb array of width [span]
+ */
+static inline uint64_t limb_get(const uint8_t* data, size_t i, size_t span);
+static inline void limb_set(uint8_t* data, size_t i, size_t span, uint64_t val);
+
+/**
+ * Divides the double word (hi:lo) by base. Requires hi < base so the
+ * quotient fits in a single word. BI_BASE_2_64 just splits the words
+ */
+static inline uint64_t dw_divmod(uint64_t hi, uint64_t lo, uint64_t base, uint64_t* rem);
+
+/**
+ * dw_divmod by a divisor that stays the same over a whole loop. recip_init
+ * pays for one divq up front and recip_divmod then needs two multiplies
+ * (Moller & Granlund). d = 0 (BI_BASE_2_64) just splits the words
+ */
+struct recip {
+  uint64_t d;     // Divisor shifted so its top bit is set
+  uint64_t v;     // floor((2^128 - 1) / d) - 2^64
+  int shift;
+};
+
+static inline struct recip recip_init(uint64_t d);
+static inline uint64_t recip_divmod(uint64_t hi, uint64_t lo, const struct recip* r, uint64_t* rem);
+
+/**
+ * recip_init(bi->base), reusing the reciprocal bi_init stored
+ */
+static inline struct recip bi_recip(const struct big_uint* bi);
+
+/**
+ * d = a +/- b on full 64 bit words (BI_BASE_2_64) where an >= bn. d has an
+ * limbs and may alias a or b. Returns the carry / borrow out of the top limb
+ */
+static uint64_t limbs_add_bin(uint64_t* d, const uint64_t* a, size_t an, const uint64_t* b, size_t bn);
+static uint64_t limbs_sub_bin(uint64_t* d, const uint64_t* a, size_t an, const uint64_t* b, size_t bn);
+
+/**
+ * d = a + b in any base where an >= bn. d has an limbs and may alias a or b.
+ * Returns the carry out of the top limb
+ */
+static uint64_t limbs_add(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base);
+
+/**
+ * limbs_add with the bn limb overlap split across the thread pool
+ */
+static uint64_t limbs_add_parallel(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base);
+
+/**
+ * Workers in the thread pool (starting it if it isn't yet)
+ */
+static size_t pool_get(void);
+
+/**
+ * Number of limbs of [data] once leading zero limbs are dropped
+ */
+static size_t limbs_strip(const uint8_t* data, size_t n, size_t span);
+
+/**
+ * Compares two limb arrays by value. Returns -1, 0 or 1
+ */
+static int limbs_cmp(const uint8_t* a, size_t an, const uint8_t* b, size_t bn, size_t span);
+
+/**
+ * Replaces dest's data with [data] ([cap] limbs, malloced) and sets its
+ * size from the significant limbs. Frees data if it copies instead
+ */
+static int bi_take_limbs(struct big_uint* dest, uint8_t* data, size_t cap);
+
+/**
+ * Arena internals. [at_top]: bi's data ends at the arena's bump pointer
+ * (and was bumped after the innermost mark). [above_floor]: p was bumped
+ * after the innermost mark. [grow]: moves / extends bi's data to [bytes]
+ */
+static int arena_at_top(const struct bi_arena* arena, const struct big_uint* bi);
+static int arena_above_floor(const struct bi_arena* arena, const uint8_t* p);
+static int arena_grow(struct big_uint* bi, size_t bytes);
+static uint8_t* arena_alloc(struct bi_arena* arena, size_t bytes);
+static void arena_pop_bytes(struct bi_arena* arena, size_t bytes);
+
+/**
+ * Instrumentation hooks, nothing at all unless built with BI_STATS.
+ * STATS_ADD bumps a counter of the calling thread. STATS_OP times the rest
+ * of the enclosing block as [op] over [limbs] limbs of width [span] (0 to
+ * leave the span counts alone). STATS_CARRIES tallies the carry chains of
+ * a + b
+ */
+#ifdef BI_STATS
+struct stats_timer {
+  enum bi_stats_op op;
+  uint64_t start;
+};
+
+static void stats_add(uint64_t* counter, uint64_t n);
+static struct bi_stats* stats_local(void);
+static struct stats_timer stats_begin(enum bi_stats_op op, size_t limbs, size_t span);
+static void stats_end(struct stats_timer* timer);
+static void stats_carries(
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base);
+
+#define STATS_ADD(field, n) stats_add(&stats_local()->field, (n))
+#define STATS_OP(op, limbs, span) \
+  struct stats_timer _stats_timer __attribute__((cleanup(stats_end))) = stats_begin((op), (limbs), (span))
+#define STATS_CARRIES(a, an, b, bn, span, base) stats_carries((a), (an), (b), (bn), (span), (base))
+#else
+#define STATS_ADD(field, n) ((void)0)
+#define STATS_OP(op, limbs, span) ((void)0)
+#define STATS_CARRIES(a, an, b, bn, span, base) ((void)0)
+#endif
 
 ////////////////////////////////////////////// Main API Methods
+/**
+ * Whether bi's limbs are still in its inline buffer
+ */
+#define BI_IS_SMALL(bi) ((bi)->data == (uint8_t*)(bi)->small)
+
+/**
+ * Allocator for bi's heap limbs (values put together by hand have none)
+ */
+#define BI_ALLOC(bi) ((bi)->alloc ? (bi)->alloc : &bi_allocator_malloc)
+
+/**
+ * bi_init without validating base (so BI_BASE_2_64 gets through)
+ */
+static int bi_init_arena(
+  struct big_uint* bi,
+  uint64_t start,
+  uint64_t base,
+  struct bi_arena* arena)
+{
+  // Heap values start out in the inline buffer, arena ones are cheap anyway
+  size_t start_cap = arena ? 8 : BI_INLINE_BYTES;
+  struct big_uint ret = {
+    .data = arena ? arena_alloc(arena, start_cap) : NULL,
+    .size = 0,
+    .capacity = start_cap,
+    .arena = arena,
+    .alloc = bi_get_default_allocator(),
+    .base = base,
+    .span = base == BI_BASE_2_64 ? UI64 : span_from_base(base),
+    .base_inv = recip_init(base).v
+  };
+
+  if (arena && !ret.data) {
+    bi_error("Couldn't allocate data in bi_init\n");
+    return -1;
+  }
+
+  if (arena)
+    memset(ret.data, 0, start_cap);
+  memcpy(bi, &ret, sizeof(struct big_uint));
+  if (!arena)
+    bi->data = (uint8_t*)bi->small;
+
+  return bi_add_sc(bi, start);
+}
+
+static int bi_init_base(
+  struct big_uint* bi,
+  uint64_t start,
+  uint64_t base)
+{
+  return bi_init_arena(bi, start, base, NULL);
+}
+
 int bi_init(
   struct big_uint* bi, 
   uint64_t start, 
@@ -62,251 +267,8653 @@ int bi_init(
     bi_error("Invalid base: %" PRIu64 ". Required: 2 <= base <= %" PRIu64 "\n", base, MAX_BASE);
     return -1;
   }
+  return bi_init_base(bi, start, base);
+}
+
+int bi_init_bin(
+  struct big_uint* bi,
+  uint64_t start)
+{
+  return bi_init_base(bi, start, BI_BASE_2_64);
+}
+
+/**
+ * A simple test that has expected status and actual status
+ */
+static int test_bi_init_status_code_once(uint64_t start, uint64_t base, int status_exp) {
+  struct big_uint bi;
+  memset(&bi, 0, sizeof(struct big_uint));
+  int status_actual = bi_init(&bi, start, base);
+  bi_free(&bi);
+  int ret = -(status_exp != status_actual);
+  
+  if(ret)
+    bi_test_failed("bi_init(start = %" PRIu64 ", base = %" PRIu64 ") - "
+                   "Expected return status: %d, got: %d\n", start, base, status_exp, status_actual);
+  else
+    bi_test_passed("bi_init(start = %" PRIu64 ", base = %" PRIu64 ")\n", start, base);
+
+  return ret;
+}
+
+/**
+ * Values start in the inline buffer and spill to the heap once they
+ * outgrow it, keeping their digits
+ */
+static int test_bi_init_small_once(uint64_t base)
+{
+  struct big_uint bi, one;
+  int ret = bi_init_base(&bi, 1, base) || bi_init_base(&one, 1, base);
+  ret = ret || !BI_IS_SMALL(&bi);
+
+  // x = 2x + 1 until the limbs no longer fit inline
+  uint64_t expect = 1;
+  for (int i = 0; !ret && i < 150; ++i) {
+    ret = bi_add_bi(&bi, &bi) || bi_add_bi(&bi, &one);
+    expect = 2 * expect + 1;
+  }
+  ret = ret || BI_IS_SMALL(&bi) || bi.size * bi.span <= BI_INLINE_BYTES;
+
+  // Low 64 bits still match: value mod 2^64 through the limbs
+  uint64_t low = 0;
+  if (!ret && base == BI_BASE_2_64) {
+    low = limb_get(bi.data, 0, bi.span);
+  } else if (!ret) {
+    for (size_t i = bi.size; i-- > 0;)
+      low = low * base + limb_get(bi.data, i, bi.span);
+  }
+  ret = ret || low != expect;
+
+  if (ret)
+    bi_test_failed("bi_init inline storage (base = %" PRIu64 ")\n", base);
+  else
+    bi_test_passed("bi_init inline storage (base = %" PRIu64 ")\n", base);
+  bi_free(&bi);
+  bi_free(&one);
+  return ret;
+}
+
+int test_bi_init()
+{
+  int ret = 0;
+  ret = test_bi_init_status_code_once(0, 0, -1) || ret;
+  ret = test_bi_init_status_code_once(0, 1, -1) || ret;
+  ret = test_bi_init_status_code_once(0, 1lu << 63, -1) || ret;
+  ret = test_bi_init_status_code_once(0, (1lu << 63) - 1, 0) || ret;
+  ret = test_bi_init_status_code_once(0, (uint64_t)-1, -1) || ret;
+
+  uint64_t bases[] = { 10, 1000000000, MAX_BASE, BI_BASE_2_64 };
+  for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i)
+    ret = test_bi_init_small_once(bases[i]) || ret;
+
+  return ret;
+}
+
+void bi_free(struct big_uint* bi)
+{
+  if (bi->arena) {
+    // Only the newest value can go back, the rest waits for a release
+    if (bi->data && arena_at_top(bi->arena, bi))
+      arena_pop_bytes(bi->arena, bi->capacity);
+  } else if (bi->data && !BI_IS_SMALL(bi)) {
+    const struct bi_allocator* alloc = BI_ALLOC(bi);
+    alloc->free(alloc->ctx, bi->data, bi->capacity);
+  }
+  bi->data = NULL;
+}
+
+static void bi_print8(const struct big_uint* bi) {
+  uint8_t *data = bi->data;
+  printf("{BI: (size: %zu, capacity: %zu base: %" PRIu64") - ", bi->size, bi->capacity, bi->base);
+  printf("(");
+  for(int i = bi->size - 1; i > 0; --i){
+    printf("%d ", data[i]);
+  }
+  printf("%d)", data[0]);
+  printf("}\n");
+}
+
+static void bi_print16(const struct big_uint* bi) {
+  uint16_t *data = (uint16_t*)bi->data;
+  printf("{BI: (size: %zu, capacity: %zu base: %" PRIu64") - ", bi->size, bi->capacity, bi->base);
+  printf("(");
+  for(int i = bi->size - 1; i > 0; --i){
+    printf("%d ", data[i]);
+  }
+  printf("%d)", data[0]);
+  printf("}\n");
+}
+
+static void bi_print32(const struct big_uint* bi) {
+  uint32_t *data = (uint32_t*)bi->data;
+  printf("{BI: (size: %zu, capacity: %zu base: %" PRIu64") - ", bi->size, bi->capacity, bi->base);
+  printf("(");
+  for(int i = bi->size - 1; i > 0; --i){
+    printf("%d ", data[i]);
+  }
+  printf("%d)", data[0]);
+  printf("}\n");
+}
+
+#define BI_PRINT(type, bi) ({ \
+  type *data = (type*)bi->data; \
+  printf("{BI: (size: %zu, capacity: %zu base: %" PRIu64") - ", bi->size, bi->capacity, bi->base); \
+  printf("("); \
+  for(int i = bi->size - 1; i > 0; --i) \
+    printf("%" PRIu64 " ", (uint64_t)data[i]); \
+  printf("%" PRIu64 ")", (uint64_t)data[0]); \
+  printf("}\n"); \
+})
+
+static void bi_print64(const struct big_uint* bi) {
+  BI_PRINT(uint64_t, bi);
+}
+
+void bi_print(const struct big_uint* bi) {
+  switch(bi->span){
+    case UI8:
+      BI_PRINT(uint8_t, bi);
+      return;
+    case UI16:
+      bi_print16(bi);
+      return;
+    case UI32:
+      bi_print32(bi);
+      return;
+    case UI64:
+      bi_print64(bi);
+      return;
+    default:
+      assert(0);
+  }
+}
+
+static int ensure_capacity_big_enough(
+  struct big_uint* bi,
+  size_t size
+) {
+  size_t need = bi->span * size;
+  if(bi->capacity >= need)
+    return 0;
+  size_t new_capacity = bi->capacity;
+  while(new_capacity < need)
+    new_capacity *= 2;
+  return grow_capacity(bi, new_capacity);
+}
+
+int bi_add_bi(
+    struct big_uint* dest,
+    const struct big_uint* right)
+{
+  // I think you _can_ add different bases, but I'll worry about that later
+  if (dest->base != right->base) {
+    bi_error("Can only add two big ints if they have the same base\n");
+    return -1;
+  }
+
+  // Size of the maximum number plus one for carry
+  size_t max_size = (dest->size > right->size ? dest->size : right->size) + 1;
+  STATS_CARRIES(dest->data, dest->size, right->data, right->size, dest->span, dest->base);
+  STATS_OP(BI_OP_ADD_BI, max_size, dest->span);
+  if (ensure_capacity_big_enough(dest, max_size))
+    return -1;
+
+  // Set the uninitialized space of dest to zero (after growing - dest may
+  // have moved, and right may be dest)
+  size_t span = dest->span;
+  memset(dest->data + dest->size * span, 0, (max_size - dest->size) * span);
+  int parallel = right->size >= bi_add_parallel_threshold && pool_get();
+  limb_set(dest->data, max_size - 1, span, (parallel ? limbs_add_parallel : limbs_add)(
+      dest->data, dest->data, max_size - 1,
+      right->data, right->size, span, dest->base));
+  dest->size = limbs_strip(dest->data, max_size, span);
+  return 0;
+}
+
+int test_bi_add_bi()
+{
+  struct big_uint left;
+  struct big_uint right;
+  int ret = 0;
+
+  bi_init(&left, 10, 10);
+  bi_init(&right, 10, 2);
+  if (!bi_add_bi(&left, &right)) {
+    bi_test_failed("bi_add_bi different bases\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_add_bi different bases\n");
+  }
+  bi_free(&left);
+  bi_free(&right);
+
+  bi_init(&left, 10, 10);
+  bi_init(&right, 10, 10);
+  if (bi_add_bi(&left, &right)) {
+    bi_test_failed("bi_add_bi (10 + 10)\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_add_bi (10 + 10)\n");
+  }
+  bi_free(&left);
+  bi_free(&right);
+
+  return ret;
+}
+
+/**
+ * Big Int += Scalar
+ */
+int bi_add_sc(
+    struct big_uint* dest,
+    const uint64_t right)
+{
+  STATS_OP(BI_OP_ADD_SC, dest->size, dest->span);
+  uint64_t carry = right;
+  struct recip r = bi_recip(dest);
+  size_t i = 0;
+  while(carry) {
+    if(i == dest->size) {
+      if(ensure_capacity_big_enough(dest, i + 1))
+        return -1;
+      limb_set(dest->data, i, dest->span, 0);
+      dest->size++;
+    }
+
+    if(dest->base == BI_BASE_2_64) {
+      uint64_t* data = (uint64_t*)dest->data;
+      carry = __builtin_add_overflow(data[i], carry, &data[i]);
+      i++;
+      continue;
+    }
+
+    // carry can be as big as a whole word, so split it before adding
+    // to keep the digit sum below 2 * base
+    uint64_t digit;
+    carry = recip_divmod(0, carry, &r, &digit);
+    digit += limb_get(dest->data, i, dest->span);
+    if(digit >= dest->base) {
+      digit -= dest->base;
+      carry++;
+    }
+    limb_set(dest->data, i, dest->span, digit);
+    i++;
+  }
+  return 0;
+}
+
+////////////////////////////////////////////// Limb Kernels
+/**
+ * Everything below works on raw little endian limb arrays (limb i lives at
+ * byte i * span) so the recursive algorithms can address halves and thirds
+ * of a number without building a struct big_uint for each of them.
+ */
+#define LIMB_PTR(data, i, span) ((data) + (i) * (span))
+
+static inline uint64_t limb_get(const uint8_t* data, size_t i, size_t span)
+{
+  switch(span){
+    case UI8:
+      return data[i];
+    case UI16:
+      return ((const uint16_t*)data)[i];
+    case UI32:
+      return ((const uint32_t*)data)[i];
+    case UI64:
+      return ((const uint64_t*)data)[i];
+    default:
+      assert(0);
+  }
+  return 0;
+}
+
+static inline void limb_set(uint8_t* data, size_t i, size_t span, uint64_t val)
+{
+  switch(span){
+    case UI8:
+      data[i] = (uint8_t)val;
+      return;
+    case UI16:
+      ((uint16_t*)data)[i] = (uint16_t)val;
+      return;
+    case UI32:
+      ((uint32_t*)data)[i] = (uint32_t)val;
+      return;
+    case UI64:
+      ((uint64_t*)data)[i] = val;
+      return;
+    default:
+      assert(0);
+  }
+}
+
+static inline uint64_t dw_divmod(uint64_t hi, uint64_t lo, uint64_t base, uint64_t* rem)
+{
+  if(!base) {
+    *rem = lo;
+    return hi;
+  }
+  assert(hi < base);
+#if defined(__x86_64__) && defined(__GNUC__)
+  uint64_t q, r;
+  __asm__("divq %4" : "=a"(q), "=d"(r) : "a"(lo), "d"(hi), "rm"(base));
+  *rem = r;
+  return q;
+#else
+  unsigned __int128 n = ((unsigned __int128)hi << 64) | lo;
+  uint64_t q = (uint64_t)(n / base);
+  *rem = lo - q * base;
+  return q;
+#endif
+}
+
+static inline struct recip recip_init(uint64_t d)
+{
+  struct recip r = { 0, 0, 0 };
+  if(!d)
+    return r;
+  r.shift = __builtin_clzl(d);
+  r.d = d << r.shift;
+  uint64_t rem;
+  r.v = dw_divmod(~r.d, UINT64_MAX, r.d, &rem);
+  return r;
+}
+
+static inline struct recip bi_recip(const struct big_uint* bi)
+{
+  if(!bi->base_inv)
+    return recip_init(bi->base);
+  int shift = __builtin_clzl(bi->base);
+  struct recip r = { bi->base << shift, bi->base_inv, shift };
+  return r;
+}
+
+static inline uint64_t recip_divmod(uint64_t hi, uint64_t lo, const struct recip* r, uint64_t* rem)
+{
+  if(!r->d) {
+    *rem = lo;
+    return hi;
+  }
+  assert(hi < r->d >> r->shift);
+  // Shifting both sides keeps the quotient, the remainder comes out shifted
+  uint64_t nh = r->shift ? hi << r->shift | lo >> (64 - r->shift) : hi;
+  uint64_t nl = lo << r->shift;
+  unsigned __int128 q = (unsigned __int128)r->v * nh + ((unsigned __int128)(nh + 1) << 64 | nl);
+  uint64_t q1 = (uint64_t)(q >> 64);
+  uint64_t rm = nl - q1 * r->d;
+  // The estimate is at most one too big, and rarely one too small. Which
+  // way the first check goes is a coin toss, so it's done with a mask
+  uint64_t over = -(uint64_t)(rm > (uint64_t)q);
+  q1 += over;
+  rm += r->d & over;
+  if(__builtin_expect(rm >= r->d, 0)) {
+    q1++;
+    rm -= r->d;
+  }
+  *rem = rm >> r->shift;
+  return q1;
+}
+
+static size_t limbs_strip(const uint8_t* data, size_t n, size_t span)
+{
+  while(n && !limb_get(data, n - 1, span))
+    n--;
+  return n;
+}
+
+static int limbs_cmp(const uint8_t* a, size_t an, const uint8_t* b, size_t bn, size_t span)
+{
+  an = limbs_strip(a, an, span);
+  bn = limbs_strip(b, bn, span);
+  if(an != bn)
+    return an < bn ? -1 : 1;
+  while(an--) {
+    uint64_t l = limb_get(a, an, span);
+    uint64_t r = limb_get(b, an, span);
+    if(l != r)
+      return l < r ? -1 : 1;
+  }
+  return 0;
+}
+
+/**
+ * Copies [an] limbs of a into d and zeroes d up to [dn] limbs
+ */
+static void limbs_copy_pad(uint8_t* d, size_t dn, const uint8_t* a, size_t an, size_t span)
+{
+  assert(an <= dn);
+  memmove(d, a, an * span);
+  memset(LIMB_PTR(d, an, span), 0, (dn - an) * span);
+}
+
+/**
+ * The carry flag chain for BI_BASE_2_64. adc / sbb through the intrinsics
+ * where we have them, otherwise the overflow builtins (which gcc and clang
+ * still lower to adc on most targets)
+ */
+#if defined(__x86_64__)
+#define ADDC_U64(c, a, b, out) _addcarry_u64((c), (a), (b), (unsigned long long*)(out))
+#define SUBB_U64(c, a, b, out) _subborrow_u64((c), (a), (b), (unsigned long long*)(out))
+#else
+#define ADDC_U64(c, a, b, out) ({                                             \
+  uint64_t _t;                                                                \
+  unsigned char _c1 = __builtin_add_overflow((a), (b), &_t);                  \
+  unsigned char _c2 = __builtin_add_overflow(_t, (uint64_t)(c), (out));       \
+  (unsigned char)(_c1 | _c2);                                                 \
+})
+#define SUBB_U64(c, a, b, out) ({                                             \
+  uint64_t _t;                                                                \
+  unsigned char _b1 = __builtin_sub_overflow((a), (b), &_t);                  \
+  unsigned char _b2 = __builtin_sub_overflow(_t, (uint64_t)(c), (out));       \
+  (unsigned char)(_b1 | _b2);                                                 \
+})
+#endif
+
+static uint64_t limbs_add_bin(uint64_t* d, const uint64_t* a, size_t an, const uint64_t* b, size_t bn)
+{
+  assert(an >= bn);
+  unsigned char c = 0;
+  size_t i = 0;
+  // Unrolled by 4 so the loop counter doesn't get in the way of the flags
+  for(; i + 4 <= bn; i += 4) {
+    c = ADDC_U64(c, a[i], b[i], &d[i]);
+    c = ADDC_U64(c, a[i + 1], b[i + 1], &d[i + 1]);
+    c = ADDC_U64(c, a[i + 2], b[i + 2], &d[i + 2]);
+    c = ADDC_U64(c, a[i + 3], b[i + 3], &d[i + 3]);
+  }
+  for(; i < bn; ++i)
+    c = ADDC_U64(c, a[i], b[i], &d[i]);
+  for(; c && i < an; ++i)
+    c = ADDC_U64(c, a[i], 0, &d[i]);
+  if(d != a)
+    memcpy(d + i, a + i, (an - i) * sizeof(uint64_t));
+  return c;
+}
+
+static uint64_t limbs_sub_bin(uint64_t* d, const uint64_t* a, size_t an, const uint64_t* b, size_t bn)
+{
+  assert(an >= bn);
+  unsigned char br = 0;
+  size_t i = 0;
+  for(; i + 4 <= bn; i += 4) {
+    br = SUBB_U64(br, a[i], b[i], &d[i]);
+    br = SUBB_U64(br, a[i + 1], b[i + 1], &d[i + 1]);
+    br = SUBB_U64(br, a[i + 2], b[i + 2], &d[i + 2]);
+    br = SUBB_U64(br, a[i + 3], b[i + 3], &d[i + 3]);
+  }
+  for(; i < bn; ++i)
+    br = SUBB_U64(br, a[i], b[i], &d[i]);
+  for(; br && i < an; ++i)
+    br = SUBB_U64(br, a[i], 0, &d[i]);
+  if(d != a)
+    memcpy(d + i, a + i, (an - i) * sizeof(uint64_t));
+  return br;
+}
+
+/**
+ * Vectorized arbitrary base add. Every lane holds a + b (< 2 * base, which
+ * is what span_from_base sizes limbs for), then per block:
+ *   g = lanes >= base (generate), p = lanes == base - 1 (propagate)
+ *   carry into each lane: c = (((g << 1) | cin) + p) ^ p
+ *   carry out of the block: top lane of g | (p & c)
+ * and base is subtracted from every lane in g | (p & c) with a mask, so
+ * the only serial part left is one scalar add per block.
+ *
+ * Runtime dispatched: 0 = scalar, 1 = AVX2, 2 = AVX-512 (BW)
+ */
+static int simd_add_level = -1;
+
+static int simd_add_level_get()
+{
+  if(simd_add_level < 0) {
+    simd_add_level = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+    if(__builtin_cpu_supports("avx512bw"))
+      simd_add_level = 2;
+    else if(__builtin_cpu_supports("avx2"))
+      simd_add_level = 1;
+#endif
+  }
+  return simd_add_level;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+
+/**
+ * Lane masks (one bit per lane) to and from AVX2 vectors
+ */
+TARGET_AVX2 static inline uint64_t avx2_mask8(__m256i v) { return (uint32_t)_mm256_movemask_epi8(v); }
+TARGET_AVX2 static inline uint64_t avx2_mask16(__m256i v)
+{
+  // Saturating pack keeps 0 / -1, the permute undoes the 128 bit interleave
+  v = _mm256_permute4x64_epi64(_mm256_packs_epi16(v, _mm256_setzero_si256()), 0xD8);
+  return (uint32_t)_mm256_movemask_epi8(v) & 0xFFFF;
+}
+TARGET_AVX2 static inline uint64_t avx2_mask32(__m256i v) { return _mm256_movemask_ps(_mm256_castsi256_ps(v)); }
+TARGET_AVX2 static inline uint64_t avx2_mask64(__m256i v) { return _mm256_movemask_pd(_mm256_castsi256_pd(v)); }
+
+TARGET_AVX2 static inline __m256i avx2_expand8(uint64_t m)
+{
+  // Byte i picks mask byte i / 8 then tests bit i % 8
+  const __m256i idx = _mm256_setr_epi8(
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+      2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+  const __m256i bit = _mm256_set1_epi64x(0x8040201008040201);
+  __m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32((int)m), idx);
+  return _mm256_cmpeq_epi8(_mm256_and_si256(v, bit), bit);
+}
+TARGET_AVX2 static inline __m256i avx2_expand16(uint64_t m)
+{
+  const __m256i bit = _mm256_setr_epi16(
+      1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, -32768);
+  return _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16((short)m), bit), bit);
+}
+TARGET_AVX2 static inline __m256i avx2_expand32(uint64_t m)
+{
+  const __m256i bit = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)m), bit), bit);
+}
+TARGET_AVX2 static inline __m256i avx2_expand64(uint64_t m)
+{
+  const __m256i bit = _mm256_setr_epi64x(1, 2, 4, 8);
+  return _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x((long long)m), bit), bit);
+}
+
+/**
+ * d = a + b over the first n / lanes blocks, starting from (and updating)
+ * *carry. Returns how many limbs were done. d may alias a or b
+ */
+#define LIMBS_ADD_AVX2(bits, set1) \
+TARGET_AVX2 static size_t limbs_add_avx2_##bits(                                     \
+  uint8_t* d, const uint8_t* a, const uint8_t* b, size_t n,                   \
+  uint64_t base, uint64_t* carry)                                             \
+{                                                                             \
+  const size_t lanes = 256 / bits;                                            \
+  const uint64_t all = lanes == 64 ? UINT64_MAX : (1lu << lanes) - 1;         \
+  /* No unsigned compares in AVX2, so flip the sign bits first */             \
+  const __m256i sign = set1((int##bits##_t)((uint64_t)1 << (bits - 1)));      \
+  const __m256i vb = set1((int##bits##_t)base);                               \
+  const __m256i vbs = _mm256_xor_si256(vb, sign);                             \
+  const __m256i vbm1 = set1((int##bits##_t)(base - 1));                       \
+  const __m256i one = set1(1);                                                \
+  uint64_t c = *carry;                                                        \
+  size_t i = 0;                                                               \
+  for(; i + lanes <= n; i += lanes) {                                         \
+    __m256i s = _mm256_add_epi##bits(                                         \
+        _mm256_loadu_si256((const __m256i*)(a + i * (bits / 8))),             \
+        _mm256_loadu_si256((const __m256i*)(b + i * (bits / 8))));            \
+    uint64_t g = ~avx2_mask##bits(_mm256_cmpgt_epi##bits(                     \
+        vbs, _mm256_xor_si256(s, sign))) & all;                               \
+    uint64_t p = avx2_mask##bits(_mm256_cmpeq_epi##bits(s, vbm1));            \
+    uint64_t ci = ((((g << 1) | c) + p) ^ p) & all;                           \
+    uint64_t wrap = g | (p & ci);                                             \
+    c = wrap >> (lanes - 1);                                                  \
+    s = _mm256_add_epi##bits(s, _mm256_and_si256(avx2_expand##bits(ci), one)); \
+    s = _mm256_sub_epi##bits(s, _mm256_and_si256(avx2_expand##bits(wrap), vb)); \
+    _mm256_storeu_si256((__m256i*)(d + i * (bits / 8)), s);                   \
+  }                                                                           \
+  *carry = c;                                                                 \
+  return i;                                                                   \
+}
+
+LIMBS_ADD_AVX2(8, _mm256_set1_epi8)
+LIMBS_ADD_AVX2(16, _mm256_set1_epi16)
+LIMBS_ADD_AVX2(32, _mm256_set1_epi32)
+LIMBS_ADD_AVX2(64, _mm256_set1_epi64x)
+
+/**
+ * Same as LIMBS_ADD_AVX2 with native unsigned compares and mask registers
+ */
+#define LIMBS_ADD_AVX512(bits) \
+TARGET_AVX512 static size_t limbs_add_avx512_##bits(                                 \
+  uint8_t* d, const uint8_t* a, const uint8_t* b, size_t n,                   \
+  uint64_t base, uint64_t* carry)                                             \
+{                                                                             \
+  const size_t lanes = 512 / bits;                                            \
+  const __m512i vb = _mm512_set1_epi##bits((int##bits##_t)base);             \
+  const __m512i vbm1 = _mm512_set1_epi##bits((int##bits##_t)(base - 1));      \
+  const __m512i one = _mm512_set1_epi##bits(1);                               \
+  uint64_t c = *carry;                                                        \
+  size_t i = 0;                                                               \
+  for(; i + lanes <= n; i += lanes) {                                         \
+    __m512i s = _mm512_add_epi##bits(                                         \
+        _mm512_loadu_si512(a + i * (bits / 8)),                               \
+        _mm512_loadu_si512(b + i * (bits / 8)));                              \
+    uint64_t g = _mm512_cmpge_epu##bits##_mask(s, vb);                        \
+    uint64_t p = _mm512_cmpeq_epi##bits##_mask(s, vbm1);                      \
+    uint64_t ci = (((g << 1) | c) + p) ^ p;                                   \
+    uint64_t wrap = g | (p & ci);                                             \
+    c = (wrap >> (lanes - 1)) & 1;                                            \
+    s = _mm512_mask_add_epi##bits(s, ci, s, one);                             \
+    s = _mm512_mask_sub_epi##bits(s, wrap, s, vb);                            \
+    _mm512_storeu_si512(d + i * (bits / 8), s);                               \
+  }                                                                           \
+  *carry = c;                                                                 \
+  return i;                                                                   \
+}
+
+LIMBS_ADD_AVX512(8)
+LIMBS_ADD_AVX512(16)
+LIMBS_ADD_AVX512(32)
+LIMBS_ADD_AVX512(64)
+#endif
+
+/**
+ * Runs as much of d = a + b (bn limbs) as fits the vector width. Returns
+ * how many limbs were done, with the carry out of them in *carry
+ */
+static size_t limbs_add_simd(
+  uint8_t* d, const uint8_t* a, const uint8_t* b, size_t bn,
+  size_t span, uint64_t base, uint64_t* carry)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+  switch(simd_add_level_get()) {
+    case 2:
+      switch(span) {
+        case UI8: return limbs_add_avx512_8(d, a, b, bn, base, carry);
+        case UI16: return limbs_add_avx512_16(d, a, b, bn, base, carry);
+        case UI32: return limbs_add_avx512_32(d, a, b, bn, base, carry);
+        case UI64: return limbs_add_avx512_64(d, a, b, bn, base, carry);
+      }
+      break;
+    case 1:
+      switch(span) {
+        case UI8: return limbs_add_avx2_8(d, a, b, bn, base, carry);
+        case UI16: return limbs_add_avx2_16(d, a, b, bn, base, carry);
+        case UI32: return limbs_add_avx2_32(d, a, b, bn, base, carry);
+        case UI64: return limbs_add_avx2_64(d, a, b, bn, base, carry);
+      }
+      break;
+  }
+#endif
+  (void)d; (void)a; (void)b; (void)bn; (void)span; (void)base; (void)carry;
+  return 0;
+}
+
+/**
+ * d = a + b where an >= bn. d has an limbs and may alias a or b.
+ * Picks up from limb [i0] with carry [c0] (whatever limbs_add_simd left).
+ * Returns the carry out of the top limb
+ */
+#define LIMBS_ADD(type, d, a, an, b, bn, base, i0, c0) ({                     \
+  type* _d = (type*)(d);                                                      \
+  const type* _a = (const type*)(a);                                          \
+  const type* _b = (const type*)(b);                                          \
+  const type _base = (type)(base);                                            \
+  type _c = (type)(c0);                                                       \
+  size_t _i = (i0);                                                           \
+  for(; _i < (bn); ++_i) {                                                    \
+    type _s = _a[_i] + _b[_i] + _c;                                           \
+    _c = _s >= _base;                                                         \
+    _d[_i] = _c ? _s - _base : _s;                                            \
+  }                                                                           \
+  for(; _c && _i < (an); ++_i) {                                              \
+    type _s = _a[_i] + _c;                                                    \
+    _c = _s >= _base;                                                         \
+    _d[_i] = _c ? _s - _base : _s;                                            \
+  }                                                                           \
+  /* Once the carry dies the rest is a straight copy */                       \
+  if(_d != _a)                                                                \
+    memcpy(_d + _i, _a + _i, ((an) - _i) * sizeof(type));                    \
+  (uint64_t)_c;                                                               \
+})
+
+static uint64_t limbs_add(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base)
+{
+  assert(an >= bn);
+  if(span == UI64 && base == BI_BASE_2_64)
+    return limbs_add_bin((uint64_t*)d, (const uint64_t*)a, an, (const uint64_t*)b, bn);
+
+  uint64_t c = 0;
+  size_t i = limbs_add_simd(d, a, b, bn, span, base, &c);
+  switch(span){
+    case UI8:
+      return LIMBS_ADD(uint8_t, d, a, an, b, bn, base, i, c);
+    case UI16:
+      return LIMBS_ADD(uint16_t, d, a, an, b, bn, base, i, c);
+    case UI32:
+      return LIMBS_ADD(uint32_t, d, a, an, b, bn, base, i, c);
+    case UI64:
+      return LIMBS_ADD(uint64_t, d, a, an, b, bn, base, i, c);
+    default:
+      assert(0);
+  }
+  return 0;
+}
+
+/**
+ * d = a - b where an >= bn. d has an limbs and may alias a or b.
+ * Returns the borrow out of the top limb (0 when a >= b)
+ */
+#define LIMBS_SUB(type, d, a, an, b, bn, base) ({                             \
+  type* _d = (type*)(d);                                                      \
+  const type* _a = (const type*)(a);                                          \
+  const type* _b = (const type*)(b);                                          \
+  const type _base = (type)(base);                                            \
+  type _br = 0;                                                               \
+  size_t _i = 0;                                                              \
+  for(; _i < (bn); ++_i) {                                                    \
+    type _t = _b[_i] + _br;                                                   \
+    _br = _a[_i] < _t;                                                        \
+    _d[_i] = _br ? _a[_i] + _base - _t : _a[_i] - _t;                         \
+  }                                                                           \
+  for(; _br && _i < (an); ++_i) {                                             \
+    _br = !_a[_i];                                                            \
+    _d[_i] = _br ? _base - 1 : _a[_i] - 1;                                    \
+  }                                                                           \
+  if(_d != _a)                                                                \
+    memcpy(_d + _i, _a + _i, ((an) - _i) * sizeof(type));                     \
+  (uint64_t)_br;                                                              \
+})
+
+static uint64_t limbs_sub(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base)
+{
+  assert(an >= bn);
+  switch(span){
+    case UI8:
+      return LIMBS_SUB(uint8_t, d, a, an, b, bn, base);
+    case UI16:
+      return LIMBS_SUB(uint16_t, d, a, an, b, bn, base);
+    case UI32:
+      return LIMBS_SUB(uint32_t, d, a, an, b, bn, base);
+    case UI64:
+      if(base == BI_BASE_2_64)
+        return limbs_sub_bin((uint64_t*)d, (const uint64_t*)a, an, (const uint64_t*)b, bn);
+      return LIMBS_SUB(uint64_t, d, a, an, b, bn, base);
+    default:
+      assert(0);
+  }
+  return 0;
+}
+
+/**
+ * d += a * base^off where d has dn limbs. The sum must fit in d
+ */
+static void limbs_add_at(
+  uint8_t* d, size_t dn, size_t off,
+  const uint8_t* a, size_t an,
+  size_t span, uint64_t base)
+{
+  an = limbs_strip(a, an, span);
+  assert(off + an <= dn);
+  uint64_t carry = limbs_add(
+      LIMB_PTR(d, off, span), LIMB_PTR(d, off, span), dn - off,
+      a, an, span, base);
+  assert(!carry);
+  (void)carry;
+}
+
+/**
+ * q = a / m where q has n limbs and may alias a. Returns a % m. Every step
+ * divides r * base + a[i] < m * base, so the quotient is a single limb
+ */
+#define LIMBS_DIVMOD_1(type, q, a, n, rm, base) ({                            \
+  type* _q = (type*)(q);                                                      \
+  const type* _a = (const type*)(a);                                          \
+  uint64_t _r = 0;                                                            \
+  for(size_t _i = (n); _i-- > 0;) {                                           \
+    unsigned __int128 _cur = (base) == BI_BASE_2_64                          \
+      ? (unsigned __int128)_r << 64 | _a[_i]                                  \
+      : (unsigned __int128)_r * (base) + _a[_i];                              \
+    _q[_i] = (type)recip_divmod((uint64_t)(_cur >> 64), (uint64_t)_cur, (rm), &_r); \
+  }                                                                           \
+  _r;                                                                         \
+})
+
+static uint64_t limbs_divmod_1(
+  uint8_t* q,
+  const uint8_t* a, size_t n,
+  uint64_t m,
+  size_t span, uint64_t base)
+{
+  assert(m);
+  struct recip rm = recip_init(m);
+  switch(span){
+    case UI8:
+      return LIMBS_DIVMOD_1(uint8_t, q, a, n, &rm, base);
+    case UI16:
+      return LIMBS_DIVMOD_1(uint16_t, q, a, n, &rm, base);
+    case UI32:
+      return LIMBS_DIVMOD_1(uint32_t, q, a, n, &rm, base);
+    case UI64:
+      return LIMBS_DIVMOD_1(uint64_t, q, a, n, &rm, base);
+    default:
+      assert(0);
+  }
+  return 0;
+}
+
+/**
+ * Schoolbook product scanning (Comba). Every column is summed in [wide]
+ * before a single reduction by base, so narrow spans do one division per
+ * output limb instead of one per partial product.
+ * d has an + bn limbs and must not alias a or b
+ */
+#define LIMBS_MUL_SCHOOL(type, wide, d, a, an, b, bn, base) ({                \
+  type* _d = (type*)(d);                                                      \
+  const type* _a = (const type*)(a);                                          \
+  const type* _b = (const type*)(b);                                          \
+  wide _carry = 0;                                                            \
+  for(size_t _k = 0; _k < (an) + (bn) - 1; ++_k) {                            \
+    wide _col = _carry;                                                       \
+    size_t _lo = _k >= (bn) ? _k - (bn) + 1 : 0;                              \
+    size_t _hi = _k < (an) ? _k : (an) - 1;                                   \
+    for(size_t _i = _lo; _i <= _hi; ++_i)                                     \
+      _col += (wide)_a[_i] * _b[_k - _i];                                     \
+    _d[_k] = (type)(_col % (base));                                           \
+    _carry = _col / (base);                                                   \
+  }                                                                           \
+  /* The product fits in an + bn limbs so what's left is one digit */         \
+  _d[(an) + (bn) - 1] = (type)_carry;                                         \
+})
+
+static void limbs_mul_school(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base)
+{
+  assert(an && bn);
+  switch(span){
+    case UI8:
+      LIMBS_MUL_SCHOOL(uint8_t, uint64_t, d, a, an, b, bn, base);
+      return;
+    case UI16:
+      LIMBS_MUL_SCHOOL(uint16_t, uint64_t, d, a, an, b, bn, base);
+      return;
+    case UI32:
+      LIMBS_MUL_SCHOOL(uint32_t, unsigned __int128, d, a, an, b, bn, base);
+      return;
+    case UI64: {
+      // Columns would need three words here, so go row by row instead -
+      // every partial product plus carry stays below base^2
+      uint64_t* _d = (uint64_t*)d;
+      const uint64_t* _a = (const uint64_t*)a;
+      const uint64_t* _b = (const uint64_t*)b;
+      struct recip rb = recip_init(base);
+      memset(_d, 0, (an + bn) * sizeof(uint64_t));
+      for(size_t i = 0; i < an; ++i) {
+        uint64_t carry = 0;
+        for(size_t j = 0; j < bn; ++j) {
+          unsigned __int128 acc = (unsigned __int128)_a[i] * _b[j] + _d[i + j] + carry;
+          carry = recip_divmod((uint64_t)(acc >> 64), (uint64_t)acc, &rb, &_d[i + j]);
+        }
+        _d[i + bn] = carry;
+      }
+      return;
+    }
+    default:
+      assert(0);
+  }
+}
+
+////////////////////////////////////////////// Multiplication
+size_t bi_karatsuba_threshold = 32;
+size_t bi_toom3_threshold = 128;
+
+/**
+ * Bump allocator handed down the multiplication recursion. Children get a
+ * copy so whatever they take is released when they return
+ */
+struct scratch {
+  uint8_t* head;
+  uint8_t* end;
+};
+
+static uint8_t* scratch_take(struct scratch* s, size_t bytes)
+{
+  uint8_t* ret = s->head;
+  s->head += bytes;
+  assert(s->head <= s->end);
+  return ret;
+}
+
+/**
+ * n aligned words from s, or NULL if s (which can be NULL) is too short
+ */
+static uint64_t* scratch_try_words(struct scratch* s, size_t n)
+{
+  if (!s || !s->head)
+    return NULL;
+  uint8_t* p = (uint8_t*)(((uintptr_t)s->head + 7) & ~(uintptr_t)7);
+  if (p > s->end || (size_t)(s->end - p) / sizeof(uint64_t) < n)
+    return NULL;
+  s->head = p + n * sizeof(uint64_t);
+  return (uint64_t*)p;
+}
+
+static size_t karatsuba_threshold()
+{
+  return bi_karatsuba_threshold < 8 ? 8 : bi_karatsuba_threshold;
+}
+
+static size_t toom3_threshold()
+{
+  return bi_toom3_threshold < 24 ? 24 : bi_toom3_threshold;
+}
+
+/**
+ * Upper bound on the scratch limbs limbs_mul needs for an n limb operand.
+ * @note Each level takes at most ~14n/3 limbs and recurses on at most n/2 + 2,
+ * which stays under this bound as long as the thresholds are clamped as above
+ */
+static size_t mul_scratch_limbs(size_t n)
+{
+  size_t bits = 0;
+  while(n >> bits)
+    bits++;
+  return 16 * n + 128 * bits + 256;
+}
+
+static void limbs_mul(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base,
+  struct scratch s);
+
+/**
+ * an >= 2 * bn - 1: multiply bn limb chunks of a by b and add them up
+ */
+static void limbs_mul_unbalanced(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base,
+  struct scratch s)
+{
+  uint8_t* tmp = scratch_take(&s, 2 * bn * span);
+  memset(d, 0, (an + bn) * span);
+  for(size_t off = 0; off < an; off += bn) {
+    size_t c = an - off < bn ? an - off : bn;
+    limbs_mul(tmp, b, bn, LIMB_PTR(a, off, span), c, span, base, s);
+    limbs_add_at(d, an + bn, off, tmp, bn + c, span, base);
+  }
+}
+
+/**
+ * (a1 B^h + a0)(b1 B^h + b0) = z2 B^2h + z1 B^h + z0 with
+ * z1 = (a0 + a1)(b0 + b1) - z0 - z2
+ */
+static void limbs_mul_karatsuba(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base,
+  struct scratch s)
+{
+  size_t h = (an + 1) / 2;
+  size_t l = h + 1;
+  assert(bn > h);
+
+  uint8_t* sa = scratch_take(&s, l * span);
+  uint8_t* sb = scratch_take(&s, l * span);
+  uint8_t* z1 = scratch_take(&s, 2 * l * span);
+
+  limb_set(sa, h, span, limbs_add(sa, a, h, LIMB_PTR(a, h, span), an - h, span, base));
+  limb_set(sb, h, span, limbs_add(sb, b, h, LIMB_PTR(b, h, span), bn - h, span, base));
+
+  // z0 and z2 land directly in their final place
+  limbs_mul(d, a, h, b, h, span, base, s);
+  limbs_mul(LIMB_PTR(d, 2 * h, span),
+      LIMB_PTR(a, h, span), an - h,
+      LIMB_PTR(b, h, span), bn - h,
+      span, base, s);
+  limbs_mul(z1, sa, l, sb, l, span, base, s);
+
+  limbs_sub(z1, z1, 2 * l, d, 2 * h, span, base);
+  limbs_sub(z1, z1, 2 * l, LIMB_PTR(d, 2 * h, span), an + bn - 2 * h, span, base);
+  limbs_add_at(d, an + bn, h, z1, 2 * l, span, base);
+}
+
+/**
+ * Evaluates a0 + a1 x + a2 x^2 at 1, -1 and 2 into l limb buffers.
+ * Returns the sign of the value at -1 (whose magnitude goes in pm1)
+ */
+static int toom3_eval(
+  uint8_t* p1, uint8_t* pm1, uint8_t* p2, size_t l,
+  const uint8_t* a, size_t an, size_t k,
+  size_t span, uint64_t base)
+{
+  const uint8_t* a0 = a;
+  const uint8_t* a1 = LIMB_PTR(a, k, span);
+  const uint8_t* a2 = LIMB_PTR(a, 2 * k, span);
+  size_t a2n = an - 2 * k;
+  int sign = 1;
+
+  // p1 = a0 + a2 for now
+  limbs_copy_pad(p1, l, a0, k, span);
+  limbs_add(p1, p1, l, a2, a2n, span, base);
+
+  // pm1 = |a0 + a2 - a1|
+  if(limbs_cmp(p1, l, a1, k, span) >= 0) {
+    limbs_sub(pm1, p1, l, a1, k, span, base);
+  } else {
+    limbs_copy_pad(pm1, l, a1, k, span);
+    limbs_sub(pm1, pm1, l, p1, l, span, base);
+    sign = -1;
+  }
+  limbs_add(p1, p1, l, a1, k, span, base);
+
+  // p2 = ((2 a2 + a1) * 2) + a0
+  limbs_copy_pad(p2, l, a2, a2n, span);
+  limbs_add(p2, p2, l, p2, l, span, base);
+  limbs_add(p2, p2, l, a1, k, span, base);
+  limbs_add(p2, p2, l, p2, l, span, base);
+  limbs_add(p2, p2, l, a0, k, span, base);
+
+  return sign;
+}
+
+/**
+ * Toom-3 over the points 0, 1, -1, 2 and infinity. The interpolation order is
+ * chosen so that only r(-1) is ever negative:
+ *   c2 = (r(1) + r(-1)) / 2 - c0 - c4
+ *   c3 = ((r(2) - c0 - 4 c2 - 16 c4) / 2 - (r(1) - r(-1)) / 2) / 3
+ *   c1 = (r(1) - r(-1)) / 2 - c3
+ */
+static void limbs_mul_toom3(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base,
+  struct scratch s)
+{
+  size_t k = (an + 2) / 3;
+  size_t dn = an + bn;
+  assert(bn > 2 * k);
+
+  // 7 * base^k < base^(k + 3) for every base >= 2
+  size_t l = k + 3;
+  size_t r = 2 * l;
+
+  uint8_t* pa1 = scratch_take(&s, l * span);
+  uint8_t* pam1 = scratch_take(&s, l * span);
+  uint8_t* pa2 = scratch_take(&s, l * span);
+  uint8_t* pb1 = scratch_take(&s, l * span);
+  uint8_t* pbm1 = scratch_take(&s, l * span);
+  uint8_t* pb2 = scratch_take(&s, l * span);
+  uint8_t* r1 = scratch_take(&s, r * span);
+  uint8_t* rm1 = scratch_take(&s, r * span);
+  uint8_t* r2 = scratch_take(&s, r * span);
+  uint8_t* t = scratch_take(&s, r * span);
+
+  int sign = toom3_eval(pa1, pam1, pa2, l, a, an, k, span, base);
+  sign *= toom3_eval(pb1, pbm1, pb2, l, b, bn, k, span, base);
+
+  // c0 and c4 land directly in their final place
+  uint8_t* c0 = d;
+  uint8_t* c4 = LIMB_PTR(d, 4 * k, span);
+  size_t c4n = dn - 4 * k;
+  limbs_mul(c0, a, k, b, k, span, base, s);
+  memset(LIMB_PTR(d, 2 * k, span), 0, 2 * k * span);
+  limbs_mul(c4,
+      LIMB_PTR(a, 2 * k, span), an - 2 * k,
+      LIMB_PTR(b, 2 * k, span), bn - 2 * k,
+      span, base, s);
+
+  limbs_mul(r1, pa1, l, pb1, l, span, base, s);
+  limbs_mul(rm1, pam1, l, pbm1, l, span, base, s);
+  limbs_mul(r2, pa2, l, pb2, l, span, base, s);
+
+  // t = (r(1) - r(-1)) / 2, r1 = (r(1) + r(-1)) / 2
+  if(sign > 0) {
+    limbs_sub(t, r1, r, rm1, r, span, base);
+    limbs_add(r1, r1, r, rm1, r, span, base);
+  } else {
+    limbs_add(t, r1, r, rm1, r, span, base);
+    limbs_sub(r1, r1, r, rm1, r, span, base);
+  }
+  limbs_divmod_1(t, t, r, 2, span, base);
+  limbs_divmod_1(r1, r1, r, 2, span, base);
+
+  // r1 = c2
+  limbs_sub(r1, r1, r, c0, 2 * k, span, base);
+  limbs_sub(r1, r1, r, c4, c4n, span, base);
+
+  // r2 = c3, rm1 is free to hold 4 c2 and 16 c4
+  limbs_sub(r2, r2, r, c0, 2 * k, span, base);
+  limbs_copy_pad(rm1, r, r1, r, span);
+  for(int i = 0; i < 2; ++i)
+    limbs_add(rm1, rm1, r, rm1, r, span, base);
+  limbs_sub(r2, r2, r, rm1, r, span, base);
+  limbs_copy_pad(rm1, r, c4, c4n, span);
+  for(int i = 0; i < 4; ++i)
+    limbs_add(rm1, rm1, r, rm1, r, span, base);
+  limbs_sub(r2, r2, r, rm1, r, span, base);
+  limbs_divmod_1(r2, r2, r, 2, span, base);
+  limbs_sub(r2, r2, r, t, r, span, base);
+  limbs_divmod_1(r2, r2, r, 3, span, base);
+
+  // t = c1
+  limbs_sub(t, t, r, r2, r, span, base);
+
+  limbs_add_at(d, dn, k, t, r, span, base);
+  limbs_add_at(d, dn, 2 * k, r1, r, span, base);
+  limbs_add_at(d, dn, 3 * k, r2, r, span, base);
+}
+
+////////////////////////////////////////////// Number Theoretic Transform
+size_t bi_ntt_threshold = 256;
+
+/**
+ * Three NTT friendly primes just under 2^62. Their product (~2^183) bounds
+ * every convolution coefficient of two word sized digit strings up to the
+ * largest supported transform (2^55, limited by the second prime)
+ */
+static const uint64_t ntt_primes[3] = {
+  4179340454199820289lu, // 29 * 2^57 + 1
+  2485986994308513793lu, // 69 * 2^55 + 1
+  1945555039024054273lu, // 27 * 2^56 + 1
+};
+
+static const uint64_t ntt_roots[3] = { 3, 5, 5 };
+
+#define NTT_MAX_LOG2 55
+
+/**
+ * A prime together with -p^-1 mod 2^64 for Montgomery reduction
+ */
+struct ntt_mod {
+  uint64_t p;
+  uint64_t pinv;
+};
+
+static struct ntt_mod ntt_mod_init(uint64_t p)
+{
+  // Newton iteration doubles the correct low bits every step (3 -> 96)
+  uint64_t inv = p;
+  for(int i = 0; i < 5; ++i)
+    inv *= 2 - p * inv;
+  struct ntt_mod ret = { p, -inv };
+  return ret;
+}
+
+/**
+ * a * b * 2^-64 mod p for a, b < p
+ */
+static inline uint64_t ntt_mont_mul(uint64_t a, uint64_t b, const struct ntt_mod* m)
+{
+  unsigned __int128 t = (unsigned __int128)a * b;
+  uint64_t q = (uint64_t)t * m->pinv;
+  uint64_t u = (uint64_t)((t + (unsigned __int128)q * m->p) >> 64);
+  return u >= m->p ? u - m->p : u;
+}
+
+static uint64_t ntt_mulmod(uint64_t a, uint64_t b, uint64_t p)
+{
+  return (uint64_t)((unsigned __int128)a * b % p);
+}
+
+static uint64_t ntt_powmod(uint64_t b, uint64_t e, uint64_t p)
+{
+  uint64_t ret = 1;
+  for(; e; e >>= 1, b = ntt_mulmod(b, b, p))
+    if(e & 1)
+      ret = ntt_mulmod(ret, b, p);
+  return ret;
+}
+
+/**
+ * Fills tw[j] = w^j in Montgomery form for j < n / 2
+ */
+static void ntt_twiddles(uint64_t* tw, size_t n, uint64_t w, const struct ntt_mod* m)
+{
+  uint64_t r = (uint64_t)(((unsigned __int128)1 << 64) % m->p);
+  uint64_t w_mont = ntt_mulmod(w, r, m->p);
+  tw[0] = r;
+  for(size_t j = 1; j < n / 2; ++j)
+    tw[j] = ntt_mont_mul(tw[j - 1], w_mont, m);
+}
+
+/**
+ * Decimation in frequency: natural order in, bit reversed order out
+ */
+static void ntt_dif(uint64_t* x, size_t n, const uint64_t* tw, const struct ntt_mod* m)
+{
+  const uint64_t p = m->p;
+  for(size_t len = n; len >= 2; len >>= 1) {
+    size_t half = len >> 1;
+    size_t stride = n / len;
+    for(size_t s = 0; s < n; s += len)
+      for(size_t j = 0; j < half; ++j) {
+        uint64_t u = x[s + j];
+        uint64_t v = x[s + j + half];
+        uint64_t sum = u + v;
+        x[s + j] = sum >= p ? sum - p : sum;
+        x[s + j + half] = ntt_mont_mul(u >= v ? u - v : u + p - v, tw[j * stride], m);
+      }
+  }
+}
+
+/**
+ * Decimation in time: bit reversed order in, natural order out
+ */
+static void ntt_dit(uint64_t* x, size_t n, const uint64_t* tw, const struct ntt_mod* m)
+{
+  const uint64_t p = m->p;
+  for(size_t len = 2; len <= n; len <<= 1) {
+    size_t half = len >> 1;
+    size_t stride = n / len;
+    for(size_t s = 0; s < n; s += len)
+      for(size_t j = 0; j < half; ++j) {
+        uint64_t u = x[s + j];
+        uint64_t v = ntt_mont_mul(x[s + j + half], tw[j * stride], m);
+        uint64_t sum = u + v;
+        x[s + j] = sum >= p ? sum - p : sum;
+        x[s + j + half] = u >= v ? u - v : u + p - v;
+      }
+  }
+}
+
+/**
+ * Packs g consecutive base digits starting at limb j * g into one word
+ */
+static uint64_t ntt_pack(const uint8_t* a, size_t an, size_t j, size_t g, size_t span, uint64_t base)
+{
+  uint64_t ret = 0;
+  size_t lo = j * g;
+  size_t hi = lo + g < an ? lo + g : an;
+  for(size_t i = hi; i-- > lo;)
+    ret = ret * base + limb_get(a, i, span);
+  return ret;
+}
+
+/**
+ * x = r0 + p0 (t1 + p1 t2) from the three residues (Garner), as 3 words
+ */
+static void ntt_crt(uint64_t x[3], uint64_t r0, uint64_t r1, uint64_t r2, const uint64_t inv[3])
+{
+  const uint64_t p0 = ntt_primes[0];
+  const uint64_t p1 = ntt_primes[1];
+  const uint64_t p2 = ntt_primes[2];
+
+  uint64_t t1 = ntt_mulmod((r1 + p1 - r0 % p1) % p1, inv[0], p1);
+  uint64_t t2 = (r2 + p2 - r0 % p2) % p2;
+  t2 = ntt_mulmod(t2, inv[1], p2);
+  t2 = ntt_mulmod((t2 + p2 - t1 % p2) % p2, inv[2], p2);
+
+  // y = t1 + p1 t2 < p1 p2 fits in 128 bits, x = r0 + p0 y needs three words
+  unsigned __int128 y = (unsigned __int128)p1 * t2 + t1;
+  unsigned __int128 lo = (unsigned __int128)p0 * (uint64_t)y + r0;
+  unsigned __int128 hi = (unsigned __int128)p0 * (uint64_t)(y >> 64) + (uint64_t)(lo >> 64);
+  x[0] = (uint64_t)lo;
+  x[1] = (uint64_t)hi;
+  x[2] = (uint64_t)(hi >> 64);
+}
+
+/**
+ * Bytes of scratch limbs_mul_ntt needs at most for an an + bn limb product
+ * (whatever the base packs into a word), alignment included
+ */
+static size_t ntt_scratch_bytes(size_t an, size_t bn)
+{
+  size_t n = 1;
+  while(n < an + bn - 1)
+    n <<= 1;
+  return 5 * n * sizeof(uint64_t) + sizeof(uint64_t);
+}
+
+/**
+ * d = a * b through three prime NTTs. Base digits are packed g at a time
+ * into words w < base^g <= MAX_BASE, so convolution coefficients stay below
+ * n * MAX_BASE^2 < p0 p1 p2 (n * 2^128 for BI_BASE_2_64, which packs one). Returns -1 (leaving d untouched) if the
+ * transform is too long or can't be allocated. The buffers come out of
+ * [s] when it has room (it can be NULL), else from malloc
+ */
+static int limbs_mul_ntt(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base,
+  struct scratch* s)
+{
+  size_t g = 1;
+  uint64_t w = base;
+  while(base != BI_BASE_2_64 && w <= MAX_BASE / base) {
+    w *= base;
+    g++;
+  }
+
+  size_t na = (an + g - 1) / g;
+  size_t nb = (bn + g - 1) / g;
+  size_t n = 1;
+  int log2n = 0;
+  while(n < na + nb - 1) {
+    n <<= 1;
+    log2n++;
+  }
+  if(log2n > NTT_MAX_LOG2)
+    return -1;
+
+  // 3 residue vectors + b's transform + twiddles (forward and inverse)
+  uint64_t* buf = scratch_try_words(s, 5 * n);
+  uint64_t* owned = buf ? NULL : malloc(5 * n * sizeof(uint64_t));
+  if(!buf && !(buf = owned))
+    return -1;
+  uint64_t* res[3] = { buf, buf + n, buf + 2 * n };
+  uint64_t* fb = buf + 3 * n;
+  uint64_t* tw = buf + 4 * n;
+  uint64_t* itw = tw + n / 2;
+  int square = a == b && an == bn;
+
+  for(int i = 0; i < 3; ++i) {
+    struct ntt_mod m = ntt_mod_init(ntt_primes[i]);
+    uint64_t root = ntt_powmod(ntt_roots[i], (m.p - 1) >> log2n, m.p);
+    ntt_twiddles(tw, n, root, &m);
+    ntt_twiddles(itw, n, ntt_powmod(root, m.p - 2, m.p), &m);
+
+    uint64_t* fa = res[i];
+    for(size_t j = 0; j < n; ++j)
+      fa[j] = j < na ? ntt_pack(a, an, j, g, span, base) % m.p : 0;
+    ntt_dif(fa, n, tw, &m);
+
+    if(!square) {
+      for(size_t j = 0; j < n; ++j)
+        fb[j] = j < nb ? ntt_pack(b, bn, j, g, span, base) % m.p : 0;
+      ntt_dif(fb, n, tw, &m);
+    }
+
+    const uint64_t* rhs = square ? fa : fb;
+    for(size_t j = 0; j < n; ++j)
+      fa[j] = ntt_mont_mul(fa[j], rhs[j], &m);
+    ntt_dit(fa, n, itw, &m);
+
+    // The pointwise product left a 2^-64 behind, fold it into the 1/n scale
+    uint64_t r = (uint64_t)(((unsigned __int128)1 << 64) % m.p);
+    uint64_t scale = ntt_mulmod(ntt_mulmod(r, r, m.p), ntt_powmod(n, m.p - 2, m.p), m.p);
+    for(size_t j = 0; j < n; ++j)
+      fa[j] = ntt_mont_mul(fa[j], scale, &m);
+  }
+
+  const uint64_t inv[3] = {
+    ntt_powmod(ntt_primes[0] % ntt_primes[1], ntt_primes[1] - 2, ntt_primes[1]),
+    ntt_powmod(ntt_primes[0] % ntt_primes[2], ntt_primes[2] - 2, ntt_primes[2]),
+    ntt_powmod(ntt_primes[1] % ntt_primes[2], ntt_primes[2] - 2, ntt_primes[2]),
+  };
+
+  // Carry in base w, then unpack every w digit into g base digits
+  size_t dn = an + bn;
+  uint64_t carry[3] = { 0, 0, 0 };
+  size_t di = 0;
+  for(size_t j = 0; di < dn; ++j) {
+    uint64_t x[3] = { 0, 0, 0 };
+    if(j < na + nb - 1)
+      ntt_crt(x, res[0][j], res[1][j], res[2][j], inv);
+
+    unsigned __int128 s = (unsigned __int128)x[0] + carry[0];
+    x[0] = (uint64_t)s;
+    s = (unsigned __int128)x[1] + carry[1] + (uint64_t)(s >> 64);
+    x[1] = (uint64_t)s;
+    x[2] += carry[2] + (uint64_t)(s >> 64);
+
+    uint64_t digit;
+    carry[2] = dw_divmod(0, x[2], w, &digit);
+    carry[1] = dw_divmod(digit, x[1], w, &digit);
+    carry[0] = dw_divmod(digit, x[0], w, &digit);
+
+    if(base == BI_BASE_2_64) {
+      limb_set(d, di++, span, digit);
+      continue;
+    }
+    for(size_t t = 0; t < g && di < dn; ++t, ++di) {
+      limb_set(d, di, span, digit % base);
+      digit /= base;
+    }
+  }
+  assert(!carry[0] && !carry[1] && !carry[2]);
+
+  free(owned);
+  return 0;
+}
+
+/**
+ * d = a * b. d has an + bn limbs (possibly with leading zeros) and must not
+ * alias a or b. Both operands must be non empty
+ */
+static void limbs_mul(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base,
+  struct scratch s)
+{
+  if(an < bn) {
+    const uint8_t* tp = a;
+    a = b;
+    b = tp;
+    size_t tn = an;
+    an = bn;
+    bn = tn;
+  }
+
+  if(bn >= bi_ntt_threshold && !limbs_mul_ntt(d, a, an, b, bn, span, base, &s))
+    return;
+
+  if(bn < karatsuba_threshold())
+    limbs_mul_school(d, a, an, b, bn, span, base);
+  else if(2 * bn <= an + 1)
+    limbs_mul_unbalanced(d, a, an, b, bn, span, base, s);
+  else if(bn >= toom3_threshold() && bn > 2 * ((an + 2) / 3))
+    limbs_mul_toom3(d, a, an, b, bn, span, base, s);
+  else
+    limbs_mul_karatsuba(d, a, an, b, bn, span, base, s);
+}
+
+/**
+ * limbs_mul for callers without scratch space. Large products go through
+ * the NTT, everything else gets a scratch buffer sized for the recursion.
+ * Returns -1 if no memory could be found
+ */
+static int limbs_mul_alloc(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base)
+{
+  size_t mn = an < bn ? an : bn;
+  size_t mx = an < bn ? bn : an;
+  if(mn >= bi_ntt_threshold && !limbs_mul_ntt(d, a, an, b, bn, span, base, NULL))
+    return 0;
+
+  struct scratch s = { NULL, NULL };
+  uint8_t* sbuf = NULL;
+  if(mn >= karatsuba_threshold()) {
+    size_t bytes = mul_scratch_limbs(mx) * span;
+    if(!(sbuf = malloc(bytes))) {
+      bi_error("Couldn't allocate scratch space for multiplication\n");
+      return -1;
+    }
+    s.head = sbuf;
+    s.end = sbuf + bytes;
+  }
+
+  limbs_mul(d, a, an, b, bn, span, base, s);
+  free(sbuf);
+  return 0;
+}
+
+int bi_mul_bi(
+    struct big_uint* dest,
+    const struct big_uint* left,
+    const struct big_uint* right)
+{
+  if (dest->base != left->base || dest->base != right->base) {
+    bi_error("Can only multiply two big ints if they have the same base\n");
+    return -1;
+  }
+  STATS_OP(BI_OP_MUL_BI, left->size + right->size, dest->span);
+
+  size_t an = left->size;
+  size_t bn = right->size;
+  size_t span = dest->span;
+  if (!an || !bn) {
+    dest->size = 0;
+    return 0;
+  }
+
+  size_t dn = an + bn;
+  uint8_t* d;
+  if (dest == left || dest == right) {
+    if (!(d = malloc(dn * span))) {
+      bi_error("Couldn't allocate data in bi_mul_bi\n");
+      return -1;
+    }
+  } else {
+    if (ensure_capacity_big_enough(dest, dn))
+      return -1;
+    d = dest->data;
+  }
+
+  if (limbs_mul_alloc(d, left->data, an, right->data, bn, span, dest->base)) {
+    if (d != dest->data)
+      free(d);
+    return -1;
+  }
+
+  if (d != dest->data)
+    return bi_take_limbs(dest, d, dn);
+  dest->size = limbs_strip(d, dn, span);
+  return 0;
+}
+
+/**
+ * Small deterministic generator so failures are reproducible
+ */
+static uint64_t test_rand_state = 0x9E3779B97F4A7C15lu;
+
+static uint64_t test_rand()
+{
+  test_rand_state ^= test_rand_state << 13;
+  test_rand_state ^= test_rand_state >> 7;
+  test_rand_state ^= test_rand_state << 17;
+  return test_rand_state;
+}
+
+/**
+ * Fills bi with n random limbs (the top one non zero)
+ */
+static int test_rand_bi(struct big_uint* bi, size_t n)
+{
+  if (ensure_capacity_big_enough(bi, n))
+    return -1;
+  for (size_t i = 0; i < n; ++i)
+    limb_set(bi->data, i, bi->span, bi->base ? test_rand() % bi->base : test_rand());
+  if (n)
+    limb_set(bi->data, n - 1, bi->span, 1 + test_rand() % (bi->base - 1));
+  bi->size = n;
+  return 0;
+}
+
+/**
+ * Evaluates a (small) big int back into a word
+ */
+static uint64_t test_bi_to_u64(const struct big_uint* bi)
+{
+  uint64_t ret = 0;
+  for (size_t i = bi->size; i-- > 0;)
+    ret = ret * bi->base + limb_get(bi->data, i, bi->span);  // 2^64 wraps to just the low limb
+  return ret;
+}
+
+/**
+ * Checks every vector add level this cpu has against the scalar loop on
+ * operands full of propagate (a + b = base - 1) and generate runs
+ */
+static int test_bi_add_bi_simd_once(uint64_t base, size_t n)
+{
+  size_t span = span_from_base(base);
+  uint8_t* buf = malloc(5 * n * span);
+  uint8_t* a = buf;
+  uint8_t* b = LIMB_PTR(a, n, span);
+  uint8_t* d[3] = { LIMB_PTR(b, n, span), LIMB_PTR(b, 2 * n, span), LIMB_PTR(b, 3 * n, span) };
+  uint64_t c[3] = { 0, 0, 0 };
+
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t x = test_rand() % base;
+    uint64_t r = test_rand() % 4;
+    limb_set(a, i, span, x);
+    limb_set(b, i, span, r == 0 ? test_rand() % base : r == 3 ? base - 1 : base - 1 - x);
+  }
+
+  int saved = simd_add_level_get();
+  int ret = 0;
+  for (int level = 0; level <= saved; ++level) {
+    simd_add_level = level;
+    c[level] = limbs_add(d[level], a, n, b, n, span, base);
+    if (level && (c[level] != c[0] || memcmp(d[level], d[0], n * span)))
+      ret = -1;
+  }
+  simd_add_level = saved;
+
+  if (ret)
+    bi_test_failed("vector add (%zu limbs, base = %" PRIu64 ") doesn't match scalar\n", n, base);
+  else
+    bi_test_passed("vector add (%zu limbs, base = %" PRIu64 ", levels = %d)\n", n, base, saved);
+  free(buf);
+  return ret;
+}
+
+int test_bi_add_bi_simd()
+{
+  int ret = 0;
+  uint64_t bases[] = { 2, 10, 127, 128, 255, 32767, 40000, 1000000000, 5000000000lu, MAX_BASE };
+  size_t sizes[] = { 1, 5, 31, 32, 63, 64, 65, 130, 1000 };
+  for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i)
+    for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j)
+      ret = test_bi_add_bi_simd_once(bases[i], sizes[j]) || ret;
+  return -ret;
+}
+
+static int test_bi_mul_bi_small_once(uint64_t l, uint64_t r, uint64_t base)
+{
+  struct big_uint left, right, dest;
+  bi_init(&left, l, base);
+  bi_init(&right, r, base);
+  bi_init(&dest, 0, base);
+
+  int ret = 0;
+  if (bi_mul_bi(&dest, &left, &right) || test_bi_to_u64(&dest) != l * r) {
+    bi_test_failed("bi_mul_bi(%" PRIu64 " * %" PRIu64 ", base = %" PRIu64 ") "
+                   "Expected: %" PRIu64 " Actual: %" PRIu64 "\n",
+                   l, r, base, l * r, test_bi_to_u64(&dest));
+    ret = -1;
+  } else {
+    bi_test_passed("bi_mul_bi(%" PRIu64 " * %" PRIu64 ", base = %" PRIu64 ")\n", l, r, base);
+  }
+
+  // In place (dest aliases left)
+  if (!ret && (bi_mul_bi(&left, &left, &right) || test_bi_to_u64(&left) != l * r)) {
+    bi_test_failed("bi_mul_bi in place (%" PRIu64 " * %" PRIu64 ", base = %" PRIu64 ")\n", l, r, base);
+    ret = -1;
+  }
+
+  bi_free(&left);
+  bi_free(&right);
+  bi_free(&dest);
+  return ret;
+}
+
+/**
+ * Checks the subquadratic kernels against plain schoolbook
+ */
+static int test_bi_mul_bi_kernels_once(size_t an, size_t bn, uint64_t base)
+{
+  struct big_uint left, right, fast, ntt, slow;
+  bi_init(&left, 0, base);
+  bi_init(&right, 0, base);
+  bi_init(&fast, 0, base);
+  bi_init(&ntt, 0, base);
+  bi_init(&slow, 0, base);
+  test_rand_bi(&left, an);
+  test_rand_bi(&right, bn);
+
+  size_t kt = bi_karatsuba_threshold;
+  size_t tt = bi_toom3_threshold;
+  size_t nt = bi_ntt_threshold;
+
+  bi_karatsuba_threshold = bi_toom3_threshold = bi_ntt_threshold = (size_t)-1;
+  bi_mul_bi(&slow, &left, &right);
+
+  bi_karatsuba_threshold = 8;
+  bi_toom3_threshold = 24;
+  bi_mul_bi(&fast, &left, &right);
+
+  bi_ntt_threshold = 1;
+  bi_mul_bi(&ntt, &left, &right);
+
+  bi_karatsuba_threshold = kt;
+  bi_toom3_threshold = tt;
+  bi_ntt_threshold = nt;
+
+  int ret = 0;
+  if (slow.size != fast.size
+      || limbs_cmp(slow.data, slow.size, fast.data, fast.size, slow.span)) {
+    bi_test_failed("bi_mul_bi(%zu limbs * %zu limbs, base = %" PRIu64 ") "
+                   "doesn't match schoolbook\n", an, bn, base);
+    ret = -1;
+  } else if (slow.size != ntt.size
+      || limbs_cmp(slow.data, slow.size, ntt.data, ntt.size, slow.span)) {
+    bi_test_failed("bi_mul_bi(%zu limbs * %zu limbs, base = %" PRIu64 ") "
+                   "NTT doesn't match schoolbook\n", an, bn, base);
+    ret = -1;
+  } else {
+    bi_test_passed("bi_mul_bi(%zu limbs * %zu limbs, base = %" PRIu64 ")\n", an, bn, base);
+  }
+
+  bi_free(&left);
+  bi_free(&right);
+  bi_free(&fast);
+  bi_free(&ntt);
+  bi_free(&slow);
+  return ret;
+}
+
+int test_bi_mul_bi()
+{
+  int ret = 0;
+  ret = test_bi_mul_bi_small_once(0, 12345, 10) || ret;
+  ret = test_bi_mul_bi_small_once(12345, 6789, 10) || ret;
+  ret = test_bi_mul_bi_small_once(4294967295lu, 4294967295lu, 2) || ret;
+  ret = test_bi_mul_bi_small_once(99999, 99999, 3) || ret;
+  ret = test_bi_mul_bi_small_once(123456789, 987654321, 1000) || ret;
+  ret = test_bi_mul_bi_small_once(123456789, 987654321, 1000000000) || ret;
+  ret = test_bi_mul_bi_small_once(4294967295lu, 4294967295lu, MAX_BASE) || ret;
+
+  uint64_t bases[] = { 2, 3, 10, 127, 255, 40000, 1000000000, 5000000000lu, MAX_BASE };
+  size_t sizes[][2] = { {1, 1}, {7, 3}, {40, 40}, {100, 31}, {97, 90}, {300, 299}, {600, 250}, {1000, 999} };
+  for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i)
+    for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j)
+      ret = test_bi_mul_bi_kernels_once(sizes[j][0], sizes[j][1], bases[i]) || ret;
+
+  return -ret;
+}
+
+////////////////////////////////////////////// Division
+size_t bi_newton_threshold = 512;
+
+static size_t newton_threshold()
+{
+  return bi_newton_threshold < 8 ? 8 : bi_newton_threshold;
+}
+
+/**
+ * d = a * m for a single limb m < base. d has n limbs and may alias a.
+ * Returns the carry out of the top limb (< base)
+ */
+#define LIMBS_MUL_1(type, d, a, n, m, rb) ({                                  \
+  type* _d = (type*)(d);                                                      \
+  const type* _a = (const type*)(a);                                          \
+  uint64_t _c = 0;                                                            \
+  for(size_t _i = 0; _i < (n); ++_i) {                                        \
+    unsigned __int128 _cur = (unsigned __int128)_a[_i] * (m) + _c;            \
+    uint64_t _t;                                                              \
+    _c = recip_divmod((uint64_t)(_cur >> 64), (uint64_t)_cur, (rb), &_t);     \
+    _d[_i] = (type)_t;                                                        \
+  }                                                                           \
+  _c;                                                                         \
+})
+
+static uint64_t limbs_mul_1(
+  uint8_t* d,
+  const uint8_t* a, size_t n,
+  uint64_t m,
+  size_t span, uint64_t base)
+{
+  assert(base == BI_BASE_2_64 || m < base);
+  struct recip rb = recip_init(base);
+  switch(span){
+    case UI8:
+      return LIMBS_MUL_1(uint8_t, d, a, n, m, &rb);
+    case UI16:
+      return LIMBS_MUL_1(uint16_t, d, a, n, m, &rb);
+    case UI32:
+      return LIMBS_MUL_1(uint32_t, d, a, n, m, &rb);
+    case UI64:
+      return LIMBS_MUL_1(uint64_t, d, a, n, m, &rb);
+    default:
+      assert(0);
+  }
+  return 0;
+}
+
+/**
+ * u[0..n] -= q * v[0..n) (u has n + 1 limbs). Returns 1 if the result went
+ * negative, in which case u holds it plus base^(n + 1)
+ */
+#define LIMBS_SUBMUL_1(type, u, v, n, q, base, rb) ({                         \
+  type* _u = (type*)(u);                                                      \
+  const type* _v = (const type*)(v);                                          \
+  uint64_t _c = 0;                                                            \
+  uint64_t _br = 0;                                                           \
+  for(size_t _i = 0; _i < (n); ++_i) {                                        \
+    unsigned __int128 _cur = (unsigned __int128)_v[_i] * (q) + _c;            \
+    uint64_t _t;                                                              \
+    _c = recip_divmod((uint64_t)(_cur >> 64), (uint64_t)_cur, (rb), &_t);     \
+    _t += _br;                                                                \
+    _br = _u[_i] < _t;                                                        \
+    _u[_i] = (type)(_br ? _u[_i] + (base) - _t : _u[_i] - _t);                \
+  }                                                                           \
+  uint64_t _t = _c + _br;                                                     \
+  _br = _u[(n)] < _t;                                                         \
+  _u[(n)] = (type)(_br ? _u[(n)] + (base) - _t : _u[(n)] - _t);               \
+  _br;                                                                        \
+})
+
+static uint64_t limbs_submul_1(
+  uint8_t* u,
+  const uint8_t* v, size_t n,
+  uint64_t q,
+  size_t span, uint64_t base)
+{
+  struct recip rb = recip_init(base);
+  switch(span){
+    case UI8:
+      return LIMBS_SUBMUL_1(uint8_t, u, v, n, q, base, &rb);
+    case UI16:
+      return LIMBS_SUBMUL_1(uint16_t, u, v, n, q, base, &rb);
+    case UI32:
+      return LIMBS_SUBMUL_1(uint32_t, u, v, n, q, base, &rb);
+    case UI64: {
+      // Same as the macro, but base may be 2^64 so the borrow can't be
+      // folded into the product digit
+      uint64_t* _u = (uint64_t*)u;
+      const uint64_t* _v = (const uint64_t*)v;
+      uint64_t c = 0, t;
+      unsigned char br = 0;
+      for(size_t i = 0; i < n; ++i) {
+        unsigned __int128 cur = (unsigned __int128)_v[i] * q + c;
+        c = recip_divmod((uint64_t)(cur >> 64), (uint64_t)cur, &rb, &t);
+        if(base == BI_BASE_2_64) {
+          br = SUBB_U64(br, _u[i], t, &_u[i]);
+        } else {
+          t += br;
+          br = _u[i] < t;
+          _u[i] = br ? _u[i] + base - t : _u[i] - t;
+        }
+      }
+      if(base == BI_BASE_2_64)
+        return SUBB_U64(br, _u[n], c, &_u[n]);
+      t = c + br;
+      br = _u[n] < t;
+      _u[n] = br ? _u[n] + base - t : _u[n] - t;
+      return br;
+    }
+    default:
+      assert(0);
+  }
+  return 0;
+}
+
+/**
+ * Schoolbook long division (Knuth vol. 2, 4.3.1 algorithm D) in an arbitrary
+ * base. q gets an - bn + 1 limbs and r gets bn limbs, either may be NULL.
+ * Requires an >= bn >= 2 and a non zero top limb in b
+ */
+static int limbs_divmod_knuth(
+  uint8_t* q, uint8_t* r,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base)
+{
+  assert(an >= bn && bn >= 2);
+  uint8_t* u = malloc((an + 1 + bn) * span);
+  if(!u) {
+    bi_error("Couldn't allocate data for long division\n");
+    return -1;
+  }
+  uint8_t* v = LIMB_PTR(u, an + 1, span);
+
+  // Base as a double word so BI_BASE_2_64 goes through the same steps
+  const unsigned __int128 bw = base == BI_BASE_2_64 ? (unsigned __int128)1 << 64 : base;
+
+  // Scale so the top limb of v is at least base / 2, which keeps every
+  // quotient estimate within 2 of the real digit
+  uint64_t f = (uint64_t)(bw / ((unsigned __int128)limb_get(b, bn - 1, span) + 1));
+  limb_set(u, an, span, limbs_mul_1(u, a, an, f, span, base));
+  limbs_mul_1(v, b, bn, f, span, base);
+
+  uint64_t vtop = limb_get(v, bn - 1, span);
+  uint64_t vsec = limb_get(v, bn - 2, span);
+
+  for(size_t j = an - bn + 1; j-- > 0;) {
+    unsigned __int128 num = (unsigned __int128)limb_get(u, j + bn, span) * bw
+                            + limb_get(u, j + bn - 1, span);
+    unsigned __int128 qhat = num / vtop;
+    unsigned __int128 rhat = num % vtop;
+    while(qhat >= bw
+          || qhat * vsec > rhat * bw + limb_get(u, j + bn - 2, span)) {
+      qhat--;
+      rhat += vtop;
+      if(rhat >= bw)
+        break;
+    }
+
+    uint8_t* uj = LIMB_PTR(u, j, span);
+    if(limbs_submul_1(uj, v, bn, (uint64_t)qhat, span, base)) {
+      // Overshot by one - add v back (the carry cancels the borrow)
+      qhat--;
+      limbs_add(uj, uj, bn + 1, v, bn, span, base);
+    }
+    if(q)
+      limb_set(q, j, span, (uint64_t)qhat);
+  }
+
+  if(r)
+    limbs_divmod_1(r, u, bn, f, span, base);
+  free(u);
+  return 0;
+}
+
+/**
+ * mu = floor(base^(2n) / m) where m has n limbs with a non zero top limb.
+ * mu has n + 2 limbs (mu <= base^(n + 1)).
+ *
+ * Small n is plain long division. Otherwise the reciprocal y of the top
+ * k = ceil((n + 3) / 2) limbs of m (plus one, so x0 = y base^(n - k) never
+ * overshoots) is found recursively and refined with one Newton step
+ *   x1 = x0 + x0 (base^(2n) - m x0) / base^(2n)
+ * which approaches from below and lands within a few units of mu
+ */
+static int limbs_recip(
+  uint8_t* mu,
+  const uint8_t* m, size_t n,
+  size_t span, uint64_t base)
+{
+  int ret = -1;
+  uint8_t* buf = NULL;
+
+  if(n < newton_threshold()) {
+    if(!(buf = calloc(2 * n + 1, span)))
+      goto done;
+    limb_set(buf, 2 * n, span, 1);
+    if(n == 1) {
+      limbs_divmod_1(mu, buf, 2 * n + 1, limb_get(m, 0, span), span, base);
+    } else if(limbs_divmod_knuth(mu, NULL, buf, 2 * n + 1, m, n, span, base)) {
+      goto done;
+    }
+    ret = 0;
+    goto done;
+  }
+
+  size_t k = (n + 4) / 2;
+  size_t l = n + 2;
+  // mh (k + 1) | y (k + 2) | p = m x (n + l) | e (2n + 1) | t = x e (l + 2n + 1)
+  size_t total = (k + 1) + (k + 2) + (n + l) + (2 * n + 1) + (l + 2 * n + 1);
+  if(!(buf = calloc(total, span)))
+    goto done;
+  uint8_t* mh = buf;
+  uint8_t* y = LIMB_PTR(mh, k + 1, span);
+  uint8_t* p = LIMB_PTR(y, k + 2, span);
+  uint8_t* e = LIMB_PTR(p, n + l, span);
+  uint8_t* t = LIMB_PTR(e, 2 * n + 1, span);
+  uint8_t one[8] = { 1 };
+
+  // x0 = recip(top k limbs + 1) * base^(n - k)
+  limb_set(mh, k, span, limbs_add(mh, LIMB_PTR(m, n - k, span), k, one, 1, span, base));
+  memset(mu, 0, l * span);
+  if(limb_get(mh, k, span)) {
+    limb_set(mu, n, span, 1);
+  } else {
+    if(limbs_recip(y, mh, k, span, base))
+      goto done;
+    memcpy(LIMB_PTR(mu, n - k, span), y, (k + 2) * span);
+  }
+
+  // e = base^(2n) - m x0 >= 0
+  if(limbs_mul_alloc(p, m, n, mu, l, span, base))
+    goto done;
+  memset(e, 0, (2 * n + 1) * span);
+  limb_set(e, 2 * n, span, 1);
+  limbs_sub(e, e, 2 * n + 1, p, limbs_strip(p, n + l, span), span, base);
+
+  // x1 = x0 + (x0 e) / base^(2n)
+  size_t en = limbs_strip(e, 2 * n + 1, span);
+  if(l + en > 2 * n) {
+    if(limbs_mul_alloc(t, mu, l, e, en, span, base))
+      goto done;
+    limbs_add(mu, mu, l, LIMB_PTR(t, 2 * n, span),
+        limbs_strip(LIMB_PTR(t, 2 * n, span), l + en - 2 * n, span), span, base);
+  }
+
+  // Fix up the last few units: base^(2n) - m x1 must end up below m
+  if(limbs_mul_alloc(p, m, n, mu, l, span, base))
+    goto done;
+  memset(e, 0, (2 * n + 1) * span);
+  limb_set(e, 2 * n, span, 1);
+  limbs_sub(e, e, 2 * n + 1, p, limbs_strip(p, n + l, span), span, base);
+  while(limbs_cmp(e, 2 * n + 1, m, n, span) >= 0) {
+    limbs_sub(e, e, 2 * n + 1, m, n, span, base);
+    limbs_add(mu, mu, l, one, 1, span, base);
+  }
+  ret = 0;
+
+done:
+  if(ret)
+    bi_error("Couldn't allocate data for reciprocal\n");
+  free(buf);
+  return ret;
+}
+
+int bi_barrett_init(
+    struct bi_barrett* ctx,
+    const struct big_uint* m)
+{
+  memset(ctx, 0, sizeof(struct bi_barrett));
+  if (!m->size) {
+    bi_error("Barrett modulus can't be zero\n");
+    return -1;
+  }
+
+  size_t n = m->size;
+  size_t span = m->span;
+  // m | mu | x (2n) | q (n + 3 + n + 2) | qm (2n + 2). The products are
+  // at most (n + 2) x (n + 1), with room for the NTT if they'll take it
+  size_t limbs = n + (n + 2) + 2 * n + (2 * n + 5) + (2 * n + 2);
+  ctx->scratch_bytes = mul_scratch_limbs(n + 2) * span;
+  if (n + 2 >= bi_ntt_threshold)
+    ctx->scratch_bytes += ntt_scratch_bytes(n + 2, n + 1);
+  if (!(ctx->m = malloc(limbs * span + ctx->scratch_bytes))) {
+    bi_error("Couldn't allocate Barrett context\n");
+    return -1;
+  }
+  ctx->mu = LIMB_PTR(ctx->m, n, span);
+  ctx->work = LIMB_PTR(ctx->mu, n + 2, span);
+  ctx->scratch = ctx->m + limbs * span;
+  ctx->n = n;
+  ctx->base = m->base;
+  ctx->span = span;
+
+  memcpy(ctx->m, m->data, n * span);
+  if (limbs_recip(ctx->mu, ctx->m, n, span, ctx->base)) {
+    bi_barrett_free(ctx);
+    return -1;
+  }
+  return 0;
+}
+
+void bi_barrett_free(struct bi_barrett* ctx)
+{
+  free(ctx->m);
+  memset(ctx, 0, sizeof(struct bi_barrett));
+}
+
+/**
+ * One Barrett step on the 2n limbs in ctx->work (x < m base^n).
+ * Leaves x mod m in the low n limbs of work and writes the n limb quotient
+ * to q (if not NULL)
+ */
+static void barrett_reduce(struct bi_barrett* ctx, uint8_t* q)
+{
+  size_t n = ctx->n;
+  size_t span = ctx->span;
+  uint64_t base = ctx->base;
+  uint8_t* x = ctx->work;
+  uint8_t* q2 = LIMB_PTR(x, 2 * n, span);
+  uint8_t* qm = LIMB_PTR(q2, 2 * n + 5, span);
+  struct scratch s = { ctx->scratch, ctx->scratch + ctx->scratch_bytes };
+  uint8_t one[8] = { 1 };
+
+  // q3 = ((x / base^(n - 1)) * mu) / base^(n + 1) is at most 2 below x / m
+  size_t q1n = limbs_strip(LIMB_PTR(x, n - 1, span), n + 1, span);
+  size_t q3n = 0;
+  uint8_t* q3 = LIMB_PTR(q2, n + 1, span);
+  if (q1n) {
+    limbs_mul(q2, LIMB_PTR(x, n - 1, span), q1n, ctx->mu, n + 2, span, base, s);
+    memset(LIMB_PTR(q2, q1n + n + 2, span), 0, (n + 3 - q1n) * span);
+    q3n = limbs_strip(q3, n + 2, span);
+  } else {
+    memset(q3, 0, (n + 2) * span);
+  }
+
+  if (q3n) {
+    limbs_mul(qm, q3, q3n, ctx->m, n, span, base, s);
+    limbs_sub(x, x, 2 * n, qm, limbs_strip(qm, q3n + n, span), span, base);
+  }
+  while (limbs_cmp(x, 2 * n, ctx->m, n, span) >= 0) {
+    limbs_sub(x, x, 2 * n, ctx->m, n, span, base);
+    limbs_add(q3, q3, n + 2, one, 1, span, base);
+  }
+
+  if (q)
+    memcpy(q, q3, n * span);
+}
+
+/**
+ * q (ceil(an / n) * n limbs, may be NULL) = a / m, r (n limbs) = a % m.
+ * Feeds a through barrett_reduce n limbs at a time from the top, with the
+ * running remainder as the high half. The remainder also stays in the top
+ * half of ctx->work, so r may be NULL too. Every block of a is read before
+ * the same block of q is written, so q may be a
+ */
+static void barrett_divmod_limbs(
+  struct bi_barrett* ctx,
+  uint8_t* q, uint8_t* r,
+  const uint8_t* a, size_t an)
+{
+  size_t n = ctx->n;
+  size_t span = ctx->span;
+  uint8_t* x = ctx->work;
+  size_t blocks = (an + n - 1) / n;
+
+  memset(LIMB_PTR(x, n, span), 0, n * span);
+  for (size_t blk = blocks; blk-- > 0;) {
+    size_t lo = blk * n;
+    size_t len = an - lo < n ? an - lo : n;
+    limbs_copy_pad(x, n, LIMB_PTR(a, lo, span), len, span);
+    barrett_reduce(ctx, q ? LIMB_PTR(q, lo, span) : NULL);
+    // remainder becomes the high half of the next block
+    memmove(LIMB_PTR(x, n, span), x, n * span);
+  }
+  if (r)
+    memcpy(r, LIMB_PTR(x, n, span), n * span);
+}
+
+/**
+ * Copies n limbs into dest (which may not alias data)
+ */
+static int bi_set_limbs(struct big_uint* dest, const uint8_t* data, size_t n)
+{
+  n = limbs_strip(data, n, dest->span);
+  if (ensure_capacity_big_enough(dest, n))
+    return -1;
+  memcpy(dest->data, data, n * dest->span);
+  dest->size = n;
+  return 0;
+}
+
+static int bi_take_limbs(struct big_uint* dest, uint8_t* data, size_t cap)
+{
+  // Arena values stay in the arena while they can, otherwise (or if that
+  // fails) they adopt the buffer and move to the heap. Values on another
+  // allocator can't adopt a malloced buffer at all
+  int copy = BI_ALLOC(dest) != &bi_allocator_malloc;
+  if (copy || (dest->arena && arena_above_floor(dest->arena, dest->data))) {
+    int ret = bi_set_limbs(dest, data, cap);
+    if (!ret || copy) {
+      free(data);
+      return ret;
+    }
+  }
+  bi_free(dest);
+  dest->arena = NULL;
+  dest->data = data;
+  dest->capacity = cap * dest->span;
+  dest->size = limbs_strip(data, cap, dest->span);
+  return 0;
+}
+
+int bi_barrett_divmod(
+    struct big_uint* q,
+    struct big_uint* r,
+    const struct big_uint* a,
+    struct bi_barrett* ctx)
+{
+  if (a->base != ctx->base
+      || (q && q->base != ctx->base)
+      || (r && r->base != ctx->base)) {
+    bi_error("Barrett reduction needs matching bases\n");
+    return -1;
+  }
+
+  // q is written in place (even when it's a) and r is copied out of the
+  // context's work space, so nothing needs allocating once they're big enough
+  size_t n = ctx->n;
+  size_t span = ctx->span;
+  size_t an = a->size;
+  size_t qn = (an + n - 1) / n * n;
+  if (q && ensure_capacity_big_enough(q, qn))
+    return -1;
+  barrett_divmod_limbs(ctx, q && qn ? q->data : NULL, NULL, a->data, an);
+  if (q)
+    q->size = limbs_strip(q->data, qn, span);
+  return r ? bi_set_limbs(r, LIMB_PTR(ctx->work, n, span), n) : 0;
+}
+
+int bi_divmod_bi(
+    struct big_uint* q,
+    struct big_uint* r,
+    const struct big_uint* a,
+    const struct big_uint* b)
+{
+  if (a->base != b->base
+      || (q && q->base != a->base)
+      || (r && r->base != a->base)) {
+    bi_error("Can only divide two big ints if they have the same base\n");
+    return -1;
+  }
+  if (!b->size) {
+    bi_error("Division by zero\n");
+    return -1;
+  }
+  STATS_OP(BI_OP_DIVMOD_BI, a->size, a->span);
+
+  size_t an = a->size;
+  size_t bn = b->size;
+  size_t span = a->span;
+  uint64_t base = a->base;
+
+  // a < b: q = 0, r = a
+  if (limbs_cmp(a->data, an, b->data, bn, span) < 0) {
+    if (r && r != a && bi_set_limbs(r, a->data, an))
+      return -1;
+    if (q)
+      q->size = 0;
+    return 0;
+  }
+
+  // Work in fresh buffers so q and r can alias a and b
+  size_t qn = an - bn + 1;
+  if (bn >= newton_threshold())
+    qn = (an + bn - 1) / bn * bn;
+  uint8_t* qbuf = malloc(qn * span);
+  uint8_t* rbuf = malloc(bn * span);
+  if (!qbuf || !rbuf) {
+    bi_error("Couldn't allocate data in bi_divmod_bi\n");
+    free(qbuf);
+    free(rbuf);
+    return -1;
+  }
+
+  int ret = 0;
+  if (bn == 1) {
+    limb_set(rbuf, 0, span, limbs_divmod_1(qbuf, a->data, an, limb_get(b->data, 0, span), span, base));
+  } else if (bn < newton_threshold()) {
+    ret = limbs_divmod_knuth(qbuf, rbuf, a->data, an, b->data, bn, span, base);
+  } else {
+    struct bi_barrett ctx;
+    if (!(ret = bi_barrett_init(&ctx, b))) {
+      barrett_divmod_limbs(&ctx, qbuf, rbuf, a->data, an);
+      bi_barrett_free(&ctx);
+    }
+  }
+
+  if (ret) {
+    free(qbuf);
+    free(rbuf);
+    return ret;
+  }
+
+  if (q)
+    ret = bi_take_limbs(q, qbuf, qn);
+  else
+    free(qbuf);
+  if (r)
+    ret = bi_take_limbs(r, rbuf, bn) || ret;
+  else
+    free(rbuf);
+  return -ret;
+}
+
+/**
+ * Checks a = q * b + r and r < b
+ */
+static int test_check_divmod(
+  const struct big_uint* a, const struct big_uint* b,
+  const struct big_uint* q, const struct big_uint* r)
+{
+  struct big_uint check;
+  bi_init_base(&check, 0, a->base);
+  bi_mul_bi(&check, q, b);
+  bi_add_bi(&check, r);
+  int ret = limbs_cmp(check.data, check.size, a->data, a->size, a->span)
+            || limbs_cmp(r->data, r->size, b->data, b->size, b->span) >= 0;
+  bi_free(&check);
+  return -ret;
+}
+
+static int test_bi_divmod_bi_once(size_t an, size_t bn, uint64_t base, size_t newton)
+{
+  struct big_uint a, b, q, r;
+  bi_init(&a, 0, base);
+  bi_init(&b, 0, base);
+  bi_init(&q, 0, base);
+  bi_init(&r, 0, base);
+  test_rand_bi(&a, an);
+  test_rand_bi(&b, bn);
+
+  size_t nt = bi_newton_threshold;
+  bi_newton_threshold = newton;
+  int ret = bi_divmod_bi(&q, &r, &a, &b) || test_check_divmod(&a, &b, &q, &r);
+  bi_newton_threshold = nt;
+
+  if (ret)
+    bi_test_failed("bi_divmod_bi(%zu limbs / %zu limbs, base = %" PRIu64 ", newton = %zu)\n",
+                   an, bn, base, newton);
+  else
+    bi_test_passed("bi_divmod_bi(%zu limbs / %zu limbs, base = %" PRIu64 ", newton = %zu)\n",
+                   an, bn, base, newton);
+
+  bi_free(&a);
+  bi_free(&b);
+  bi_free(&q);
+  bi_free(&r);
+  return -ret;
+}
+
+int test_bi_divmod_bi()
+{
+  int ret = 0;
+
+  struct big_uint a, b, q, r;
+  bi_init(&a, 83810205, 10);
+  bi_init(&b, 0, 10);
+  bi_init(&q, 0, 10);
+  bi_init(&r, 0, 10);
+  if (!bi_divmod_bi(&q, &r, &a, &b)) {
+    bi_test_failed("bi_divmod_bi by zero\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_divmod_bi by zero\n");
+  }
+  bi_add_sc(&b, 6789);
+  bi_add_sc(&a, 17);
+  if (bi_divmod_bi(&q, &r, &a, &b) || test_bi_to_u64(&q) != 12345 || test_bi_to_u64(&r) != 17) {
+    bi_test_failed("bi_divmod_bi(83810222 / 6789)\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_divmod_bi(83810222 / 6789)\n");
+  }
+  // In place, quotient only
+  if (bi_divmod_bi(&a, NULL, &a, &b) || test_bi_to_u64(&a) != 12345) {
+    bi_test_failed("bi_divmod_bi in place\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_divmod_bi in place\n");
+  }
+  bi_free(&a);
+  bi_free(&b);
+  bi_free(&q);
+  bi_free(&r);
+
+  uint64_t bases[] = { 2, 3, 10, 255, 40000, 1000000000, MAX_BASE };
+  size_t sizes[][2] = { {1, 1}, {5, 1}, {3, 7}, {20, 2}, {40, 17}, {300, 150}, {500, 60}, {1000, 400} };
+  for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i)
+    for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j) {
+      ret = test_bi_divmod_bi_once(sizes[j][0], sizes[j][1], bases[i], (size_t)-1) || ret;
+      ret = test_bi_divmod_bi_once(sizes[j][0], sizes[j][1], bases[i], 8) || ret;
+    }
+
+  return -ret;
+}
+
+int test_bi_barrett()
+{
+  int ret = 0;
+  uint64_t bases[] = { 3, 10, 65521, MAX_BASE };
+  size_t sizes[] = { 1, 9, 64, 200 };
+  for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i)
+    for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j) {
+      struct big_uint m, a, q, r;
+      struct bi_barrett ctx;
+      bi_init(&m, 0, bases[i]);
+      bi_init(&a, 0, bases[i]);
+      bi_init(&q, 0, bases[i]);
+      bi_init(&r, 0, bases[i]);
+      test_rand_bi(&m, sizes[j]);
+
+      int fail = bi_barrett_init(&ctx, &m);
+      for (size_t k = 0; !fail && k < 3 * sizes[j]; k += sizes[j] / 2 + 1) {
+        test_rand_bi(&a, k);
+        fail = bi_barrett_divmod(&q, &r, &a, &ctx) || test_check_divmod(&a, &m, &q, &r);
+      }
+      bi_barrett_free(&ctx);
+
+      if (fail) {
+        bi_test_failed("bi_barrett_divmod(%zu limb modulus, base = %" PRIu64 ")\n", sizes[j], bases[i]);
+        ret = -1;
+      } else {
+        bi_test_passed("bi_barrett_divmod(%zu limb modulus, base = %" PRIu64 ")\n", sizes[j], bases[i]);
+      }
+      bi_free(&m);
+      bi_free(&a);
+      bi_free(&q);
+      bi_free(&r);
+    }
+
+  // Quotient in place, with products going through the NTT in the
+  // context's scratch
+  size_t nt = bi_ntt_threshold;
+  bi_ntt_threshold = 16;
+  for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i) {
+    struct big_uint m, a, q, r;
+    struct bi_barrett ctx;
+    bi_init(&m, 0, bases[i]);
+    bi_init(&a, 0, bases[i]);
+    bi_init(&q, 0, bases[i]);
+    bi_init(&r, 0, bases[i]);
+    test_rand_bi(&m, 40);
+    test_rand_bi(&a, 150);
+    bi_set_limbs(&q, a.data, a.size);
+
+    int fail = bi_barrett_init(&ctx, &m)
+      || bi_barrett_divmod(&q, &r, &q, &ctx)
+      || test_check_divmod(&a, &m, &q, &r);
+    bi_barrett_free(&ctx);
+
+    if (fail) {
+      bi_test_failed("bi_barrett_divmod in place through the NTT (base = %" PRIu64 ")\n", bases[i]);
+      ret = -1;
+    } else {
+      bi_test_passed("bi_barrett_divmod in place through the NTT (base = %" PRIu64 ")\n", bases[i]);
+    }
+    bi_free(&m);
+    bi_free(&a);
+    bi_free(&q);
+    bi_free(&r);
+  }
+  bi_ntt_threshold = nt;
+  return ret;
+}
+
+////////////////////////////////////////////// Montgomery
+/**
+ * x / base and x % base for a column sum of any width, as two reciprocal
+ * divisions of its words (the high one folds away for 64 bit columns)
+ */
+static inline unsigned __int128 mont_col_divmod(unsigned __int128 x, const struct recip* rb, uint64_t* rem)
+{
+  uint64_t hi = (uint64_t)(x >> 64);
+  uint64_t qhi = hi ? recip_divmod(0, hi, rb, &hi) : 0;
+  return (unsigned __int128)qhi << 64 | recip_divmod(hi, (uint64_t)x, rb, rem);
+}
+
+/**
+ * r = a * b * base^-n mod m by product scanning (FIPS): every output column
+ * gathers both a_i b_j and u_i m_j in [wide] and is reduced by base once,
+ * through the reciprocal rb. r (n + 1 limbs, < 2m) must not alias a or b.
+ * u holds n limbs of scratch
+ */
+#define MONT_MUL_COLS(type, wide, r, a, b, m, u, n, minv, rb) ({              \
+  type* _r = (type*)(r);                                                      \
+  type* _u = (type*)(u);                                                      \
+  const type* _a = (const type*)(a);                                          \
+  const type* _b = (const type*)(b);                                          \
+  const type* _m = (const type*)(m);                                          \
+  wide _acc = 0;                                                              \
+  uint64_t _rem, _low;                                                        \
+  for(size_t _k = 0; _k < (n); ++_k) {                                        \
+    for(size_t _i = 0; _i <= _k; ++_i)                                        \
+      _acc += (wide)_a[_i] * _b[_k - _i];                                     \
+    for(size_t _i = 0; _i < _k; ++_i)                                         \
+      _acc += (wide)_u[_i] * _m[_k - _i];                                     \
+    _acc = (wide)mont_col_divmod(_acc, (rb), &_rem);                          \
+    recip_divmod(0, _rem * (minv), (rb), &_low);                              \
+    _u[_k] = (type)_low;                                                      \
+    /* _rem + u m_0 is a multiple of base below 2^64 */                       \
+    _acc += recip_divmod(0, _rem + _low * _m[0], (rb), &_low);                \
+  }                                                                           \
+  for(size_t _k = (n); _k < 2 * (n) - 1; ++_k) {                              \
+    for(size_t _i = _k - (n) + 1; _i < (n); ++_i)                             \
+      _acc += (wide)_a[_i] * _b[_k - _i] + (wide)_u[_i] * _m[_k - _i];        \
+    _acc = (wide)mont_col_divmod(_acc, (rb), &_rem);                          \
+    _r[_k - (n)] = (type)_rem;                                                \
+  }                                                                           \
+  _acc = (wide)mont_col_divmod(_acc, (rb), &_rem);                            \
+  _r[(n) - 1] = (type)_rem;                                                   \
+  _r[(n)] = (type)_acc;                                                       \
+})
+
+/**
+ * Same as MONT_MUL_COLS for full 64 bit words (BI_BASE_2_64), using
+ * coarsely integrated operand scanning (one row at a time), where every
+ * division by base is just a split of the words. t holds n + 2 limbs of
+ * scratch and becomes the result
+ */
+static void mont_mul_cios64(
+  uint64_t* t,
+  const uint64_t* a, const uint64_t* b, const uint64_t* m,
+  size_t n, uint64_t minv, uint64_t base)
+{
+  memset(t, 0, (n + 2) * sizeof(uint64_t));
+  for(size_t i = 0; i < n; ++i) {
+    uint64_t c = 0;
+    for(size_t j = 0; j < n; ++j) {
+      unsigned __int128 cur = (unsigned __int128)a[i] * b[j] + t[j] + c;
+      c = dw_divmod((uint64_t)(cur >> 64), (uint64_t)cur, base, &t[j]);
+    }
+    unsigned __int128 cur = (unsigned __int128)t[n] + c;
+    t[n + 1] = dw_divmod((uint64_t)(cur >> 64), (uint64_t)cur, base, &t[n]);
+
+    uint64_t u, dummy;
+    cur = (unsigned __int128)t[0] * minv;
+    dw_divmod((uint64_t)(cur >> 64), (uint64_t)cur, base, &u);
+
+    // t = (t + u m) / base, the low limb is zero by construction
+    cur = (unsigned __int128)u * m[0] + t[0];
+    c = dw_divmod((uint64_t)(cur >> 64), (uint64_t)cur, base, &dummy);
+    for(size_t j = 1; j < n; ++j) {
+      cur = (unsigned __int128)u * m[j] + t[j] + c;
+      c = dw_divmod((uint64_t)(cur >> 64), (uint64_t)cur, base, &t[j - 1]);
+    }
+    cur = (unsigned __int128)t[n] + c;
+    c = dw_divmod((uint64_t)(cur >> 64), (uint64_t)cur, base, &t[n - 1]);
+    t[n] = t[n + 1] + c;
+    t[n + 1] = 0;
+  }
+}
+
+/**
+ * Same as MONT_MUL_COLS for the other 64 bit limbs. A column of 2n
+ * products below base^2 takes a third word ([top], below 2n < base), so
+ * reducing it takes two reciprocal divisions: one per column rather than
+ * one per product, as a row by row scan would need
+ */
+static void mont_mul_cols64(
+  uint64_t* r,
+  const uint64_t* a, const uint64_t* b, const uint64_t* m, uint64_t* u,
+  size_t n, uint64_t minv, const struct recip* rb)
+{
+  unsigned __int128 acc = 0;
+  uint64_t top = 0;
+  uint64_t rem, low;
+#define MONT_COL_ADD(x, y) do {                                               \
+    unsigned __int128 _p = (unsigned __int128)(x) * (y);                      \
+    acc += _p;                                                                \
+    top += acc < _p;                                                          \
+  } while(0)
+#define MONT_COL_DIVMOD() do {                                                \
+    uint64_t _qh = recip_divmod(top, (uint64_t)(acc >> 64), rb, &rem);        \
+    acc = (unsigned __int128)_qh << 64 | recip_divmod(rem, (uint64_t)acc, rb, &rem); \
+    top = 0;                                                                  \
+  } while(0)
+
+  for(size_t k = 0; k < n; ++k) {
+    for(size_t i = 0; i <= k; ++i)
+      MONT_COL_ADD(a[i], b[k - i]);
+    for(size_t i = 0; i < k; ++i)
+      MONT_COL_ADD(u[i], m[k - i]);
+    MONT_COL_DIVMOD();
+    unsigned __int128 x = (unsigned __int128)rem * minv;
+    recip_divmod((uint64_t)(x >> 64), (uint64_t)x, rb, &u[k]);
+    // rem + u m_0 is a multiple of base below base^2
+    x = (unsigned __int128)u[k] * m[0] + rem;
+    acc += recip_divmod((uint64_t)(x >> 64), (uint64_t)x, rb, &low);
+  }
+  for(size_t k = n; k < 2 * n - 1; ++k) {
+    for(size_t i = k - n + 1; i < n; ++i) {
+      MONT_COL_ADD(a[i], b[k - i]);
+      MONT_COL_ADD(u[i], m[k - i]);
+    }
+    MONT_COL_DIVMOD();
+    r[k - n] = rem;
+  }
+  MONT_COL_DIVMOD();
+  r[n - 1] = rem;
+  r[n] = (uint64_t)acc;
+#undef MONT_COL_ADD
+#undef MONT_COL_DIVMOD
+}
+
+/**
+ * r = a * b * base^-n mod m with a, b < m, all n limbs. r may alias a or b
+ */
+static void mont_mul(uint8_t* r, const uint8_t* a, const uint8_t* b, const struct bi_mont_ctx* ctx)
+{
+  size_t n = ctx->n;
+  size_t span = ctx->span;
+  uint64_t base = ctx->base;
+  uint8_t* t = ctx->work;
+  uint8_t* u = LIMB_PTR(t, n + 2, span);
+  struct recip rb = { 0, 0, 0 };
+  if(base) {
+    rb.shift = __builtin_clzl(base);
+    rb.d = base << rb.shift;
+    rb.v = ctx->base_inv;
+  }
+
+  switch(span){
+    case UI8:
+      MONT_MUL_COLS(uint8_t, uint64_t, t, a, b, ctx->m, u, n, ctx->minv, &rb);
+      break;
+    case UI16:
+      MONT_MUL_COLS(uint16_t, uint64_t, t, a, b, ctx->m, u, n, ctx->minv, &rb);
+      break;
+    case UI32:
+      MONT_MUL_COLS(uint32_t, unsigned __int128, t, a, b, ctx->m, u, n, ctx->minv, &rb);
+      break;
+    case UI64:
+      if(base)
+        mont_mul_cols64((uint64_t*)t, (const uint64_t*)a, (const uint64_t*)b,
+            (const uint64_t*)ctx->m, (uint64_t*)u, n, ctx->minv, &rb);
+      else
+        mont_mul_cios64((uint64_t*)t, (const uint64_t*)a, (const uint64_t*)b,
+            (const uint64_t*)ctx->m, n, ctx->minv, base);
+      break;
+    default:
+      assert(0);
+  }
+
+  if(limbs_cmp(t, n + 1, ctx->m, n, span) >= 0)
+    limbs_sub(t, t, n + 1, ctx->m, n, span, base);
+  memcpy(r, t, n * span);
+}
+
+/**
+ * -x^-1 mod base, or 0 if x and base aren't coprime
+ */
+static uint64_t mont_neg_inverse(uint64_t x, uint64_t base)
+{
+  if(base == BI_BASE_2_64) {
+    if(!(x & 1))
+      return 0;
+    // Newton doubles the correct low bits every step (3 -> 96)
+    uint64_t inv = x;
+    for(int i = 0; i < 5; ++i)
+      inv *= 2 - x * inv;
+    return -inv;
+  }
+
+  // Extended Euclid, tracking only the coefficient of x
+  uint64_t r0 = base, r1 = x % base;
+  int64_t s0 = 0, s1 = 1;
+  while(r1) {
+    uint64_t q = r0 / r1;
+    uint64_t r2 = r0 - q * r1;
+    // |s| <= base / 2 so these never overflow
+    int64_t s2 = s0 - (int64_t)q * s1;
+    r0 = r1;
+    r1 = r2;
+    s0 = s1;
+    s1 = s2;
+  }
+  if(r0 != 1)
+    return 0;
+  // s0 = x^-1 mod base (up to sign), so -s0 is what we want
+  uint64_t inv = s0 < 0 ? (uint64_t)(-s0) : base - (uint64_t)s0;
+  return inv == base ? 0 : inv;
+}
+
+int bi_mont_init(
+    struct bi_mont_ctx* ctx,
+    const struct big_uint* m)
+{
+  memset(ctx, 0, sizeof(struct bi_mont_ctx));
+  if (!m->size || (m->size == 1 && limb_get(m->data, 0, m->span) == 1)) {
+    bi_error("Montgomery modulus must be greater than 1\n");
+    return -1;
+  }
+
+  size_t n = m->size;
+  size_t span = m->span;
+  uint64_t minv = mont_neg_inverse(limb_get(m->data, 0, span), m->base);
+  if (!minv) {
+    bi_error("Montgomery modulus must be coprime to the base\n");
+    return -1;
+  }
+
+  // m | r2 | work (n + 2 + n)
+  if (!(ctx->m = malloc((4 * n + 2) * span))) {
+    bi_error("Couldn't allocate Montgomery context\n");
+    return -1;
+  }
+  ctx->r2 = LIMB_PTR(ctx->m, n, span);
+  ctx->work = LIMB_PTR(ctx->r2, n, span);
+  ctx->n = n;
+  ctx->base = m->base;
+  ctx->base_inv = recip_init(m->base).v;
+  ctx->span = span;
+  ctx->minv = minv;
+  memcpy(ctx->m, m->data, n * span);
+
+  // r2 = base^(2n) mod m
+  struct big_uint pow, rem;
+  int ret = bi_init_base(&pow, 0, m->base) || bi_init_base(&rem, 0, m->base);
+  if (!ret && !(ret = ensure_capacity_big_enough(&pow, 2 * n + 1))) {
+    memset(pow.data, 0, 2 * n * span);
+    limb_set(pow.data, 2 * n, span, 1);
+    pow.size = 2 * n + 1;
+    ret = bi_divmod_bi(NULL, &rem, &pow, m);
+  }
+  if (!ret)
+    limbs_copy_pad(ctx->r2, n, rem.data, rem.size, span);
+  bi_free(&pow);
+  bi_free(&rem);
+
+  if (ret)
+    bi_mont_free(ctx);
+  return ret;
+}
+
+void bi_mont_free(struct bi_mont_ctx* ctx)
+{
+  free(ctx->m);
+  memset(ctx, 0, sizeof(struct bi_mont_ctx));
+}
+
+/**
+ * Binary digits of bi as 32 bit words (least significant first), found by
+ * repeatedly dividing by 2^32. Returns a malloced array of *nwords words
+ */
+static uint32_t* bi_to_words32(const struct big_uint* bi, size_t* nwords)
+{
+  size_t n = bi->size;
+  size_t span = bi->span;
+  // Every word takes at least one bit off, so this is more than enough
+  size_t cap = n * 64 / 32 + 1;
+  uint32_t* words = malloc(cap * sizeof(uint32_t));
+  uint8_t* tmp = malloc(n * span + 1);
+  if (!words || !tmp) {
+    free(words);
+    free(tmp);
+    return NULL;
+  }
+  memcpy(tmp, bi->data, n * span);
+
+  size_t count = 0;
+  while ((n = limbs_strip(tmp, n, span))) {
+    assert(count < cap);
+    words[count++] = (uint32_t)limbs_divmod_1(tmp, tmp, n, 1lu << 32, span, bi->base);
+  }
+  free(tmp);
+  *nwords = count;
+  return words;
+}
+
+#define BIT_AT(words, i) (((words)[(i) / 32] >> ((i) % 32)) & 1)
+
+int bi_powmod(
+    struct big_uint* dest,
+    const struct big_uint* b,
+    const struct big_uint* exp,
+    struct bi_mont_ctx* ctx)
+{
+  if (dest->base != ctx->base || b->base != ctx->base) {
+    bi_error("bi_powmod needs the same base for dest, base and modulus\n");
+    return -1;
+  }
+  STATS_OP(BI_OP_POWMOD, ctx->n, ctx->span);
+
+  size_t n = ctx->n;
+  size_t span = ctx->span;
+  size_t nwords = 0;
+  uint32_t* words = bi_to_words32(exp, &nwords);
+  if (!words) {
+    bi_error("Couldn't allocate data in bi_powmod\n");
+    return -1;
+  }
+  size_t nbits = nwords ? 32 * nwords - __builtin_clz(words[nwords - 1]) : 0;
+
+  // Odd powers b^1, b^3, ..., b^(2^w - 1) in Montgomery form
+  int w = nbits < 8 ? 1 : nbits < 24 ? 2 : nbits < 80 ? 3 : nbits < 240 ? 4 : nbits < 672 ? 5 : 6;
+  size_t entries = (size_t)1 << (w - 1);
+  // table | b^2 | acc | (b mod m)
+  uint8_t* buf = malloc((entries + 3) * n * span);
+  struct big_uint red;
+  int ret = bi_init_base(&red, 0, ctx->base);
+  if (!buf || ret) {
+    bi_error("Couldn't allocate data in bi_powmod\n");
+    ret = -1;
+    goto done;
+  }
+  uint8_t* sq = LIMB_PTR(buf, entries * n, span);
+  uint8_t* acc = LIMB_PTR(sq, n, span);
+  uint8_t* one = LIMB_PTR(acc, n, span);
+
+  struct big_uint mod = { .data = ctx->m, .size = n, .capacity = n * span,
+                          .base = ctx->base, .span = span };
+  if ((ret = bi_divmod_bi(NULL, &red, b, &mod)))
+    goto done;
+  limbs_copy_pad(buf, n, red.data, red.size, span);
+  mont_mul(buf, buf, ctx->r2, ctx);
+  mont_mul(sq, buf, buf, ctx);
+  for (size_t i = 1; i < entries; ++i)
+    mont_mul(LIMB_PTR(buf, i * n, span), LIMB_PTR(buf, (i - 1) * n, span), sq, ctx);
+
+  // acc = 1 in Montgomery form (base^n mod m)
+  memset(one, 0, n * span);
+  limb_set(one, 0, span, 1);
+  mont_mul(acc, one, ctx->r2, ctx);
+
+  // Left to right sliding window: every window starts and ends on a 1 bit
+  for (size_t i = nbits; i-- > 0;) {
+    if (!BIT_AT(words, i)) {
+      mont_mul(acc, acc, acc, ctx);
+      continue;
+    }
+    size_t j = i + 1 >= (size_t)w ? i + 1 - w : 0;
+    while (!BIT_AT(words, j))
+      j++;
+    size_t val = 0;
+    for (size_t k = i + 1; k-- > j;) {
+      val = (val << 1) | BIT_AT(words, k);
+      mont_mul(acc, acc, acc, ctx);
+    }
+    mont_mul(acc, acc, LIMB_PTR(buf, (val >> 1) * n, span), ctx);
+    i = j;
+  }
+
+  // Out of Montgomery form
+  mont_mul(acc, acc, one, ctx);
+  if (!(ret = ensure_capacity_big_enough(dest, n))) {
+    memcpy(dest->data, acc, n * span);
+    dest->size = limbs_strip(acc, n, span);
+  }
+
+done:
+  free(words);
+  free(buf);
+  bi_free(&red);
+  return ret;
+}
+
+/**
+ * Square and multiply with bi_mul_bi / bi_divmod_bi to check against
+ */
+static int test_powmod_slow(
+  struct big_uint* dest,
+  const struct big_uint* b,
+  uint64_t e,
+  const struct big_uint* m)
+{
+  struct big_uint x;
+  bi_init_base(&x, 0, b->base);
+  bi_divmod_bi(NULL, &x, b, m);
+  dest->size = 0;
+  bi_add_sc(dest, 1);
+  bi_divmod_bi(NULL, dest, dest, m);
+  for (; e; e >>= 1) {
+    if (e & 1) {
+      bi_mul_bi(dest, dest, &x);
+      bi_divmod_bi(NULL, dest, dest, m);
+    }
+    bi_mul_bi(&x, &x, &x);
+    bi_divmod_bi(NULL, &x, &x, m);
+  }
+  bi_free(&x);
+  return 0;
+}
+
+static int test_bi_powmod_once(size_t mn, size_t bn, uint64_t e, uint64_t base)
+{
+  struct big_uint m, b, exp, fast, slow;
+  struct bi_mont_ctx ctx;
+  bi_init(&m, 0, base);
+  bi_init(&b, 0, base);
+  bi_init(&exp, e, 10);
+  bi_init(&fast, 0, base);
+  bi_init(&slow, 0, base);
+
+  // Retry until the modulus is coprime to the base
+  do {
+    test_rand_bi(&m, mn);
+  } while (!mont_neg_inverse(limb_get(m.data, 0, m.span), base)
+           || (mn == 1 && limb_get(m.data, 0, m.span) == 1));
+  test_rand_bi(&b, bn);
+
+  int ret = bi_mont_init(&ctx, &m)
+            || bi_powmod(&fast, &b, &exp, &ctx)
+            || test_powmod_slow(&slow, &b, e, &m)
+            || limbs_cmp(fast.data, fast.size, slow.data, slow.size, fast.span);
+  bi_mont_free(&ctx);
+
+  if (ret)
+    bi_test_failed("bi_powmod(%zu limbs ^ %" PRIu64 " mod %zu limbs, base = %" PRIu64 ")\n", bn, e, mn, base);
+  else
+    bi_test_passed("bi_powmod(%zu limbs ^ %" PRIu64 " mod %zu limbs, base = %" PRIu64 ")\n", bn, e, mn, base);
+
+  bi_free(&m);
+  bi_free(&b);
+  bi_free(&exp);
+  bi_free(&fast);
+  bi_free(&slow);
+  return -ret;
+}
+
+int test_bi_powmod()
+{
+  int ret = 0;
+
+  // 4^13 mod 497 = 445
+  struct big_uint m, b, e, r;
+  struct bi_mont_ctx ctx;
+  bi_init(&m, 497, 10);
+  bi_init(&b, 4, 10);
+  bi_init(&e, 13, 2);
+  bi_init(&r, 0, 10);
+  if (bi_mont_init(&ctx, &m) || bi_powmod(&r, &b, &e, &ctx) || test_bi_to_u64(&r) != 445) {
+    bi_test_failed("bi_powmod(4 ^ 13 mod 497)\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_powmod(4 ^ 13 mod 497)\n");
+  }
+  bi_mont_free(&ctx);
+
+  // Not coprime to the base
+  m.size = 0;
+  bi_add_sc(&m, 500);
+  if (!bi_mont_init(&ctx, &m)) {
+    bi_test_failed("bi_mont_init(500, base = 10)\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_mont_init(500, base = 10)\n");
+  }
+  bi_free(&m);
+  bi_free(&b);
+  bi_free(&e);
+  bi_free(&r);
+
+  uint64_t bases[] = { 2, 3, 10, 255, 40000, 1000000000, 1lu << 32, 1000000000000000000, MAX_BASE };
+  for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i) {
+    ret = test_bi_powmod_once(2, 1, 0, bases[i]) || ret;
+    ret = test_bi_powmod_once(2, 3, 65537, bases[i]) || ret;
+    ret = test_bi_powmod_once(4, 9, 12345678901lu, bases[i]) || ret;
+    ret = test_bi_powmod_once(33, 20, (uint64_t)-1, bases[i]) || ret;
+  }
+  return -ret;
+}
+
+////////////////////////////////////////////// Binary Limbs
+/**
+ * Rewrites a BI_BASE_2_64 number in base 2^32 (every limb splits in two)
+ */
+static int test_bin_to_32(struct big_uint* dest, const struct big_uint* bin)
+{
+  if (ensure_capacity_big_enough(dest, 2 * bin->size))
+    return -1;
+  for (size_t i = 0; i < bin->size; ++i) {
+    uint64_t limb = limb_get(bin->data, i, UI64);
+    limb_set(dest->data, 2 * i, dest->span, limb & UINT32_MAX);
+    limb_set(dest->data, 2 * i + 1, dest->span, limb >> 32);
+  }
+  dest->size = limbs_strip(dest->data, 2 * bin->size, dest->span);
+  return 0;
+}
+
+/**
+ * Checks bin (BI_BASE_2_64) and b32 (base 2^32) hold the same value
+ */
+static int test_bin_eq32(const struct big_uint* bin, const struct big_uint* b32)
+{
+  struct big_uint conv;
+  bi_init(&conv, 0, 1lu << 32);
+  int ret = test_bin_to_32(&conv, bin)
+            || limbs_cmp(conv.data, conv.size, b32->data, b32->size, b32->span);
+  bi_free(&conv);
+  return ret;
+}
+
+static int test_bi_bin_once(size_t an, size_t bn, size_t newton)
+{
+  const uint64_t b32 = 1lu << 32;
+  struct big_uint a, b, q, r, a32, b32a, q32, r32;
+  struct bi_mont_ctx ctx, ctx32;
+  bi_init_bin(&a, 0);
+  bi_init_bin(&b, 0);
+  bi_init_bin(&q, 0);
+  bi_init_bin(&r, 0);
+  bi_init(&a32, 0, b32);
+  bi_init(&b32a, 0, b32);
+  bi_init(&q32, 0, b32);
+  bi_init(&r32, 0, b32);
+  test_rand_bi(&a, an);
+  test_rand_bi(&b, bn);
+  // Odd modulus for Montgomery
+  limb_set(b.data, 0, UI64, limb_get(b.data, 0, UI64) | 1);
+  test_bin_to_32(&a32, &a);
+  test_bin_to_32(&b32a, &b);
+
+  size_t saved = bi_newton_threshold;
+  bi_newton_threshold = newton;
+  int ret = 0;
+
+  // a + b, a * b, a / b through the binary kernels
+  ret = ret || bi_add_bi(&q, &a) || bi_add_bi(&q, &b);
+  ret = ret || bi_add_bi(&q32, &a32) || bi_add_bi(&q32, &b32a);
+  ret = ret || test_bin_eq32(&q, &q32);
+
+  ret = ret || bi_mul_bi(&q, &a, &b) || bi_mul_bi(&q32, &a32, &b32a);
+  ret = ret || test_bin_eq32(&q, &q32);
+
+  ret = ret || bi_divmod_bi(&q, &r, &a, &b) || bi_divmod_bi(&q32, &r32, &a32, &b32a);
+  ret = ret || test_bin_eq32(&q, &q32) || test_bin_eq32(&r, &r32);
+
+  // a ^ e mod b, e is one random word
+  struct big_uint e, e32;
+  bi_init_bin(&e, test_rand());
+  bi_init(&e32, 0, b32);
+  test_bin_to_32(&e32, &e);
+  ret = ret || bi_mont_init(&ctx, &b) || bi_mont_init(&ctx32, &b32a);
+  ret = ret || bi_powmod(&q, &a, &e, &ctx) || bi_powmod(&q32, &a32, &e32, &ctx32);
+  ret = ret || test_bin_eq32(&q, &q32);
+  bi_mont_free(&ctx);
+  bi_mont_free(&ctx32);
+  bi_free(&e);
+  bi_free(&e32);
+
+  bi_newton_threshold = saved;
+  if (ret)
+    bi_test_failed("base 2^64 (%zu limbs, %zu limbs, newton = %zu) doesn't match base 2^32\n", an, bn, newton);
+  else
+    bi_test_passed("base 2^64 (%zu limbs, %zu limbs, newton = %zu)\n", an, bn, newton);
+
+  bi_free(&a);
+  bi_free(&b);
+  bi_free(&q);
+  bi_free(&r);
+  bi_free(&a32);
+  bi_free(&b32a);
+  bi_free(&q32);
+  bi_free(&r32);
+  return ret;
+}
+
+int test_bi_bin()
+{
+  int ret = 0;
+
+  // (2^64 - 1) + 1 = 2^64
+  struct big_uint a, b;
+  bi_init_bin(&a, UINT64_MAX);
+  bi_init_bin(&b, 1);
+  if (bi_add_bi(&a, &b) || a.size != 2
+      || limb_get(a.data, 0, UI64) != 0 || limb_get(a.data, 1, UI64) != 1) {
+    bi_test_failed("bi_add_bi(2^64 - 1 + 1, base = 2^64)\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_add_bi(2^64 - 1 + 1, base = 2^64)\n");
+  }
+
+  // (2^64 - 1)^2 = 2^128 - 2^65 + 1
+  a.size = 0;
+  bi_add_sc(&a, UINT64_MAX);
+  if (bi_mul_bi(&a, &a, &a) || a.size != 2
+      || limb_get(a.data, 0, UI64) != 1 || limb_get(a.data, 1, UI64) != UINT64_MAX - 1) {
+    bi_test_failed("bi_mul_bi((2^64 - 1)^2, base = 2^64)\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_mul_bi((2^64 - 1)^2, base = 2^64)\n");
+  }
+
+  // Carry out of bi_add_sc ripples through a run of full limbs
+  a.size = 0;
+  bi_add_sc(&a, UINT64_MAX);
+  bi_mul_bi(&a, &a, &b);
+  ensure_capacity_big_enough(&a, 3);
+  limb_set(a.data, 1, UI64, UINT64_MAX);
+  a.size = 2;
+  if (bi_add_sc(&a, 1) || a.size != 3 || limb_get(a.data, 0, UI64)
+      || limb_get(a.data, 1, UI64) || limb_get(a.data, 2, UI64) != 1) {
+    bi_test_failed("bi_add_sc(2^128 - 1 + 1, base = 2^64)\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_add_sc(2^128 - 1 + 1, base = 2^64)\n");
+  }
+  bi_free(&a);
+  bi_free(&b);
+
+  size_t sizes[][2] = { { 1, 1 }, { 3, 2 }, { 9, 4 }, { 40, 33 }, { 200, 150 }, { 600, 300 } };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    ret = test_bi_bin_once(sizes[i][0], sizes[i][1], (size_t)-1) || ret;
+    ret = test_bi_bin_once(sizes[i][0], sizes[i][1], 8) || ret;
+  }
+  return -ret;
+}
+
+////////////////////////////////////////////// Packed Digits
+/**
+ * Digits per block in bi_packed_add_bi. A multiple of 32 so every block
+ * starts on a byte boundary (and on a whole 16 byte nibble vector)
+ */
+#define PACKED_BLOCK 256
+
+/**
+ * ceil(log2(base)) - the bits one digit takes
+ */
+static size_t packed_bits(uint64_t base)
+{
+  return 64 - __builtin_clzl(base - 1);
+}
+
+/**
+ * Makes room for n digits. The word loads in packed_get read up to 7 bytes
+ * in front of a digit, so 8 bytes of slack always sit before the top one
+ */
+static int packed_reserve(struct bi_packed* bp, size_t n)
+{
+  size_t need = (n * bp->bits + 7) / 8 + 8;
+  if(bp->capacity >= need)
+    return 0;
+
+  size_t cap = bp->capacity ? bp->capacity : 16;
+  while(cap < need)
+    cap *= 2;
+  uint8_t* data = malloc(cap);
+  if(!data) {
+    bi_error("Couldn't allocate packed digits\n");
+    return -1;
+  }
+  // Digits hang off the end of the buffer, so the old bytes move to the end
+  memset(data, 0, cap - bp->capacity);
+  if(bp->capacity)
+    memcpy(data + cap - bp->capacity, bp->data, bp->capacity);
+  free(bp->data);
+  bp->data = data;
+  bp->capacity = cap;
+  return 0;
+}
+
+/**
+ * Digit i of a packed buffer of dl bytes
+ */
+static inline uint64_t packed_get(const uint8_t* data, size_t dl, size_t bits, size_t i)
+{
+  if(bits > 56)
+    return get_bits_span(data, dl, bits, i);
+  // One big endian word always covers the digit (shift <= 7, bits <= 56)
+  size_t off = i * bits;
+  uint64_t w;
+  memcpy(&w, data + dl - 8 - off / 8, sizeof(w));
+  return (__builtin_bswap64(w) >> (off % 8)) & (~0lu >> (64 - bits));
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/**
+ * Base 9 - 16 (two digits a byte): 32 digits per 16 byte vector. Bytes are
+ * reversed (digit 0 is at the end) and split / joined on the nibbles
+ */
+TARGET_SSSE3 static size_t packed_unpack4_ssse3(
+  uint8_t* d, const uint8_t* data, size_t dl, size_t i0, size_t n)
+{
+  const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  const __m128i lo = _mm_set1_epi8(0x0F);
+  size_t i = 0;
+  for(; i + 32 <= n; i += 32) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(data + dl - (i0 + i) / 2 - 16));
+    x = _mm_shuffle_epi8(x, rev);
+    __m128i l = _mm_and_si128(x, lo);
+    __m128i h = _mm_and_si128(_mm_srli_epi16(x, 4), lo);
+    _mm_storeu_si128((__m128i*)(d + i), _mm_unpacklo_epi8(l, h));
+    _mm_storeu_si128((__m128i*)(d + i + 16), _mm_unpackhi_epi8(l, h));
+  }
+  return i;
+}
+
+TARGET_SSSE3 static size_t packed_repack4_ssse3(
+  uint8_t* data, size_t dl, size_t i0, const uint8_t* s, size_t n)
+{
+  const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  // lo + 16 hi for every digit pair
+  const __m128i join = _mm_set1_epi16(0x1001);
+  size_t i = 0;
+  for(; i + 32 <= n; i += 32) {
+    __m128i a = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(s + i)), join);
+    __m128i b = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i*)(s + i + 16)), join);
+    __m128i x = _mm_shuffle_epi8(_mm_packus_epi16(a, b), rev);
+    _mm_storeu_si128((__m128i*)(data + dl - (i0 + i) / 2 - 16), x);
+  }
+  return i;
+}
+#endif
+
+static int packed_have_ssse3()
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+  return __builtin_cpu_supports("ssse3");
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Up to 32 bits a digit the bytes are streamed (from the end down) through
+ * a word, 4 at a time. Wider digits get a word load each
+ */
+#define PACKED_UNPACK(type, d, data, dl, bits, i0, i, n) ({                   \
+  type* _d = (type*)(d);                                                      \
+  if((bits) <= 32) {                                                          \
+    const uint8_t* _p = (data) + (dl) - ((i0) + (i)) * (bits) / 8;            \
+    const uint64_t _mask = ~0lu >> (64 - (bits));                             \
+    uint64_t _acc = 0;                                                        \
+    size_t _nb = 0;                                                           \
+    for(; (i) < (n); ++(i)) {                                                 \
+      if(_nb < (bits)) {                                                      \
+        uint32_t _w;                                                          \
+        _p -= 4;                                                              \
+        memcpy(&_w, _p, sizeof(_w));                                          \
+        _acc |= (uint64_t)__builtin_bswap32(_w) << _nb;                       \
+        _nb += 32;                                                            \
+      }                                                                       \
+      _d[(i)] = (type)(_acc & _mask);                                         \
+      _acc >>= (bits);                                                        \
+      _nb -= (bits);                                                          \
+    }                                                                         \
+  }                                                                           \
+  for(; (i) < (n); ++(i))                                                     \
+    _d[(i)] = (type)packed_get((data), (dl), (bits), (i0) + (i));             \
+})
+
+#define PACKED_REPACK(type, data, dl, bits, i0, s, i, n) ({                   \
+  const type* _s = (const type*)(s);                                          \
+  uint8_t* _p = (data) + (dl) - ((i0) + (i)) * (bits) / 8;                    \
+  uint64_t _acc = 0;                                                          \
+  size_t _nb = 0;                                                             \
+  for(; (i) < (n); ++(i)) {                                                   \
+    _acc |= (uint64_t)_s[(i)] << _nb;                                         \
+    _nb += (bits);                                                            \
+    if(_nb >= 32) {                                                           \
+      uint32_t _w = __builtin_bswap32((uint32_t)_acc);                        \
+      _p -= 4;                                                                \
+      memcpy(_p, &_w, sizeof(_w));                                            \
+      _acc >>= 32;                                                            \
+      _nb -= 32;                                                              \
+    }                                                                         \
+  }                                                                           \
+  for(; _nb >= 8; _nb -= 8, _acc >>= 8)                                       \
+    *--_p = (uint8_t)_acc;                                                    \
+  if(_nb) {                                                                   \
+    --_p;                                                                     \
+    *_p = (*_p & (uint8_t)(0xff << _nb)) | (uint8_t)_acc;                     \
+  }                                                                           \
+})
+
+/**
+ * Unpacks digits [i0, i0 + n) into limbs of width [span]. i0 * bits has
+ * to land on a byte
+ */
+static void packed_unpack(
+  uint8_t* d, size_t span,
+  const uint8_t* data, size_t dl, size_t bits,
+  size_t i0, size_t n)
+{
+  assert(!(i0 * bits % 8));
+  size_t i = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+  if(bits == 4 && span == UI8 && packed_have_ssse3())
+    i = packed_unpack4_ssse3(d, data, dl, i0, n);
+#endif
+  switch(span){
+    case UI8:
+      PACKED_UNPACK(uint8_t, d, data, dl, bits, i0, i, n);
+      break;
+    case UI16:
+      PACKED_UNPACK(uint16_t, d, data, dl, bits, i0, i, n);
+      break;
+    case UI32:
+      PACKED_UNPACK(uint32_t, d, data, dl, bits, i0, i, n);
+      break;
+    case UI64:
+      PACKED_UNPACK(uint64_t, d, data, dl, bits, i0, i, n);
+      break;
+    default:
+      assert(0);
+  }
+}
+
+/**
+ * Packs n limbs of width [span] into digits [i0, i0 + n). i0 * bits has to
+ * land on a byte. Bits past the last digit in its byte are kept
+ */
+static void packed_repack(
+  uint8_t* data, size_t dl, size_t bits, size_t i0,
+  const uint8_t* s, size_t span, size_t n)
+{
+  assert(!(i0 * bits % 8));
+  size_t i = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+  if(bits == 4 && span == UI8 && packed_have_ssse3())
+    i = packed_repack4_ssse3(data, dl, i0, s, n);
+#endif
+  if(bits > 32) {
+    for(; i < n; ++i)
+      set_bits_span(data, dl, bits, i0 + i, limb_get(s, i, span));
+    return;
+  }
+
+  switch(span){
+    case UI8:
+      PACKED_REPACK(uint8_t, data, dl, bits, i0, s, i, n);
+      break;
+    case UI16:
+      PACKED_REPACK(uint16_t, data, dl, bits, i0, s, i, n);
+      break;
+    case UI32:
+      PACKED_REPACK(uint32_t, data, dl, bits, i0, s, i, n);
+      break;
+    case UI64:
+      PACKED_REPACK(uint64_t, data, dl, bits, i0, s, i, n);
+      break;
+    default:
+      assert(0);
+  }
+}
+
+int bi_packed_init(
+  struct bi_packed* bp,
+  uint64_t start,
+  uint64_t base)
+{
+  if (base < 2 || base > MAX_BASE) {
+    bi_error("Invalid base: %" PRIu64 ". Required: 2 <= base <= %" PRIu64 "\n", base, MAX_BASE);
+    return -1;
+  }
+
+  memset(bp, 0, sizeof(struct bi_packed));
+  bp->base = base;
+  bp->bits = packed_bits(base);
+  if (packed_reserve(bp, 1))
+    return -1;
+  return bi_packed_add_sc(bp, start);
+}
+
+void bi_packed_free(struct bi_packed* bp)
+{
+  free(bp->data);
+  bp->data = NULL;
+  bp->size = 0;
+  bp->capacity = 0;
+}
+
+int bi_pack(
+  struct bi_packed* dest,
+  const struct big_uint* src)
+{
+  if (dest->base != src->base) {
+    bi_error("Can only pack into a packed number of the same base\n");
+    return -1;
+  }
+  if (packed_reserve(dest, src->size))
+    return -1;
+  memset(dest->data, 0, dest->capacity);
+  packed_repack(dest->data, dest->capacity, dest->bits, 0, src->data, src->span, src->size);
+  dest->size = src->size;
+  return 0;
+}
+
+int bi_unpack(
+  struct big_uint* dest,
+  const struct bi_packed* src)
+{
+  if (dest->base != src->base) {
+    bi_error("Can only unpack into a big int of the same base\n");
+    return -1;
+  }
+  if (ensure_capacity_big_enough(dest, src->size))
+    return -1;
+  packed_unpack(dest->data, dest->span, src->data, src->capacity, src->bits, 0, src->size);
+  dest->size = src->size;
+  return 0;
+}
+
+int bi_packed_add_bi(
+  struct bi_packed* dest,
+  const struct bi_packed* right)
+{
+  if (dest->base != right->base) {
+    bi_error("Can only add two packed numbers if they have the same base\n");
+    return -1;
+  }
+
+  size_t n = dest->size > right->size ? dest->size : right->size;
+  if (packed_reserve(dest, n + 1))
+    return -1;
+
+  // Unpack a block of each side, add them as limbs and pack the sum back.
+  // Once right runs out and the carry dies the rest of dest stays as is
+  uint64_t base = dest->base;
+  size_t bits = dest->bits;
+  size_t span = span_from_base(base);
+  uint8_t a[PACKED_BLOCK * UI64];
+  uint8_t b[PACKED_BLOCK * UI64];
+  const uint8_t one[UI64] = { 1 };
+  uint64_t carry = 0;
+  for (size_t i0 = 0; i0 < n && (i0 < right->size || carry); i0 += PACKED_BLOCK) {
+    size_t cnt = n - i0 < PACKED_BLOCK ? n - i0 : PACKED_BLOCK;
+    size_t rcnt = right->size > i0 ? right->size - i0 : 0;
+    rcnt = rcnt < cnt ? rcnt : cnt;
+
+    // Both before the repack - right may be dest
+    packed_unpack(a, span, dest->data, dest->capacity, bits, i0, cnt);
+    packed_unpack(b, span, right->data, right->capacity, bits, i0, rcnt);
+    uint64_t c = limbs_add(a, a, cnt, b, rcnt, span, base);
+    // a + b + carry < 2 base^cnt so at most one of these carries
+    if (carry)
+      c += limbs_add(a, a, cnt, one, 1, span, base);
+    carry = c;
+    packed_repack(dest->data, dest->capacity, bits, i0, a, span, cnt);
+  }
+
+  if (carry)
+    set_bits_span(dest->data, dest->capacity, bits, n++, 1);
+  dest->size = n;
+  return 0;
+}
+
+int bi_packed_add_sc(
+  struct bi_packed* dest,
+  const uint64_t right)
+{
+  uint64_t carry = right;
+  size_t i = 0;
+  while(carry) {
+    // Digits past size are already zero
+    if(i == dest->size) {
+      if(packed_reserve(dest, i + 1))
+        return -1;
+      dest->size++;
+    }
+
+    uint64_t digit = packed_get(dest->data, dest->capacity, dest->bits, i) + carry % dest->base;
+    carry /= dest->base;
+    if(digit >= dest->base) {
+      digit -= dest->base;
+      carry++;
+    }
+    set_bits_span(dest->data, dest->capacity, dest->bits, i, digit);
+    i++;
+  }
+  return 0;
+}
+
+static int test_bi_packed_once(uint64_t base, size_t an, size_t bn)
+{
+  struct big_uint a, b, check;
+  struct bi_packed pa, pb;
+  bi_init(&a, 0, base);
+  bi_init(&b, 0, base);
+  bi_init(&check, 0, base);
+  bi_packed_init(&pa, 0, base);
+  bi_packed_init(&pb, 0, base);
+  test_rand_bi(&a, an);
+  test_rand_bi(&b, bn);
+
+  // Round trip
+  int ret = bi_pack(&pa, &a) || bi_pack(&pb, &b) || bi_unpack(&check, &pa)
+            || limbs_cmp(check.data, check.size, a.data, a.size, a.span);
+
+  // a + b, then doubled in place, then a scalar
+  uint64_t sc = test_rand();
+  ret = ret || bi_packed_add_bi(&pa, &pb) || bi_add_bi(&a, &b);
+  ret = ret || bi_packed_add_bi(&pa, &pa) || bi_add_bi(&a, &a);
+  ret = ret || bi_packed_add_sc(&pa, sc) || bi_add_sc(&a, sc);
+  ret = ret || bi_unpack(&check, &pa) || check.size != a.size
+            || limbs_cmp(check.data, check.size, a.data, a.size, a.span);
+
+  if (ret)
+    bi_test_failed("bi_packed (%zu + %zu digits, base = %" PRIu64 ") doesn't match big_uint\n", an, bn, base);
+  else
+    bi_test_passed("bi_packed (%zu + %zu digits, base = %" PRIu64 ", %zu bits)\n", an, bn, base, pa.bits);
+
+  bi_free(&a);
+  bi_free(&b);
+  bi_free(&check);
+  bi_packed_free(&pa);
+  bi_packed_free(&pb);
+  return ret;
+}
+
+int test_bi_packed()
+{
+  int ret = 0;
+
+  // Widths
+  uint64_t widths[][2] = { { 2, 1 }, { 3, 2 }, { 4, 2 }, { 10, 4 }, { 16, 4 }, { 17, 5 }, { MAX_BASE, 63 } };
+  for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+    if (packed_bits(widths[i][0]) != widths[i][1]) {
+      bi_test_failed("packed_bits(%" PRIu64 ") Expected: %" PRIu64 " Actual: %zu\n",
+                     widths[i][0], widths[i][1], packed_bits(widths[i][0]));
+      ret = -1;
+    } else {
+      bi_test_passed("packed_bits(%" PRIu64 ") == %" PRIu64 "\n", widths[i][0], widths[i][1]);
+    }
+  }
+
+  // Decimal counter carrying through a run of nines
+  struct bi_packed c;
+  struct big_uint u;
+  bi_packed_init(&c, 99999999999lu, 10);
+  bi_init(&u, 0, 10);
+  bi_packed_add_sc(&c, 1);
+  bi_unpack(&u, &c);
+  if (u.size != 12 || limb_get(u.data, 11, u.span) != 1 || limbs_strip(u.data, 11, u.span)) {
+    bi_test_failed("bi_packed_add_sc(99999999999 + 1, base = 10)\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_packed_add_sc(99999999999 + 1, base = 10)\n");
+  }
+  bi_packed_free(&c);
+  bi_free(&u);
+
+  uint64_t bases[] = { 2, 3, 10, 16, 100, 255, 1000, 40000, 1000000000, 1lu << 56, (1lu << 56) + 1, MAX_BASE };
+  size_t sizes[][2] = { { 1, 1 }, { 7, 3 }, { 33, 64 }, { 300, 299 }, { 1000, 10 } };
+  for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i)
+    for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j)
+      ret = test_bi_packed_once(bases[i], sizes[j][0], sizes[j][1]) || ret;
+  return -ret;
+}
+
+////////////////////////////////////////////// Radix Conversion
+/**
+ * Words of the source base per leaf of the conversion tree. Leaves are
+ * converted by Horner's rule, everything above them by multiplication
+ */
+#define CONVERT_LEAF 16
+
+/**
+ * d = d * m + c for any word m (it doesn't need to be below base). The
+ * carry spills into new limbs, d needs room for them
+ */
+static void bi_mul_add_word(struct big_uint* d, uint64_t m, uint64_t c)
+{
+  struct recip rb = bi_recip(d);
+  uint64_t r;
+  for(size_t i = 0; i < d->size; ++i) {
+    // (base - 1) m + c < base 2^64 so the quotient is a word
+    unsigned __int128 cur = (unsigned __int128)limb_get(d->data, i, d->span) * m + c;
+    c = recip_divmod((uint64_t)(cur >> 64), (uint64_t)cur, &rb, &r);
+    limb_set(d->data, i, d->span, r);
+  }
+  while(c) {
+    c = recip_divmod(0, c, &rb, &r);
+    limb_set(d->data, d->size++, d->span, r);
+  }
+}
+
+/**
+ * Splits src into words of [w] = base^g (as many digits as fit a word),
+ * lowest first. BI_BASE_2_64 is split into halves so w still fits
+ */
+static uint64_t* convert_words(const struct big_uint* src, size_t* nwords, uint64_t* w)
+{
+  size_t g = 1;
+  if(src->base == BI_BASE_2_64) {
+    *w = 1lu << 32;
+    *nwords = 2 * src->size;
+  } else {
+    for(*w = src->base; *w <= UINT64_MAX / src->base; *w *= src->base)
+      g++;
+    *nwords = (src->size + g - 1) / g;
+  }
+
+  uint64_t* words = malloc((*nwords ? *nwords : 1) * sizeof(uint64_t));
+  if(!words)
+    return NULL;
+  for(size_t j = 0; j < *nwords; ++j) {
+    if(src->base == BI_BASE_2_64) {
+      words[j] = limb_get(src->data, j / 2, UI64) >> (32 * (j % 2)) & UINT32_MAX;
+      continue;
+    }
+    size_t hi = (j + 1) * g < src->size ? (j + 1) * g : src->size;
+    words[j] = 0;
+    for(size_t i = hi; i-- > j * g;)
+      words[j] = words[j] * src->base + limb_get(src->data, i, src->span);
+  }
+  return words;
+}
+
+/**
+ * dest (zero) = the n words in base w, converted to dest's base.
+ * pow[k] = w^(CONVERT_LEAF 2^k): value = hi * pow[k] + lo where lo is
+ * the largest tree node below n
+ */
+static int convert_rec(
+  struct big_uint* dest,
+  const uint64_t* words, size_t n, uint64_t w,
+  const struct big_uint* pow)
+{
+  if(n <= CONVERT_LEAF) {
+    // Every word adds at most log_base(2^64) + 1 limbs
+    size_t per = dest->base == BI_BASE_2_64 ? 1 : 64 / (63 - __builtin_clzl(dest->base)) + 1;
+    if(ensure_capacity_big_enough(dest, n * per + 1))
+      return -1;
+    for(size_t i = n; i-- > 0;)
+      bi_mul_add_word(dest, w, words[i]);
+    return 0;
+  }
+
+  size_t k = 0;
+  while(((size_t)CONVERT_LEAF << (k + 1)) < n)
+    k++;
+  size_t h = (size_t)CONVERT_LEAF << k;
+
+  struct big_uint lo;
+  int ret = bi_init_base(&lo, 0, dest->base);
+  ret = ret || convert_rec(dest, words + h, n - h, w, pow)
+            || bi_mul_bi(dest, dest, &pow[k])
+            || convert_rec(&lo, words, h, w, pow)
+            || bi_add_bi(dest, &lo);
+  bi_free(&lo);
+  return ret;
+}
+
+/**
+ * dest (zero) = the n words in base w. Builds the power tree
+ * pow[k] = w^(CONVERT_LEAF 2^k) for every split convert_rec will make
+ */
+static int convert_from_words(
+  struct big_uint* dest,
+  const uint64_t* words, size_t n, uint64_t w)
+{
+  size_t levels = 0;
+  while (((size_t)CONVERT_LEAF << levels) < n)
+    levels++;
+  struct big_uint* pow = calloc(levels ? levels : 1, sizeof(struct big_uint));
+  int ret = !pow;
+  size_t made = 0;
+  for (; !ret && made < levels; ++made) {
+    ret = bi_init_base(&pow[made], made ? 0 : 1, dest->base);
+    if (ret)
+      break;
+    if (made) {
+      ret = bi_mul_bi(&pow[made], &pow[made - 1], &pow[made - 1]);
+      continue;
+    }
+    size_t per = dest->base == BI_BASE_2_64 ? 1 : 64 / (63 - __builtin_clzl(dest->base)) + 1;
+    ret = ensure_capacity_big_enough(&pow[0], CONVERT_LEAF * per + 1);
+    for (size_t i = 0; !ret && i < CONVERT_LEAF; ++i)
+      bi_mul_add_word(&pow[0], w, 0);
+  }
+
+  ret = ret || convert_rec(dest, words, n, w, pow);
+  for (size_t i = 0; i < made; ++i)
+    bi_free(&pow[i]);
+  free(pow);
+  return ret;
+}
+
+int bi_convert_base(
+    struct big_uint* dest,
+    const struct big_uint* src)
+{
+  STATS_OP(BI_OP_CONVERT_BASE, src->size, src->span);
+  if (src->base == dest->base)
+    return src == dest ? 0 : bi_set_limbs(dest, src->data, src->size);
+
+  // src is fully read into words before dest is touched, so they may alias
+  size_t n;
+  uint64_t w;
+  uint64_t* words = convert_words(src, &n, &w);
+  struct big_uint tmp;
+  int ret = !words || bi_init_base(&tmp, 0, dest->base);
+  if (!ret) {
+    ret = convert_from_words(&tmp, words, n, w)
+          || bi_set_limbs(dest, tmp.data, tmp.size);
+    bi_free(&tmp);
+  }
+  if (ret)
+    bi_error("Couldn't convert to base %" PRIu64 "\n", dest->base);
+  free(words);
+  return ret;
+}
+
+static int test_bi_convert_base_small(uint64_t v, uint64_t from, uint64_t to)
+{
+  struct big_uint src, dest;
+  bi_init_base(&src, v, from);
+  bi_init_base(&dest, 0, to);
+  int ret = bi_convert_base(&dest, &src) || test_bi_to_u64(&dest) != v;
+  if (ret)
+    bi_test_failed("bi_convert_base(%" PRIu64 ", %" PRIu64 " -> %" PRIu64 ")\n", v, from, to);
+  else
+    bi_test_passed("bi_convert_base(%" PRIu64 ", %" PRIu64 " -> %" PRIu64 ")\n", v, from, to);
+  bi_free(&src);
+  bi_free(&dest);
+  return ret;
+}
+
+/**
+ * from -> to -> from gets back where it started, and from -> to matches
+ * going through a third base
+ */
+static int test_bi_convert_base_once(size_t n, uint64_t from, uint64_t to, uint64_t via)
+{
+  struct big_uint src, dest, back, mid, indirect;
+  bi_init_base(&src, 0, from);
+  bi_init_base(&dest, 0, to);
+  bi_init_base(&back, 0, from);
+  bi_init_base(&mid, 0, via);
+  bi_init_base(&indirect, 0, to);
+  test_rand_bi(&src, n);
+  int ret = bi_convert_base(&dest, &src);
+  ret = ret || bi_convert_base(&back, &dest);
+  ret = ret || limbs_cmp(back.data, back.size, src.data, src.size, src.span);
+  ret = ret || bi_convert_base(&mid, &src);
+  ret = ret || bi_convert_base(&indirect, &mid);
+  ret = ret || indirect.size != dest.size
+            || limbs_cmp(indirect.data, indirect.size, dest.data, dest.size, dest.span);
+  if (ret)
+    bi_test_failed("bi_convert_base(%zu limbs, %" PRIu64 " -> %" PRIu64 " via %" PRIu64 ")\n", n, from, to, via);
+  else
+    bi_test_passed("bi_convert_base(%zu limbs, %" PRIu64 " -> %" PRIu64 " via %" PRIu64 ")\n", n, from, to, via);
+  bi_free(&src);
+  bi_free(&dest);
+  bi_free(&back);
+  bi_free(&mid);
+  bi_free(&indirect);
+  return ret;
+}
+
+/**
+ * Converting a number onto itself keeps it, and converting into (and back
+ * into) numbers that already hold big values replaces them
+ */
+static int test_bi_convert_base_alias_once(size_t n, uint64_t from, uint64_t to)
+{
+  struct big_uint x, orig, y;
+  bi_init_base(&x, 0, from);
+  bi_init_base(&orig, 0, from);
+  bi_init_base(&y, 0, to);
+  test_rand_bi(&x, n);
+  test_rand_bi(&y, 2 * n + 40);
+  int ret = bi_set_limbs(&orig, x.data, x.size)
+            || bi_convert_base(&x, &x)
+            || limbs_cmp(x.data, x.size, orig.data, orig.size, orig.span)
+            || bi_convert_base(&y, &x)
+            || bi_convert_base(&x, &y)
+            || x.size != orig.size
+            || limbs_cmp(x.data, x.size, orig.data, orig.size, orig.span);
+  if (ret)
+    bi_test_failed("bi_convert_base(%zu limbs, %" PRIu64 " -> %" PRIu64 ", reusing dest)\n", n, from, to);
+  else
+    bi_test_passed("bi_convert_base(%zu limbs, %" PRIu64 " -> %" PRIu64 ", reusing dest)\n", n, from, to);
+  bi_free(&x);
+  bi_free(&orig);
+  bi_free(&y);
+  return ret;
+}
+
+int test_bi_convert_base()
+{
+  int ret = 0;
+
+  uint64_t small[] = { 0, 1, 9, 10, 123456789, 18446744073709551615lu };
+  uint64_t bases[] = { 2, 7, 10, 1lu << 32, 1000000000, MAX_BASE, BI_BASE_2_64 };
+  for (size_t i = 0; i < sizeof(small) / sizeof(small[0]); ++i)
+    for (size_t j = 0; j < sizeof(bases) / sizeof(bases[0]); ++j)
+      ret = test_bi_convert_base_small(small[i], 10, bases[j]) || ret;
+
+  size_t sizes[] = { 1, 17, 100, 1000, 5000 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    ret = test_bi_convert_base_once(sizes[i], 10, BI_BASE_2_64, 7) || ret;
+    ret = test_bi_convert_base_once(sizes[i], 10, 2, 1000000000) || ret;
+    ret = test_bi_convert_base_once(sizes[i], BI_BASE_2_64, 10, 3) || ret;
+    ret = test_bi_convert_base_once(sizes[i], 1000000000, 1lu << 32, MAX_BASE) || ret;
+    ret = test_bi_convert_base_once(sizes[i], MAX_BASE, 3, 255) || ret;
+    ret = test_bi_convert_base_alias_once(sizes[i], 10, BI_BASE_2_64) || ret;
+    ret = test_bi_convert_base_alias_once(sizes[i], BI_BASE_2_64, 1000000000) || ret;
+  }
+  return -ret;
+}
+
+////////////////////////////////////////////// Decimal Strings
+/**
+ * Decimal digits per limb once a number is in base 10^18 (or the k of a
+ * number that's already in base 10^k)
+ */
+#define DEC_LIMB_DIGITS 18
+
+/**
+ * Writes v in decimal ending right before [end], zero padded to [width]
+ * digits. Returns where the digits start
+ */
+static char* dec_format(char* end, uint64_t v, size_t width)
+{
+  static const char pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+  char* p = end;
+  while (v >= 100) {
+    p -= 2;
+    memcpy(p, pairs + 2 * (v % 100), 2);
+    v /= 100;
+  }
+  if (v >= 10) {
+    p -= 2;
+    memcpy(p, pairs + 2 * v, 2);
+  } else {
+    *--p = (char)('0' + v);
+  }
+  while ((size_t)(end - p) < width)
+    *--p = '0';
+  return p;
+}
+
+/**
+ * k if base = 10^k, otherwise 0
+ */
+static size_t dec_base_digits(uint64_t base)
+{
+  for (uint8_t k = 1; k < 19; ++k)
+    if (quick_pow10(k) == base)
+      return k;
+  return 0;
+}
+
+/**
+ * Sink for the decimal writer. Gets full blocks of the caller's buffer
+ */
+typedef int (*dec_flush_fn)(void* ctx, const char* buf, size_t n);
+
+/**
+ * Streams bi in decimal through [buf] (any length), handing it to [flush]
+ * every time it fills up and once at the end. Numbers not already in a
+ * power of ten base go through bi_convert_base to base 10^18 first, so
+ * this is subquadratic and only ever formats whole limbs
+ */
+static int dec_write(
+  const struct big_uint* bi,
+  char* buf, size_t buflen,
+  dec_flush_fn flush, void* ctx)
+{
+  if (!buflen) {
+    bi_error("Need a buffer to write to\n");
+    return -1;
+  }
+  STATS_OP(BI_OP_TO_STR, bi->size, bi->span);
+
+  struct big_uint conv;
+  const struct big_uint* dec = bi;
+  size_t k = bi->base == BI_BASE_2_64 ? 0 : dec_base_digits(bi->base);
+  if (!k) {
+    if (bi_init_base(&conv, 0, quick_pow10(DEC_LIMB_DIGITS)) || bi_convert_base(&conv, bi)) {
+      bi_free(&conv);
+      return -1;
+    }
+    dec = &conv;
+    k = DEC_LIMB_DIGITS;
+  }
+
+  int ret = 0;
+  size_t used = 0;
+  char tmp[24];
+  for (size_t i = dec->size ? dec->size : 1; !ret && i-- > 0;) {
+    uint64_t limb = dec->size ? limb_get(dec->data, i, dec->span) : 0;
+    char* end = tmp + sizeof(tmp);
+    const char* p = dec_format(end, limb, i + 1 >= dec->size ? 0 : k);
+    while (!ret && p < end) {
+      size_t n = (size_t)(end - p) < buflen - used ? (size_t)(end - p) : buflen - used;
+      memcpy(buf + used, p, n);
+      p += n;
+      used += n;
+      if (used == buflen) {
+        ret = flush(ctx, buf, used);
+        used = 0;
+      }
+    }
+  }
+  if (!ret && used)
+    ret = flush(ctx, buf, used);
+
+  if (dec != bi)
+    bi_free(&conv);
+  return ret;
+}
+
+/**
+ * Flush for bi_to_str - the buffer is big enough that this only runs once
+ */
+static int dec_flush_count(void* ctx, const char* buf, size_t n)
+{
+  (void)buf;
+  *(size_t*)ctx += n;
+  return 0;
+}
+
+static int dec_flush_fd(void* ctx, const char* buf, size_t n)
+{
+  int fd = *(int*)ctx;
+  while (n) {
+    ssize_t w = write(fd, buf, n);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0) {
+      bi_error("Couldn't write to fd %d\n", fd);
+      return -1;
+    }
+    buf += w;
+    n -= (size_t)w;
+  }
+  return 0;
+}
+
+static int dec_flush_file(void* ctx, const char* buf, size_t n)
+{
+  if (fwrite(buf, 1, n, (FILE*)ctx) != n) {
+    bi_error("Couldn't write to file\n");
+    return -1;
+  }
+  return 0;
+}
+
+char* bi_to_str(const struct big_uint* bi)
+{
+  // Every limb turns into at most 20 digits (and base 10^18 limbs into 18)
+  size_t len = 20 * (bi->size ? bi->size : 1) + 1;
+  if (bi->base != BI_BASE_2_64 && bi->base < quick_pow10(DEC_LIMB_DIGITS))
+    len = (size_t)((double)(bi->size ? bi->size : 1) * log10((double)bi->base)) + 2 * DEC_LIMB_DIGITS;
+  char* str = malloc(len);
+  if (!str) {
+    bi_error("Couldn't allocate data in bi_to_str\n");
+    return NULL;
+  }
+  size_t n = 0;
+  if (dec_write(bi, str, len - 1, dec_flush_count, &n)) {
+    free(str);
+    return NULL;
+  }
+  str[n] = '\0';
+  return str;
+}
+
+int bi_write_fd(
+    const struct big_uint* bi,
+    int fd,
+    char* buf,
+    size_t buflen)
+{
+  return dec_write(bi, buf, buflen, dec_flush_fd, &fd);
+}
+
+int bi_write_file(
+    const struct big_uint* bi,
+    FILE* f,
+    char* buf,
+    size_t buflen)
+{
+  return dec_write(bi, buf, buflen, dec_flush_file, f);
+}
+
+int bi_from_str(
+    struct big_uint* dest,
+    const char* str)
+{
+  size_t len = strlen(str);
+  if (!len) {
+    bi_error("Can't parse an empty string\n");
+    return -1;
+  }
+  STATS_OP(BI_OP_FROM_STR, len, 0);
+
+  // 19 digits a word (10^19 < 2^64), lowest word first
+  size_t n = (len + 18) / 19;
+  uint64_t* words = malloc(n * sizeof(uint64_t));
+  if (!words) {
+    bi_error("Couldn't allocate data in bi_from_str\n");
+    return -1;
+  }
+  for (size_t j = 0; j < n; ++j) {
+    size_t hi = len - 19 * j;
+    size_t lo = hi > 19 ? hi - 19 : 0;
+    uint64_t word = 0;
+    for (size_t i = lo; i < hi; ++i) {
+      if (str[i] < '0' || str[i] > '9') {
+        bi_error("Invalid decimal digit '%c'\n", str[i]);
+        free(words);
+        return -1;
+      }
+      word = word * 10 + (uint64_t)(str[i] - '0');
+    }
+    words[j] = word;
+  }
+
+  struct big_uint tmp;
+  int ret = bi_init_base(&tmp, 0, dest->base);
+  ret = ret || convert_from_words(&tmp, words, n, quick_pow10(19));
+  ret = ret || bi_set_limbs(dest, tmp.data, tmp.size);
+  bi_free(&tmp);
+  free(words);
+  return ret;
+}
+
+static int test_bi_str_once(const char* str, const char* expected, uint64_t base)
+{
+  struct big_uint bi;
+  bi_init_base(&bi, 0, base);
+  char* out = NULL;
+  int ret = bi_from_str(&bi, str) || !(out = bi_to_str(&bi)) || strcmp(out, expected);
+
+  // Both streaming writers through a tiny buffer
+  char buf[7];
+  FILE* f = tmpfile();
+  size_t len = strlen(expected);
+  char* back = malloc(2 * len + 1);
+  ret = ret || !f || !back;
+  ret = ret || bi_write_file(&bi, f, buf, sizeof(buf)) || fflush(f);
+  ret = ret || bi_write_fd(&bi, fileno(f), buf, sizeof(buf));
+  if (!ret) {
+    rewind(f);
+    ret = fread(back, 1, 2 * len + 1, f) != 2 * len
+          || memcmp(back, expected, len) || memcmp(back + len, expected, len);
+  }
+
+  size_t shown = len < 40 ? len : 40;
+  if (ret)
+    bi_test_failed("bi_from_str / bi_to_str (%.*s..., %zu digits, base = %" PRIu64 ")\n", (int)shown, expected, len, base);
+  else
+    bi_test_passed("bi_from_str / bi_to_str (%.*s, %zu digits, base = %" PRIu64 ")\n", (int)shown, expected, len, base);
+  if (f)
+    fclose(f);
+  free(back);
+  free(out);
+  bi_free(&bi);
+  return ret;
+}
+
+int test_bi_str()
+{
+  int ret = 0;
+
+  struct big_uint bi;
+  bi_init(&bi, 0, 10);
+  if (!bi_from_str(&bi, "12a") || !bi_from_str(&bi, "")) {
+    bi_test_failed("bi_from_str(invalid)\n");
+    ret = -1;
+  } else {
+    bi_test_passed("bi_from_str(invalid)\n");
+  }
+  bi_free(&bi);
+
+  uint64_t bases[] = { 2, 7, 10, 1000, 1000000000, quick_pow10(18), MAX_BASE, BI_BASE_2_64 };
+  for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i) {
+    ret = test_bi_str_once("0", "0", bases[i]) || ret;
+    ret = test_bi_str_once("000123", "123", bases[i]) || ret;
+    ret = test_bi_str_once("18446744073709551615", "18446744073709551615", bases[i]) || ret;
+    ret = test_bi_str_once("100000000000000000000000000000000000000", "100000000000000000000000000000000000000", bases[i]) || ret;
+  }
+
+  // Long random ones (leading digit non zero)
+  size_t lens[] = { 19, 37, 1000, 30000 };
+  for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); ++i) {
+    char* str = malloc(lens[i] + 1);
+    for (size_t j = 0; j < lens[i]; ++j)
+      str[j] = (char)('0' + (j ? test_rand() % 10 : 1 + test_rand() % 9));
+    str[lens[i]] = '\0';
+    for (size_t j = 0; j < sizeof(bases) / sizeof(bases[0]); ++j)
+      ret = test_bi_str_once(str, str, bases[j]) || ret;
+    free(str);
+  }
+  return -ret;
+}
+
+////////////////////////////////////////////// Arena
+/**
+ * A chunk of arena memory, bumped front to back. Allocations are rounded
+ * up to 8 bytes so limbs of every span stay aligned
+ */
+struct bi_arena_block {
+  struct bi_arena_block* prev;
+  size_t size;          // Bytes in data
+  size_t used;
+  uint64_t data[];
+};
+
+#define ARENA_ALIGN(n) (((n) + 7) & ~(size_t)7)
+#define ARENA_PTR(b, off) ((uint8_t*)(b)->data + (off))
+#define ARENA_DEFAULT_BLOCK (1 << 16)
+
+/**
+ * Pushes a block of at least [bytes] (the spare one if it's big enough)
+ */
+static struct bi_arena_block* arena_push(struct bi_arena* arena, size_t bytes)
+{
+  size_t size = bytes > arena->block_size ? bytes : arena->block_size;
+  struct bi_arena_block* b = arena->spare;
+  if (b && b->size >= size) {
+    arena->spare = NULL;
+  } else if (!(b = malloc(sizeof(struct bi_arena_block) + size))) {
+    bi_error("Couldn't allocate an arena block\n");
+    return NULL;
+  } else {
+    b->size = size;
+  }
+  b->prev = arena->top;
+  b->used = 0;
+  arena->top = b;
+  return b;
+}
+
+static void arena_pop(struct bi_arena* arena)
+{
+  struct bi_arena_block* b = arena->top;
+  arena->top = b->prev;
+  if (!arena->spare && b->size == arena->block_size)
+    arena->spare = b;
+  else
+    free(b);
+}
+
+static uint8_t* arena_alloc(struct bi_arena* arena, size_t bytes)
+{
+  bytes = ARENA_ALIGN(bytes);
+  struct bi_arena_block* b = arena->top;
+  if (!b || b->size - b->used < bytes)
+    if (!(b = arena_push(arena, bytes)))
+      return NULL;
+  uint8_t* ret = ARENA_PTR(b, b->used);
+  b->used += bytes;
+  return ret;
+}
+
+static void arena_pop_bytes(struct bi_arena* arena, size_t bytes)
+{
+  arena->top->used -= bytes;
+}
+
+static int arena_at_top(const struct bi_arena* arena, const struct big_uint* bi)
+{
+  const struct bi_arena_block* b = arena->top;
+  return b && bi->data + bi->capacity == ARENA_PTR(b, b->used)
+         && (arena->floor != b || bi->data >= ARENA_PTR(b, arena->floor_used));
+}
+
+static int arena_above_floor(const struct bi_arena* arena, const uint8_t* p)
+{
+  // Walk down from the top, anything met before the floor is newer than it
+  for (const struct bi_arena_block* b = arena->top; b; b = b->prev) {
+    int in = (uintptr_t)p >= (uintptr_t)b->data
+             && (uintptr_t)p < (uintptr_t)ARENA_PTR(b, b->size);
+    if (b == arena->floor)
+      return in && p >= ARENA_PTR(b, arena->floor_used);
+    if (in)
+      return 1;
+  }
+  return 0;
+}
+
+static int arena_grow(struct big_uint* bi, size_t bytes)
+{
+  struct bi_arena* arena = bi->arena;
+  struct bi_arena_block* top = arena->top;
+  bytes = ARENA_ALIGN(bytes);
+
+  int at_top = arena_at_top(arena, bi);
+  size_t off = at_top ? (size_t)(bi->data - ARENA_PTR(top, 0)) : 0;
+  if (at_top && off + bytes <= top->size) {
+    top->used = off + bytes;
+    bi->capacity = bytes;
+    return 0;
+  }
+
+  // Anything bumped now by a value from before the innermost mark would be
+  // released under it, so those move to the heap instead
+  uint8_t* data;
+  const struct bi_allocator* alloc = BI_ALLOC(bi);
+  if (at_top || arena_above_floor(arena, bi->data)) {
+    data = arena_alloc(arena, bytes);
+  } else if ((data = alloc->alloc(alloc->ctx, bytes))) {
+    bi->arena = NULL;
+  }
+  if (!data) {
+    bi_error("Couldn't reallocate data when growing an arena value\n");
+    return -1;
+  }
+
+  memcpy(data, bi->data, bi->capacity);
+  if (at_top)
+    top->used = off;
+  bi->data = data;
+  bi->capacity = bytes;
+  return 0;
+}
+
+int bi_arena_init(
+    struct bi_arena* arena,
+    size_t block_size)
+{
+  struct bi_arena ret = {
+    .block_size = ARENA_ALIGN(block_size ? block_size : ARENA_DEFAULT_BLOCK),
+  };
+  memcpy(arena, &ret, sizeof(struct bi_arena));
+  return arena_push(arena, 0) ? 0 : -1;
+}
+
+void bi_arena_free(struct bi_arena* arena)
+{
+  while (arena->top)
+    arena_pop(arena);
+  free(arena->spare);
+  arena->spare = NULL;
+  arena->floor = NULL;
+}
+
+struct bi_arena_pos bi_arena_mark(struct bi_arena* arena)
+{
+  struct bi_arena_pos ret = {
+    .block = arena->top,
+    .used = arena->top ? arena->top->used : 0,
+    .floor = arena->floor,
+    .floor_used = arena->floor_used,
+  };
+  arena->floor = ret.block;
+  arena->floor_used = ret.used;
+  return ret;
+}
+
+void bi_arena_release(
+    struct bi_arena* arena,
+    struct bi_arena_pos pos)
+{
+  while (arena->top != pos.block)
+    arena_pop(arena);
+  if (arena->top)
+    arena->top->used = pos.used;
+  arena->floor = pos.floor;
+  arena->floor_used = pos.floor_used;
+}
+
+int bi_init_in(
+    struct bi_arena* arena,
+    struct big_uint* bi,
+    uint64_t start,
+    uint64_t base)
+{
+  if (base != BI_BASE_2_64 && (base < 2 || base > MAX_BASE)) {
+    bi_error("Invalid base: %" PRIu64 ". Required: 2 <= base <= %" PRIu64 "\n", base, MAX_BASE);
+    return -1;
+  }
+  return bi_init_arena(bi, start, base, arena);
+}
+
+static int test_bi_arena_chain(size_t block_size, uint64_t base, size_t steps)
+{
+  struct bi_arena arena;
+  if (bi_arena_init(&arena, block_size)) {
+    bi_test_failed("bi_arena_init(%zu)\n", block_size);
+    return -1;
+  }
+
+  // Fibonacci-ish chain in the arena against the same chain on the heap
+  struct big_uint x, y, hx, hy, p, hp, q, r, hq, hr;
+  int ret = bi_init_base(&hx, 1, base) || bi_init_base(&hy, 1, base)
+            || bi_init_base(&hp, 0, base) || bi_init_base(&hq, 0, base)
+            || bi_init_base(&hr, 0, base);
+
+  struct bi_arena_pos pos = bi_arena_mark(&arena);
+  ret = ret || bi_init_in(&arena, &x, 1, base) || bi_init_in(&arena, &y, 1, base);
+  for (size_t i = 0; i < steps && !ret; ++i) {
+    ret = bi_add_bi(&x, &y) || bi_add_bi(&y, &x) || bi_add_sc(&x, i)
+          || bi_add_bi(&hx, &hy) || bi_add_bi(&hy, &hx) || bi_add_sc(&hx, i);
+  }
+  ret = ret || limbs_cmp(x.data, x.size, hx.data, hx.size, x.span)
+        || limbs_cmp(y.data, y.size, hy.data, hy.size, y.span);
+
+  // Products and quotients land in the arena too
+  ret = ret || bi_init_in(&arena, &p, 0, base) || bi_init_in(&arena, &q, 0, base)
+        || bi_init_in(&arena, &r, 0, base);
+  ret = ret || bi_mul_bi(&p, &x, &y) || bi_mul_bi(&hp, &hx, &hy)
+        || bi_mul_bi(&p, &p, &x) || bi_mul_bi(&hp, &hp, &hx)
+        || limbs_cmp(p.data, p.size, hp.data, hp.size, p.span);
+  ret = ret || bi_divmod_bi(&q, &r, &p, &y) || bi_divmod_bi(&hq, &hr, &hp, &hy)
+        || limbs_cmp(q.data, q.size, hq.data, hq.size, q.span)
+        || limbs_cmp(r.data, r.size, hr.data, hr.size, r.span);
+  ret = ret || p.arena != &arena || q.arena != &arena || r.arena != &arena;
+  bi_arena_release(&arena, pos);
+
+  if (ret)
+    bi_test_failed("bi_arena chain (block = %zu, base = %" PRIu64 ", steps = %zu)\n", block_size, base, steps);
+  else
+    bi_test_passed("bi_arena chain (block = %zu, base = %" PRIu64 ", steps = %zu)\n", block_size, base, steps);
+  bi_free(&hx);
+  bi_free(&hy);
+  bi_free(&hp);
+  bi_free(&hq);
+  bi_free(&hr);
+  bi_arena_free(&arena);
+  return ret;
+}
+
+int test_bi_arena()
+{
+  int ret = 0;
+
+  ret = test_bi_arena_chain(0, 10, 300) || ret;
+  ret = test_bi_arena_chain(64, 10, 300) || ret;
+  ret = test_bi_arena_chain(256, 1000000000, 500) || ret;
+  ret = test_bi_arena_chain(1000, BI_BASE_2_64, 500) || ret;
+
+  struct bi_arena arena;
+  struct big_uint a, b, big, old;
+  bi_init_base(&big, 0, 10);
+  test_rand_bi(&big, 100);
+  bi_arena_init(&arena, 4096);
+
+  // The top value grows in place, and bi_free hands its bytes back
+  bi_init_in(&arena, &a, 0, 10);
+  uint8_t* at = a.data;
+  int fail = bi_add_bi(&a, &big) || a.data != at || a.capacity < 100;
+  bi_free(&a);
+  fail = fail || bi_init_in(&arena, &b, 7, 10) || b.data != at;
+  if (fail)
+    bi_test_failed("bi_arena grows in place / pops on bi_free\n");
+  else
+    bi_test_passed("bi_arena grows in place / pops on bi_free\n");
+  ret = fail || ret;
+
+  // Release rewinds to the mark
+  struct bi_arena_pos pos = bi_arena_mark(&arena);
+  bi_init_in(&arena, &a, 1, 10);
+  at = a.data;
+  bi_arena_release(&arena, pos);
+  pos = bi_arena_mark(&arena);
+  fail = bi_init_in(&arena, &a, 2, 10) || a.data != at;
+  bi_arena_release(&arena, pos);
+  if (fail)
+    bi_test_failed("bi_arena mark / release\n");
+  else
+    bi_test_passed("bi_arena mark / release\n");
+  ret = fail || ret;
+
+  // A value from before the mark that has to grow inside it moves to the
+  // heap and survives the release
+  bi_init_in(&arena, &old, 0, 10);
+  bi_init_in(&arena, &b, 0, 10);
+  pos = bi_arena_mark(&arena);
+  bi_init_in(&arena, &a, 3, 10);
+  fail = bi_add_bi(&old, &big) || old.arena || bi_add_bi(&b, &big) || b.arena;
+  bi_arena_release(&arena, pos);
+  bi_init_in(&arena, &a, 0, 10);
+  test_rand_bi(&a, 300);
+  fail = fail || limbs_cmp(old.data, old.size, big.data, big.size, 1)
+         || limbs_cmp(b.data, b.size, big.data, big.size, 1);
+  if (fail)
+    bi_test_failed("bi_arena values outliving a mark\n");
+  else
+    bi_test_passed("bi_arena values outliving a mark\n");
+  ret = fail || ret;
+
+  bi_free(&old);
+  bi_free(&b);
+  bi_free(&big);
+  bi_arena_free(&arena);
+  return -ret;
+}
+
+////////////////////////////////////////////// Batches
+#define BATCH_ROW(batch, i) ((batch)->data + (i) * (batch)->count * (batch)->span)
+
+/**
+ * d += a for lanes [j0, count) of two row major batches (an <= dn rows,
+ * row strides of count limbs). Carries out of row dn - 1 land in row dn,
+ * which must be zero. Evaluates to whether any did
+ */
+#define BATCH_ADD(type, d, a, count, j0, an, dn, base) ({                     \
+  type* _d = (type*)(d);                                                      \
+  const type* _a = (const type*)(a);                                          \
+  const type _base = (type)(base);                                            \
+  int _top = 0;                                                               \
+  for(size_t _j = (j0); _j < (count); ++_j) {                                 \
+    type _c = 0;                                                              \
+    size_t _i = 0;                                                            \
+    for(; _i < (an); ++_i) {                                                  \
+      type _s = _d[_i * (count) + _j] + _a[_i * (count) + _j] + _c;           \
+      _c = _s >= _base;                                                       \
+      _d[_i * (count) + _j] = _c ? _s - _base : _s;                           \
+    }                                                                         \
+    for(; _c && _i < (dn); ++_i) {                                            \
+      type _s = _d[_i * (count) + _j] + _c;                                   \
+      _c = _s >= _base;                                                       \
+      _d[_i * (count) + _j] = _c ? _s - _base : _s;                           \
+    }                                                                         \
+    if(_c) {                                                                  \
+      _d[(dn) * (count) + _j] = 1;                                            \
+      _top = 1;                                                               \
+    }                                                                         \
+  }                                                                           \
+  _top;                                                                       \
+})
+
+static int batch_add_bin(
+  uint64_t* d, const uint64_t* a, size_t count, size_t j0, size_t an, size_t dn)
+{
+  int top = 0;
+  for(size_t j = j0; j < count; ++j) {
+    unsigned char c = 0;
+    size_t i = 0;
+    for(; i < an; ++i)
+      c = ADDC_U64(c, d[i * count + j], a[i * count + j], &d[i * count + j]);
+    for(; c && i < dn; ++i)
+      c = ADDC_U64(c, d[i * count + j], 0, &d[i * count + j]);
+    if(c) {
+      d[dn * count + j] = 1;
+      top = 1;
+    }
+  }
+  return top;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/**
+ * BATCH_ADD a vector of lanes at a time, every lane carrying on its own.
+ * Returns how many lanes were done (and ORs the top row carry into *top)
+ */
+#define BATCH_ADD_AVX2(bits, set1) \
+TARGET_AVX2 static size_t batch_add_avx2_##bits(                                    \
+  uint8_t* d, const uint8_t* a, size_t count, size_t an, size_t dn,           \
+  uint64_t base, int* top)                                                    \
+{                                                                             \
+  const size_t lanes = 256 / bits;                                            \
+  const size_t stride = count * (bits / 8);                                   \
+  const __m256i sign = set1((int##bits##_t)((uint64_t)1 << (bits - 1)));      \
+  const __m256i vb = set1((int##bits##_t)base);                               \
+  const __m256i vbs = _mm256_xor_si256(vb, sign);                             \
+  size_t j = 0;                                                               \
+  for(; j + lanes <= count; j += lanes) {                                     \
+    uint8_t* dp = d + j * (bits / 8);                                         \
+    const uint8_t* ap = a + j * (bits / 8);                                   \
+    /* Carries as 0 / -1 lanes, so adding one is a subtract */                \
+    __m256i c = _mm256_setzero_si256();                                       \
+    size_t i = 0;                                                             \
+    for(; i < an; ++i) {                                                      \
+      __m256i s = _mm256_sub_epi##bits(_mm256_add_epi##bits(                  \
+          _mm256_loadu_si256((const __m256i*)(dp + i * stride)),              \
+          _mm256_loadu_si256((const __m256i*)(ap + i * stride))), c);         \
+      c = _mm256_xor_si256(_mm256_cmpgt_epi##bits(                            \
+          vbs, _mm256_xor_si256(s, sign)), _mm256_set1_epi8(-1));             \
+      s = _mm256_sub_epi##bits(s, _mm256_and_si256(c, vb));                   \
+      _mm256_storeu_si256((__m256i*)(dp + i * stride), s);                    \
+    }                                                                         \
+    for(; !_mm256_testz_si256(c, c) && i < dn; ++i) {                         \
+      __m256i s = _mm256_sub_epi##bits(                                       \
+          _mm256_loadu_si256((const __m256i*)(dp + i * stride)), c);          \
+      c = _mm256_cmpeq_epi##bits(s, vb);                                      \
+      s = _mm256_andnot_si256(c, s);                                          \
+      _mm256_storeu_si256((__m256i*)(dp + i * stride), s);                    \
+    }                                                                         \
+    if(!_mm256_testz_si256(c, c)) {                                           \
+      _mm256_storeu_si256((__m256i*)(dp + dn * stride),                       \
+                          _mm256_sub_epi##bits(_mm256_setzero_si256(), c));   \
+      *top = 1;                                                               \
+    }                                                                         \
+  }                                                                           \
+  return j;                                                                   \
+}
+
+BATCH_ADD_AVX2(8, _mm256_set1_epi8)
+BATCH_ADD_AVX2(16, _mm256_set1_epi16)
+BATCH_ADD_AVX2(32, _mm256_set1_epi32)
+BATCH_ADD_AVX2(64, _mm256_set1_epi64x)
+
+#define BATCH_ADD_AVX512(bits) \
+TARGET_AVX512 static size_t batch_add_avx512_##bits(                                \
+  uint8_t* d, const uint8_t* a, size_t count, size_t an, size_t dn,           \
+  uint64_t base, int* top)                                                    \
+{                                                                             \
+  const size_t lanes = 512 / bits;                                            \
+  const size_t stride = count * (bits / 8);                                   \
+  const __m512i vb = _mm512_set1_epi##bits((int##bits##_t)base);             \
+  const __m512i one = _mm512_set1_epi##bits(1);                               \
+  size_t j = 0;                                                               \
+  for(; j + lanes <= count; j += lanes) {                                     \
+    uint8_t* dp = d + j * (bits / 8);                                         \
+    const uint8_t* ap = a + j * (bits / 8);                                   \
+    uint64_t c = 0;                                                           \
+    size_t i = 0;                                                             \
+    for(; i < an; ++i) {                                                      \
+      __m512i s = _mm512_add_epi##bits(                                       \
+          _mm512_loadu_si512(dp + i * stride),                                \
+          _mm512_loadu_si512(ap + i * stride));                               \
+      s = _mm512_mask_add_epi##bits(s, c, s, one);                            \
+      c = _mm512_cmpge_epu##bits##_mask(s, vb);                               \
+      _mm512_storeu_si512(dp + i * stride, _mm512_mask_sub_epi##bits(s, c, s, vb)); \
+    }                                                                         \
+    for(; c && i < dn; ++i) {                                                 \
+      __m512i s = _mm512_loadu_si512(dp + i * stride);                        \
+      s = _mm512_mask_add_epi##bits(s, c, s, one);                            \
+      c = _mm512_cmpeq_epi##bits##_mask(s, vb);                               \
+      _mm512_storeu_si512(dp + i * stride, _mm512_mask_sub_epi##bits(s, c, s, vb)); \
+    }                                                                         \
+    if(c) {                                                                   \
+      _mm512_storeu_si512(dp + dn * stride, _mm512_maskz_mov_epi##bits(c, one)); \
+      *top = 1;                                                               \
+    }                                                                         \
+  }                                                                           \
+  return j;                                                                   \
+}
+
+BATCH_ADD_AVX512(8)
+BATCH_ADD_AVX512(16)
+BATCH_ADD_AVX512(32)
+BATCH_ADD_AVX512(64)
+
+/**
+ * Base 2^64 lanes: the carry out is the unsigned wrap of either add
+ */
+TARGET_AVX512 static size_t batch_add_avx512_bin(
+  uint8_t* d, const uint8_t* a, size_t count, size_t an, size_t dn, int* top)
+{
+  const size_t stride = count * 8;
+  const __m512i one = _mm512_set1_epi64(1);
+  const __m512i zero = _mm512_setzero_si512();
+  size_t j = 0;
+  for(; j + 8 <= count; j += 8) {
+    uint8_t* dp = d + j * 8;
+    const uint8_t* ap = a + j * 8;
+    __mmask8 c = 0;
+    size_t i = 0;
+    for(; i < an; ++i) {
+      __m512i x = _mm512_loadu_si512(ap + i * stride);
+      __m512i s = _mm512_add_epi64(_mm512_loadu_si512(dp + i * stride), x);
+      __mmask8 w = _mm512_cmplt_epu64_mask(s, x);
+      s = _mm512_mask_add_epi64(s, c, s, one);
+      c = w | (c & _mm512_cmpeq_epi64_mask(s, zero));
+      _mm512_storeu_si512(dp + i * stride, s);
+    }
+    for(; c && i < dn; ++i) {
+      __m512i s = _mm512_loadu_si512(dp + i * stride);
+      s = _mm512_mask_add_epi64(s, c, s, one);
+      c &= _mm512_cmpeq_epi64_mask(s, zero);
+      _mm512_storeu_si512(dp + i * stride, s);
+    }
+    if(c) {
+      _mm512_storeu_si512(dp + dn * stride, _mm512_maskz_mov_epi64(c, one));
+      *top = 1;
+    }
+  }
+  return j;
+}
+#endif
+
+/**
+ * BATCH_ADD over every lane, vector lanes first
+ */
+static int batch_add(
+  uint8_t* d, const uint8_t* a, size_t count, size_t an, size_t dn,
+  size_t span, uint64_t base)
+{
+  int top = 0;
+  size_t j = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+  switch(simd_add_level_get()) {
+    case 2:
+      switch(span) {
+        case UI8: j = batch_add_avx512_8(d, a, count, an, dn, base, &top); break;
+        case UI16: j = batch_add_avx512_16(d, a, count, an, dn, base, &top); break;
+        case UI32: j = batch_add_avx512_32(d, a, count, an, dn, base, &top); break;
+        case UI64:
+          j = base == BI_BASE_2_64
+              ? batch_add_avx512_bin(d, a, count, an, dn, &top)
+              : batch_add_avx512_64(d, a, count, an, dn, base, &top);
+          break;
+      }
+      break;
+    case 1:
+      switch(span) {
+        case UI8: j = batch_add_avx2_8(d, a, count, an, dn, base, &top); break;
+        case UI16: j = batch_add_avx2_16(d, a, count, an, dn, base, &top); break;
+        case UI32: j = batch_add_avx2_32(d, a, count, an, dn, base, &top); break;
+        case UI64:
+          if(base != BI_BASE_2_64)
+            j = batch_add_avx2_64(d, a, count, an, dn, base, &top);
+          break;
+      }
+      break;
+  }
+#endif
+
+  switch(span) {
+    case UI8:
+      return BATCH_ADD(uint8_t, d, a, count, j, an, dn, base) || top;
+    case UI16:
+      return BATCH_ADD(uint16_t, d, a, count, j, an, dn, base) || top;
+    case UI32:
+      return BATCH_ADD(uint32_t, d, a, count, j, an, dn, base) || top;
+    case UI64:
+      if(base == BI_BASE_2_64)
+        return batch_add_bin((uint64_t*)d, (const uint64_t*)a, count, j, an, dn) || top;
+      return BATCH_ADD(uint64_t, d, a, count, j, an, dn, base) || top;
+    default:
+      assert(0);
+      return 0;
+  }
+}
+
+/**
+ * Makes room for [rows] rows, the new ones zeroed
+ */
+static int batch_reserve(struct bi_batch* batch, size_t rows)
+{
+  if (rows <= batch->rows)
+    return 0;
+  size_t new_rows = rows > 2 * batch->rows ? rows : 2 * batch->rows;
+  size_t row_bytes = batch->count * batch->span;
+  uint8_t* data = realloc(batch->data, new_rows * row_bytes);
+  if (!data) {
+    bi_error("Couldn't reallocate data in a batch\n");
+    return -1;
+  }
+  memset(data + batch->rows * row_bytes, 0, (new_rows - batch->rows) * row_bytes);
+  batch->data = data;
+  batch->rows = new_rows;
+  return 0;
+}
+
+int bi_batch_init(
+    struct bi_batch* batch,
+    size_t count,
+    uint64_t base)
+{
+  if (base != BI_BASE_2_64 && (base < 2 || base > MAX_BASE)) {
+    bi_error("Invalid base: %" PRIu64 ". Required: 2 <= base <= %" PRIu64 "\n", base, MAX_BASE);
+    return -1;
+  }
+  struct bi_batch ret = {
+    .data = NULL,
+    .count = count,
+    .limbs = 0,
+    .rows = 0,
+    .base = base,
+    .span = base == BI_BASE_2_64 ? UI64 : span_from_base(base),
+  };
+  memcpy(batch, &ret, sizeof(struct bi_batch));
+  return batch_reserve(batch, 2);
+}
+
+void bi_batch_free(struct bi_batch* batch)
+{
+  free(batch->data);
+  batch->data = NULL;
+}
+
+int bi_batch_get(
+    const struct bi_batch* batch,
+    size_t j,
+    struct big_uint* dest)
+{
+  if (dest->base != batch->base || j >= batch->count) {
+    bi_error("bi_batch_get needs a number of the batch's base and j < count\n");
+    return -1;
+  }
+  if (ensure_capacity_big_enough(dest, batch->limbs))
+    return -1;
+  for (size_t i = 0; i < batch->limbs; ++i)
+    limb_set(dest->data, i, dest->span, limb_get(BATCH_ROW(batch, i), j, batch->span));
+  dest->size = limbs_strip(dest->data, batch->limbs, dest->span);
+  return 0;
+}
+
+int bi_batch_set(
+    struct bi_batch* batch,
+    size_t j,
+    const struct big_uint* src)
+{
+  if (src->base != batch->base || j >= batch->count) {
+    bi_error("bi_batch_set needs a number of the batch's base and j < count\n");
+    return -1;
+  }
+  // Keep a zero row above the top for bi_batch_add's carries
+  if (batch_reserve(batch, src->size + 1))
+    return -1;
+  if (src->size > batch->limbs)
+    batch->limbs = src->size;
+  for (size_t i = 0; i < batch->limbs; ++i)
+    limb_set(BATCH_ROW(batch, i), j, batch->span, i < src->size ? limb_get(src->data, i, src->span) : 0);
+  return 0;
+}
+
+int bi_batch_add(
+    struct bi_batch* dest,
+    const struct bi_batch* right)
+{
+  if (dest->base != right->base || dest->count != right->count) {
+    bi_error("Can only add two batches with the same base and count\n");
+    return -1;
+  }
+  size_t dn = dest->limbs > right->limbs ? dest->limbs : right->limbs;
+  STATS_OP(BI_OP_BATCH_ADD, dest->count * dn, dest->span);
+  if (batch_reserve(dest, dn + 1))
+    return -1;
+  if (batch_add(dest->data, right->data, dest->count, right->limbs, dn, dest->span, dest->base))
+    dn++;
+  dest->limbs = dn;
+  return 0;
+}
+
+#define BATCH_SC_LANES 64
+
+/**
+ * Carries c[0..nl) up lanes [j0, j0 + nl) of the rows at d (strides of
+ * count limbs), splitting each with the base's reciprocal [r]. Evaluates
+ * to the rows reached
+ */
+#define BATCH_ADD_SC(type, d, c, count, j0, nl, base, r) ({                   \
+  type* _d = (type*)(d) + (j0);                                               \
+  const type _base = (type)(base);                                            \
+  uint64_t _any = 0;                                                          \
+  for(size_t _k = 0; _k < (nl); ++_k)                                         \
+    _any |= (c)[_k];                                                          \
+  size_t _i = 0;                                                              \
+  for(; _any; ++_i, _d += (count)) {                                          \
+    _any = 0;                                                                 \
+    for(size_t _k = 0; _k < (nl); ++_k) {                                     \
+      uint64_t _s;                                                            \
+      (c)[_k] = recip_divmod(0, (c)[_k], (r), &_s);                           \
+      _s += _d[_k];                                                           \
+      uint64_t _over = -(uint64_t)(_s >= _base);                              \
+      (c)[_k] -= _over;                                                       \
+      _d[_k] = (type)(_s - (_base & _over));                                  \
+      _any |= (c)[_k];                                                        \
+    }                                                                         \
+  }                                                                           \
+  _i;                                                                         \
+})
+
+int bi_batch_add_sc(
+    struct bi_batch* dest,
+    const uint64_t* right)
+{
+  // The scalars are carried up their columns in place, the way bi_add_sc
+  // does, so the rows they can reach are those of the largest one plus
+  // one. Lanes go BATCH_SC_LANES at a time to walk each row contiguously
+  struct recip r = recip_init(dest->base);
+  uint64_t most = 0;
+  for (size_t j = 0; j < dest->count; ++j)
+    most |= right[j];
+  size_t rows = 0;
+  for (uint64_t m = most, rem; m; m = recip_divmod(0, m, &r, &rem))
+    rows++;
+  size_t dn = dest->limbs > rows ? dest->limbs : rows;
+  STATS_OP(BI_OP_BATCH_ADD, dest->count * dn, dest->span);
+  if (batch_reserve(dest, dn + 1))
+    return -1;
+  if (dest->base == BI_BASE_2_64) {
+    // The scalars already are a row of digits
+    if (rows && batch_add(dest->data, (const uint8_t*)right, dest->count, 1, dn, UI64, BI_BASE_2_64))
+      dn++;
+    dest->limbs = dn;
+    return 0;
+  }
+
+  size_t top = dest->limbs;
+  uint64_t carry[BATCH_SC_LANES];
+  for (size_t j0 = 0; j0 < dest->count; j0 += BATCH_SC_LANES) {
+    size_t nl = dest->count - j0 < BATCH_SC_LANES ? dest->count - j0 : BATCH_SC_LANES;
+    memcpy(carry, right + j0, nl * sizeof(uint64_t));
+    size_t i = 0;
+    switch (dest->span) {
+      case UI8:
+        i = BATCH_ADD_SC(uint8_t, dest->data, carry, dest->count, j0, nl, dest->base, &r);
+        break;
+      case UI16:
+        i = BATCH_ADD_SC(uint16_t, dest->data, carry, dest->count, j0, nl, dest->base, &r);
+        break;
+      case UI32:
+        i = BATCH_ADD_SC(uint32_t, dest->data, carry, dest->count, j0, nl, dest->base, &r);
+        break;
+      case UI64:
+        i = BATCH_ADD_SC(uint64_t, dest->data, carry, dest->count, j0, nl, dest->base, &r);
+        break;
+    }
+    if (i > top)
+      top = i;
+  }
+  dest->limbs = top;
+  return 0;
+}
+
+static int test_bi_batch_once(size_t count, uint64_t base, int level)
+{
+  int saved = simd_add_level_get();
+  simd_add_level = level;
+
+  struct bi_batch batch, other;
+  struct big_uint* ref = calloc(count, sizeof(struct big_uint));
+  uint64_t* sc = malloc(count * sizeof(uint64_t));
+  struct big_uint x, y;
+  int ret = !ref || !sc || bi_batch_init(&batch, count, base) || bi_batch_init(&other, count, base);
+  ret = ret || bi_init_base(&x, 0, base) || bi_init_base(&y, 0, base);
+
+  // Numbers of every length, some all base - 1 so carries run off the top
+  for (size_t j = 0; !ret && j < count; ++j) {
+    ret = bi_init_base(&ref[j], 0, base) || test_rand_bi(&x, j % 7);
+    if (!ret && j % 5 == 0)
+      for (size_t i = 0; i < x.size; ++i)
+        limb_set(x.data, i, x.span, base - 1);
+    ret = ret || bi_add_bi(&ref[j], &x) || bi_batch_set(&batch, j, &x)
+          || test_rand_bi(&x, j % 3) || bi_batch_set(&other, j, &x);
+  }
+
+  for (int round = 0; !ret && round < 6; ++round) {
+    for (size_t j = 0; j < count; ++j)
+      sc[j] = round % 2 ? test_rand() >> (j % 64) : (j % 3 ? 1 : UINT64_MAX);
+    ret = bi_batch_add(&batch, &other) || bi_batch_add_sc(&batch, sc);
+    for (size_t j = 0; !ret && j < count; ++j)
+      ret = bi_batch_get(&other, j, &y) || bi_add_bi(&ref[j], &y) || bi_add_sc(&ref[j], sc[j]);
+    if (round == 2)
+      ret = ret || bi_batch_add(&batch, &batch);
+    for (size_t j = 0; !ret && round == 2 && j < count; ++j)
+      ret = bi_add_bi(&ref[j], &ref[j]);
+    for (size_t j = 0; !ret && round == 2 && j < count; ++j)
+      ret = bi_batch_get(&batch, j, &y) || bi_batch_set(&other, j, &y);
+  }
+
+  for (size_t j = 0; !ret && j < count; ++j)
+    ret = bi_batch_get(&batch, j, &y) || limbs_cmp(y.data, y.size, ref[j].data, ref[j].size, y.span);
+
+  simd_add_level = saved;
+  if (ret)
+    bi_test_failed("bi_batch_add (count = %zu, base = %" PRIu64 ", simd level = %d)\n", count, base, level);
+  else
+    bi_test_passed("bi_batch_add (count = %zu, base = %" PRIu64 ", simd level = %d)\n", count, base, level);
+  for (size_t j = 0; ref && j < count; ++j)
+    bi_free(&ref[j]);
+  free(ref);
+  free(sc);
+  bi_free(&x);
+  bi_free(&y);
+  bi_batch_free(&batch);
+  bi_batch_free(&other);
+  return ret;
+}
+
+int test_bi_batch()
+{
+  int ret = 0;
+  uint64_t bases[] = { 2, 10, 255, 1000, 65535, 1000000000, MAX_BASE, BI_BASE_2_64 };
+  size_t counts[] = { 1, 13, 200 };
+  for (int level = 0; level <= simd_add_level_get(); ++level)
+    for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i)
+      for (size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); ++k)
+        ret = test_bi_batch_once(counts[k], bases[i], level) || ret;
+  return -ret;
+}
+
+////////////////////////////////////////////// Thread Pool
+/**
+ * Fork / join pool. Every worker owns a deque: it pushes and pops its own
+ * end while idle workers steal from the other. Threads outside the pool
+ * push to one extra shared deque. Whoever waits on a group runs tasks in
+ * the meantime, so nested forks can't deadlock
+ */
+struct pool_task {
+  void (*fn)(void*);
+  void* arg;
+  atomic_size_t* pending;   // Group counter, dropped once fn returns
+};
+
+struct pool_deque {
+  pthread_mutex_t lock;
+  struct pool_task* tasks;  // Ring, oldest at [head]
+  size_t head;
+  size_t n;
+  size_t cap;
+};
+
+static struct {
+  pthread_mutex_t lock;         // Serializes (re)sizing
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle;
+  pthread_t* threads;
+  struct pool_deque* deques;    // One per worker, then the shared one
+  size_t nthreads;
+  int sized;
+  atomic_size_t queued;
+  atomic_int stop;
+} pool = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .idle_lock = PTHREAD_MUTEX_INITIALIZER,
+  .idle = PTHREAD_COND_INITIALIZER,
+};
+
+static _Thread_local size_t pool_self = SIZE_MAX;
+
+static int pool_deque_push(struct pool_deque* q, struct pool_task t)
+{
+  pthread_mutex_lock(&q->lock);
+  if (q->n == q->cap) {
+    size_t cap = q->cap ? 2 * q->cap : 64;
+    struct pool_task* tasks = malloc(cap * sizeof(struct pool_task));
+    if (!tasks) {
+      pthread_mutex_unlock(&q->lock);
+      return -1;
+    }
+    for (size_t i = 0; i < q->n; ++i)
+      tasks[i] = q->tasks[(q->head + i) % q->cap];
+    free(q->tasks);
+    q->tasks = tasks;
+    q->head = 0;
+    q->cap = cap;
+  }
+  q->tasks[(q->head + q->n++) % q->cap] = t;
+  pthread_mutex_unlock(&q->lock);
+  return 0;
+}
+
+static int pool_deque_pop(struct pool_deque* q, struct pool_task* t, int oldest)
+{
+  pthread_mutex_lock(&q->lock);
+  int ret = q->n > 0;
+  if (ret && oldest) {
+    *t = q->tasks[q->head];
+    q->head = (q->head + 1) % q->cap;
+    q->n--;
+  } else if (ret) {
+    *t = q->tasks[(q->head + --q->n) % q->cap];
+  }
+  pthread_mutex_unlock(&q->lock);
+  return ret;
+}
+
+/**
+ * Runs one task: the newest of our own, else the oldest one we can steal.
+ * Returns 0 if there was nothing to do
+ */
+static int pool_try_run(void)
+{
+  size_t n = pool.nthreads + 1;
+  size_t self = pool_self < pool.nthreads ? pool_self : pool.nthreads;
+  struct pool_task t;
+  int got = pool_deque_pop(&pool.deques[self], &t, self == pool.nthreads);
+  for (size_t k = 1; !got && k < n; ++k)
+    got = pool_deque_pop(&pool.deques[(self + k) % n], &t, 1);
+  if (!got)
+    return 0;
+  atomic_fetch_sub(&pool.queued, 1);
+  t.fn(t.arg);
+  atomic_fetch_sub(t.pending, 1);
+  return 1;
+}
+
+static void* pool_worker(void* arg)
+{
+  pool_self = (size_t)arg;
+  while (!atomic_load(&pool.stop)) {
+    if (pool_try_run())
+      continue;
+    pthread_mutex_lock(&pool.idle_lock);
+    while (!atomic_load(&pool.queued) && !atomic_load(&pool.stop))
+      pthread_cond_wait(&pool.idle, &pool.idle_lock);
+    pthread_mutex_unlock(&pool.idle_lock);
+  }
+  return NULL;
+}
+
+/**
+ * Joins the first [started] workers and frees the deques. Needs pool.lock
+ */
+static void pool_stop(size_t started)
+{
+  pthread_mutex_lock(&pool.idle_lock);
+  atomic_store(&pool.stop, 1);
+  pthread_cond_broadcast(&pool.idle);
+  pthread_mutex_unlock(&pool.idle_lock);
+  for (size_t i = 0; i < started; ++i)
+    pthread_join(pool.threads[i], NULL);
+  for (size_t i = 0; pool.deques && i <= pool.nthreads; ++i) {
+    pthread_mutex_destroy(&pool.deques[i].lock);
+    free(pool.deques[i].tasks);
+  }
+  free(pool.threads);
+  free(pool.deques);
+  pool.threads = NULL;
+  pool.deques = NULL;
+  pool.nthreads = 0;
+  atomic_store(&pool.stop, 0);
+}
+
+/**
+ * Starts [nthreads] workers. Needs pool.lock
+ */
+static int pool_start(size_t nthreads)
+{
+  pool.sized = 1;
+  if (!nthreads)
+    return 0;
+  pool.threads = malloc(nthreads * sizeof(pthread_t));
+  pool.deques = calloc(nthreads + 1, sizeof(struct pool_deque));
+  if (!pool.threads || !pool.deques) {
+    bi_error("Couldn't allocate the thread pool\n");
+    free(pool.threads);
+    free(pool.deques);
+    pool.threads = NULL;
+    pool.deques = NULL;
+    return -1;
+  }
+  for (size_t i = 0; i <= nthreads; ++i)
+    pthread_mutex_init(&pool.deques[i].lock, NULL);
+
+  // Everything the workers read is set before the first one starts
+  pool.nthreads = nthreads;
+  for (size_t i = 0; i < nthreads; ++i) {
+    if (pthread_create(&pool.threads[i], NULL, pool_worker, (void*)i)) {
+      bi_error("Couldn't start pool thread %zu\n", i);
+      pool_stop(i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static size_t pool_get(void)
+{
+  pthread_mutex_lock(&pool.lock);
+  if (!pool.sized) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    pool_start(cores > 1 ? (size_t)cores - 1 : 0);
+  }
+  size_t ret = pool.nthreads;
+  pthread_mutex_unlock(&pool.lock);
+  return ret;
+}
+
+/**
+ * Queues fn(arg) as part of the group counted by [pending] (or just runs
+ * it when the pool is off)
+ */
+static void pool_fork(void (*fn)(void*), void* arg, atomic_size_t* pending)
+{
+  struct pool_task t = { fn, arg, pending };
+  size_t self = pool_self < pool.nthreads ? pool_self : pool.nthreads;
+  atomic_fetch_add(pending, 1);
+  if (!pool.nthreads || pool_deque_push(&pool.deques[self], t)) {
+    fn(arg);
+    atomic_fetch_sub(pending, 1);
+    return;
+  }
+  atomic_fetch_add(&pool.queued, 1);
+  pthread_mutex_lock(&pool.idle_lock);
+  pthread_cond_signal(&pool.idle);
+  pthread_mutex_unlock(&pool.idle_lock);
+}
+
+/**
+ * Helps out until every task of the group is done
+ */
+static void pool_join(atomic_size_t* pending)
+{
+  while (atomic_load(pending))
+    if (!pool.nthreads || !pool_try_run())
+      sched_yield();
+}
+
+int bi_pool_set_threads(size_t nthreads)
+{
+  pthread_mutex_lock(&pool.lock);
+  pool_stop(pool.nthreads);
+  int ret = pool_start(nthreads);
+  pthread_mutex_unlock(&pool.lock);
+  return ret;
+}
+
+size_t bi_pool_threads(void)
+{
+  return pool_get();
+}
+
+////////////////////////////////////////////// Parallel Reductions
+/**
+ * Forks beyond the pool size, so uneven subtrees still keep everyone busy
+ */
+#define PAR_OVERSPLIT 4
+
+struct par_sum {
+  const struct big_uint* values;
+  size_t lo;
+  size_t hi;
+  struct big_uint acc;
+  int ret;
+};
+
+static void par_sum_run(void* arg)
+{
+  struct par_sum* p = arg;
+  for (size_t i = p->lo; !p->ret && i < p->hi; ++i)
+    p->ret = bi_add_bi(&p->acc, &p->values[i]);
+}
+
+struct par_prod {
+  const struct big_uint* values;
+  size_t lo;
+  size_t hi;
+  size_t forks;             // Levels that still fork their left half
+  struct big_uint out;
+  int ret;
+};
+
+static void par_prod_run(void* arg)
+{
+  struct par_prod* p = arg;
+  if (p->hi - p->lo == 1) {
+    p->ret = bi_set_limbs(&p->out, p->values[p->lo].data, p->values[p->lo].size);
+    return;
+  }
+
+  size_t mid = p->lo + (p->hi - p->lo) / 2;
+  size_t forks = p->forks ? p->forks - 1 : 0;
+  struct par_prod left = { .values = p->values, .lo = p->lo, .hi = mid, .forks = forks };
+  struct par_prod right = { .values = p->values, .lo = mid, .hi = p->hi, .forks = forks };
+  if (bi_init_base(&left.out, 0, p->out.base) || bi_init_base(&right.out, 0, p->out.base)) {
+    p->ret = -1;
+    return;
+  }
+
+  atomic_size_t pending = 0;
+  if (p->forks)
+    pool_fork(par_prod_run, &left, &pending);
+  else
+    par_prod_run(&left);
+  par_prod_run(&right);
+  pool_join(&pending);
+
+  p->ret = left.ret || right.ret || bi_mul_bi(&p->out, &left.out, &right.out);
+  bi_free(&left.out);
+  bi_free(&right.out);
+}
+
+/**
+ * Pieces to split into: [nthreads] or everyone in the pool plus the caller
+ */
+static size_t par_ways(size_t nthreads)
+{
+  size_t pooled = pool_get();
+  if (!pooled)
+    return 1;
+  return nthreads ? nthreads : pooled + 1;
+}
+
+static int par_check_bases(const struct big_uint* dest, const struct big_uint* values, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    if (values[i].base != dest->base) {
+      bi_error("Parallel reductions need every value in dest's base\n");
+      return -1;
+    }
+  return 0;
+}
+
+int bi_sum_parallel(
+    struct big_uint* dest,
+    const struct big_uint* values,
+    size_t n,
+    size_t nthreads)
+{
+  if (par_check_bases(dest, values, n))
+    return -1;
+  size_t ways = par_ways(nthreads);
+  if (ways > n)
+    ways = n ? n : 1;
+
+  struct par_sum* parts = calloc(ways, sizeof(struct par_sum));
+  if (!parts) {
+    bi_error("Couldn't allocate data in bi_sum_parallel\n");
+    return -1;
+  }
+  size_t made = 0;
+  int ret = 0;
+  atomic_size_t pending = 0;
+  for (; made < ways; ++made) {
+    struct par_sum* p = &parts[made];
+    p->values = values;
+    p->lo = n * made / ways;
+    p->hi = n * (made + 1) / ways;
+    if ((ret = bi_init_base(&p->acc, 0, dest->base)))
+      break;
+    if (made)
+      pool_fork(par_sum_run, p, &pending);
+  }
+  if (made)
+    par_sum_run(&parts[0]);
+  pool_join(&pending);
+
+  // dest may be one of the values, so it's only written once they're summed
+  for (size_t i = 0; i < made; ++i)
+    ret = ret || parts[i].ret;
+  ret = ret || bi_set_limbs(dest, parts[0].acc.data, parts[0].acc.size);
+  for (size_t i = 1; !ret && i < made; ++i)
+    ret = bi_add_bi(dest, &parts[i].acc);
+  for (size_t i = 0; i < made; ++i)
+    bi_free(&parts[i].acc);
+  free(parts);
+  return ret;
+}
+
+int bi_prod_parallel(
+    struct big_uint* dest,
+    const struct big_uint* values,
+    size_t n,
+    size_t nthreads)
+{
+  if (par_check_bases(dest, values, n))
+    return -1;
+  if (!n) {
+    dest->size = 0;
+    return bi_add_sc(dest, 1);
+  }
+
+  size_t ways = par_ways(nthreads);
+  struct par_prod root = { .values = values, .lo = 0, .hi = n };
+  while (ways > 1 && ((size_t)1 << root.forks) < ways * PAR_OVERSPLIT)
+    root.forks++;
+  if (bi_init_base(&root.out, 0, dest->base))
+    return -1;
+
+  par_prod_run(&root);
+  int ret = root.ret || bi_set_limbs(dest, root.out.data, root.out.size);
+  bi_free(&root.out);
+  return ret;
+}
+
+static int test_bi_parallel_once(size_t n, size_t limbs, uint64_t base, size_t nthreads)
+{
+  struct big_uint* values = calloc(n, sizeof(struct big_uint));
+  struct big_uint sum, prod, ref;
+  int ret = !values || bi_init_base(&sum, 0, base) || bi_init_base(&prod, 0, base)
+            || bi_init_base(&ref, 0, base);
+  for (size_t i = 0; !ret && i < n; ++i)
+    ret = bi_init_base(&values[i], 0, base) || test_rand_bi(&values[i], 1 + i % limbs);
+
+  ret = ret || bi_sum_parallel(&sum, values, n, nthreads)
+        || bi_prod_parallel(&prod, values, n, nthreads);
+
+  // Plain left to right reductions to check against
+  for (size_t i = 0; !ret && i < n; ++i)
+    ret = bi_add_bi(&ref, &values[i]);
+  ret = ret || limbs_cmp(sum.data, sum.size, ref.data, ref.size, sum.span);
+  ref.size = 0;
+  ret = ret || bi_add_sc(&ref, 1);
+  for (size_t i = 0; !ret && i < n; ++i)
+    ret = bi_mul_bi(&ref, &ref, &values[i]);
+  ret = ret || limbs_cmp(prod.data, prod.size, ref.data, ref.size, prod.span);
+
+  if (ret)
+    bi_test_failed("bi_sum_parallel / bi_prod_parallel (n = %zu, limbs = %zu, base = %" PRIu64 ", pool = %zu, nthreads = %zu)\n", n, limbs, base, bi_pool_threads(), nthreads);
+  else
+    bi_test_passed("bi_sum_parallel / bi_prod_parallel (n = %zu, limbs = %zu, base = %" PRIu64 ", pool = %zu, nthreads = %zu)\n", n, limbs, base, bi_pool_threads(), nthreads);
+  for (size_t i = 0; values && i < n; ++i)
+    bi_free(&values[i]);
+  free(values);
+  bi_free(&sum);
+  bi_free(&prod);
+  bi_free(&ref);
+  return ret;
+}
+
+int test_bi_parallel()
+{
+  int ret = 0;
+  size_t pools[] = { 0, 3, 1 };
+  for (size_t k = 0; k < sizeof(pools) / sizeof(pools[0]); ++k) {
+    ret = bi_pool_set_threads(pools[k]) || ret;
+    ret = test_bi_parallel_once(0, 1, 10, 0) || ret;
+    ret = test_bi_parallel_once(1, 3, 10, 0) || ret;
+    ret = test_bi_parallel_once(1000, 4, 10, 0) || ret;
+    ret = test_bi_parallel_once(300, 40, 1000000000, 0) || ret;
+    ret = test_bi_parallel_once(257, 20, BI_BASE_2_64, 7) || ret;
+    ret = test_bi_parallel_once(64, 300, MAX_BASE, 2) || ret;
+  }
+
+  // Summing into one of the values
+  struct big_uint v[3];
+  for (int i = 0; i < 3; ++i)
+    bi_init(&v[i], 1000 + i, 10);
+  int fail = bi_sum_parallel(&v[1], v, 3, 0) || test_bi_to_u64(&v[1]) != 3003;
+  if (fail)
+    bi_test_failed("bi_sum_parallel into one of the values\n");
+  else
+    bi_test_passed("bi_sum_parallel into one of the values\n");
+  for (int i = 0; i < 3; ++i)
+    bi_free(&v[i]);
+
+  bi_pool_set_threads(0);
+  return -(ret || fail);
+}
+
+////////////////////////////////////////////// Parallel Add
+size_t bi_add_parallel_threshold = 1 << 20;
+
+/**
+ * d[lo, hi) += 1. Returns the carry out. A limb of base - 1 becomes base,
+ * which is 0 for BI_BASE_2_64 (the add wraps)
+ */
+static uint64_t limbs_inc(uint8_t* d, size_t lo, size_t hi, size_t span, uint64_t base)
+{
+  uint64_t c = 1;
+  for (size_t i = lo; c && i < hi; ++i) {
+    uint64_t v = limb_get(d, i, span) + 1;
+    c = v == base;
+    limb_set(d, i, span, c ? 0 : v);
+  }
+  return c;
+}
+
+/**
+ * One chunk of a parallel add. The chunk is added with no carry in; a
+ * carry in would make it carry out too if every limb came out base - 1
+ */
+struct par_add {
+  uint8_t* d;
+  const uint8_t* a;
+  const uint8_t* b;
+  size_t lo;
+  size_t hi;
+  size_t span;
+  uint64_t base;
+  uint64_t carry;
+  int all_max;
+};
+
+static void par_add_run(void* arg)
+{
+  struct par_add* p = arg;
+  size_t off = p->lo * p->span;
+  p->carry = limbs_add(p->d + off, p->a + off, p->hi - p->lo, p->b + off, p->hi - p->lo, p->span, p->base);
+  p->all_max = 1;
+  for (size_t i = p->lo; p->all_max && i < p->hi; ++i)
+    p->all_max = limb_get(p->d, i, p->span) == p->base - 1;
+}
+
+static void par_add_inc(void* arg)
+{
+  struct par_add* p = arg;
+  limbs_inc(p->d, p->lo, p->hi, p->span, p->base);
+}
+
+static uint64_t limbs_add_parallel(
+  uint8_t* d,
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base)
+{
+  assert(an >= bn);
+  size_t ways = pool_get() + 1;
+  struct par_add* parts = ways > 1 && bn >= ways ? calloc(ways, sizeof(struct par_add)) : NULL;
+  if (!parts)
+    return limbs_add(d, a, an, b, bn, span, base);
+
+  atomic_size_t pending = 0;
+  for (size_t k = ways; k-- > 0;) {
+    struct par_add p = { d, a, b, bn * k / ways, bn * (k + 1) / ways, span, base, 0, 0 };
+    parts[k] = p;
+    if (k)
+      pool_fork(par_add_run, &parts[k], &pending);
+  }
+  par_add_run(&parts[0]);
+  pool_join(&pending);
+
+  // Prefix pass over the chunk carries, then bump the chunks that get one
+  uint64_t c = 0;
+  for (size_t k = 0; k < ways; ++k) {
+    uint64_t in = c;
+    c = parts[k].carry | (parts[k].all_max & c);
+    if (in)
+      pool_fork(par_add_inc, &parts[k], &pending);
+  }
+  pool_join(&pending);
+  free(parts);
+
+  // Whatever's left of a only sees the final carry
+  if (d != a)
+    memcpy(d + bn * span, a + bn * span, (an - bn) * span);
+  return c ? limbs_inc(d, bn, an, span, base) : 0;
+}
+
+static int test_bi_add_bi_parallel_once(size_t an, size_t bn, uint64_t base, int runs)
+{
+  struct big_uint a, b, ref;
+  int ret = bi_init_base(&a, 0, base) || bi_init_base(&b, 0, base) || bi_init_base(&ref, 0, base);
+  ret = ret || test_rand_bi(&a, an) || test_rand_bi(&b, bn);
+
+  // Long runs of base - 1 so chunk carries ripple through whole chunks
+  for (size_t i = 0; !ret && runs && i + 1 < an; ++i)
+    if (i % 97 < 60)
+      limb_set(a.data, i, a.span, (base - 1) - (i < bn ? limb_get(b.data, i, b.span) : 0));
+  if (!ret && runs && bn)
+    limb_set(b.data, 0, b.span, limb_get(b.data, 0, b.span) + 1 == base ? 0 : limb_get(b.data, 0, b.span) + 1);
+
+  size_t saved = bi_add_parallel_threshold;
+  bi_add_parallel_threshold = (size_t)-1;
+  ret = ret || bi_set_limbs(&ref, a.data, a.size) || bi_add_bi(&ref, &b);
+  bi_add_parallel_threshold = 1;
+  ret = ret || bi_add_bi(&a, &b);
+  bi_add_parallel_threshold = saved;
+  ret = ret || limbs_cmp(a.data, a.size, ref.data, ref.size, a.span);
+
+  if (ret)
+    bi_test_failed("bi_add_bi parallel (an = %zu, bn = %zu, base = %" PRIu64 ", runs = %d, pool = %zu)\n", an, bn, base, runs, bi_pool_threads());
+  else
+    bi_test_passed("bi_add_bi parallel (an = %zu, bn = %zu, base = %" PRIu64 ", runs = %d, pool = %zu)\n", an, bn, base, runs, bi_pool_threads());
+  bi_free(&a);
+  bi_free(&b);
+  bi_free(&ref);
+  return ret;
+}
+
+int test_bi_add_bi_parallel()
+{
+  int ret = 0;
+  uint64_t bases[] = { 10, 1000000000, MAX_BASE, BI_BASE_2_64 };
+  size_t pools[] = { 3, 1 };
+  for (size_t k = 0; k < sizeof(pools) / sizeof(pools[0]); ++k) {
+    ret = bi_pool_set_threads(pools[k]) || ret;
+    for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i) {
+      ret = test_bi_add_bi_parallel_once(1, 1, bases[i], 0) || ret;
+      ret = test_bi_add_bi_parallel_once(1000, 1000, bases[i], 0) || ret;
+      ret = test_bi_add_bi_parallel_once(1000, 1000, bases[i], 1) || ret;
+      ret = test_bi_add_bi_parallel_once(3000, 777, bases[i], 1) || ret;
+      ret = test_bi_add_bi_parallel_once(500, 5000, bases[i], 1) || ret;
+    }
+  }
+  bi_pool_set_threads(0);
+  return -ret;
+}
+
+////////////////////////////////////////////// Accumulators
+/**
+ * d[i] += a[i] for i in [i0, n), a's limbs widened to words. No carries
+ */
+#define ACCUM_ADD(type, d, a, i0, n) ({                                       \
+  uint64_t* _d = (d);                                                         \
+  const type* _a = (const type*)(a);                                          \
+  const size_t _n = (n);                                                      \
+  for(size_t _i = (i0); _i < _n; ++_i)                                        \
+    _d[_i] += _a[_i];                                                         \
+})
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/**
+ * Loads 4 (AVX2) or 8 (AVX-512) limbs of [bits] zero extended to words
+ */
+TARGET_AVX2 static inline __m256i accum_load_avx2_8(const uint8_t* p)
+{
+  int32_t v;
+  memcpy(&v, p, sizeof(v));
+  return _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(v));
+}
+TARGET_AVX2 static inline __m256i accum_load_avx2_16(const uint8_t* p) { return _mm256_cvtepu16_epi64(_mm_loadl_epi64((const __m128i*)p)); }
+TARGET_AVX2 static inline __m256i accum_load_avx2_32(const uint8_t* p) { return _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)p)); }
+TARGET_AVX2 static inline __m256i accum_load_avx2_64(const uint8_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+
+TARGET_AVX512 static inline __m512i accum_load_avx512_8(const uint8_t* p) { return _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i*)p)); }
+TARGET_AVX512 static inline __m512i accum_load_avx512_16(const uint8_t* p) { return _mm512_cvtepu16_epi64(_mm_loadu_si128((const __m128i*)p)); }
+TARGET_AVX512 static inline __m512i accum_load_avx512_32(const uint8_t* p) { return _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*)p)); }
+TARGET_AVX512 static inline __m512i accum_load_avx512_64(const uint8_t* p) { return _mm512_loadu_si512(p); }
+
+/**
+ * ACCUM_ADD a vector at a time. Returns how many limbs were done
+ */
+#define ACCUM_ADD_AVX2(bits) \
+TARGET_AVX2 static size_t accum_add_avx2_##bits(uint64_t* d, const uint8_t* a, size_t n) \
+{                                                                             \
+  size_t i = 0;                                                               \
+  for(; i + 4 <= n; i += 4) {                                                 \
+    __m256i s = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(d + i)), \
+                                 accum_load_avx2_##bits(a + i * (bits / 8))); \
+    _mm256_storeu_si256((__m256i*)(d + i), s);                                \
+  }                                                                           \
+  return i;                                                                   \
+}
+
+ACCUM_ADD_AVX2(8)
+ACCUM_ADD_AVX2(16)
+ACCUM_ADD_AVX2(32)
+ACCUM_ADD_AVX2(64)
+
+#define ACCUM_ADD_AVX512(bits) \
+TARGET_AVX512 static size_t accum_add_avx512_##bits(uint64_t* d, const uint8_t* a, size_t n) \
+{                                                                             \
+  size_t i = 0;                                                               \
+  for(; i + 8 <= n; i += 8) {                                                 \
+    __m512i s = _mm512_add_epi64(_mm512_loadu_si512(d + i),                   \
+                                 accum_load_avx512_##bits(a + i * (bits / 8))); \
+    _mm512_storeu_si512(d + i, s);                                            \
+  }                                                                           \
+  return i;                                                                   \
+}
+
+ACCUM_ADD_AVX512(8)
+ACCUM_ADD_AVX512(16)
+ACCUM_ADD_AVX512(32)
+ACCUM_ADD_AVX512(64)
+#endif
+
+static void accum_add(uint64_t* d, const uint8_t* a, size_t n, size_t span)
+{
+  size_t i = 0;
+#if defined(__x86_64__) && defined(__GNUC__)
+  switch(simd_add_level_get()) {
+    case 2:
+      switch(span) {
+        case UI8: i = accum_add_avx512_8(d, a, n); break;
+        case UI16: i = accum_add_avx512_16(d, a, n); break;
+        case UI32: i = accum_add_avx512_32(d, a, n); break;
+        case UI64: i = accum_add_avx512_64(d, a, n); break;
+      }
+      break;
+    case 1:
+      switch(span) {
+        case UI8: i = accum_add_avx2_8(d, a, n); break;
+        case UI16: i = accum_add_avx2_16(d, a, n); break;
+        case UI32: i = accum_add_avx2_32(d, a, n); break;
+        case UI64: i = accum_add_avx2_64(d, a, n); break;
+      }
+      break;
+  }
+#endif
+
+  switch(span) {
+    case UI8:
+      ACCUM_ADD(uint8_t, d, a, i, n);
+      break;
+    case UI16:
+      ACCUM_ADD(uint16_t, d, a, i, n);
+      break;
+    case UI32:
+      ACCUM_ADD(uint32_t, d, a, i, n);
+      break;
+    case UI64:
+      ACCUM_ADD(uint64_t, d, a, i, n);
+      break;
+  }
+}
+
+static int accum_reserve(struct bi_accum* acc, size_t n)
+{
+  if (n <= acc->capacity)
+    return 0;
+  size_t cap = n > 2 * acc->capacity ? n : 2 * acc->capacity;
+  uint64_t* limbs = realloc(acc->limbs, cap * sizeof(uint64_t));
+  if (!limbs) {
+    bi_error("Couldn't reallocate data in an accumulator\n");
+    return -1;
+  }
+  memset(limbs + acc->capacity, 0, (cap - acc->capacity) * sizeof(uint64_t));
+  acc->limbs = limbs;
+  acc->capacity = cap;
+  return 0;
+}
+
+/**
+ * Carries every limb back under base
+ */
+static int accum_normalize(struct bi_accum* acc)
+{
+  if (acc->base == BI_BASE_2_64 || acc->bound < acc->base)
+    return 0;
+  uint64_t c = 0;
+  for (size_t i = 0; i < acc->size || c; ++i) {
+    if (i == acc->size) {
+      if (accum_reserve(acc, i + 1))
+        return -1;
+      acc->size++;
+    }
+    uint64_t lo;
+    uint64_t hi = ADDC_U64(0, acc->limbs[i], c, &lo);
+    if (!hi && lo < acc->base) {
+      acc->limbs[i] = lo;
+      c = 0;
+    } else {
+      c = dw_divmod(hi, lo, acc->base, &acc->limbs[i]);
+    }
+  }
+  acc->bound = acc->base - 1;
+  return 0;
+}
+
+int bi_accum_init(
+    struct bi_accum* acc,
+    uint64_t base)
+{
+  if (base != BI_BASE_2_64 && (base < 2 || base > MAX_BASE)) {
+    bi_error("Invalid base: %" PRIu64 ". Required: 2 <= base <= %" PRIu64 "\n", base, MAX_BASE);
+    return -1;
+  }
+  struct bi_accum ret = {
+    .limbs = NULL,
+    .size = 0,
+    .capacity = 0,
+    .base = base,
+    .bound = base - 1,
+  };
+  memcpy(acc, &ret, sizeof(struct bi_accum));
+  return accum_reserve(acc, 4);
+}
+
+void bi_accum_free(struct bi_accum* acc)
+{
+  free(acc->limbs);
+  acc->limbs = NULL;
+}
+
+int bi_accum_add_bi(
+    struct bi_accum* acc,
+    const struct big_uint* right)
+{
+  struct bi_view v;
+  bi_view_init(&v, right);
+  return bi_accum_add_view(acc, &v);
+}
+
+int bi_accum_add_view(
+    struct bi_accum* acc,
+    const struct bi_view* right)
+{
+  if (acc->base != right->base) {
+    bi_error("Can only add a big int to an accumulator of the same base\n");
+    return -1;
+  }
+  // The limbs land [shift] up, the zeros below don't change anything
+  size_t n = right->size;
+  size_t s = n ? right->shift : 0;
+  size_t an = acc->size > s + n ? acc->size : s + n;
+  STATS_OP(BI_OP_ACCUM_ADD, n, right->span);
+  if (accum_reserve(acc, an + 1))
+    return -1;
+
+  // Base 2^64 limbs have no headroom at all, so those just carry
+  if (acc->base == BI_BASE_2_64) {
+    acc->limbs[an] = limbs_add_bin(acc->limbs + s, acc->limbs + s, an - s, (const uint64_t*)right->data, n);
+    acc->size = an + (acc->limbs[an] != 0);
+    return 0;
+  }
+
+  if (acc->bound > UINT64_MAX - (acc->base - 1) && accum_normalize(acc))
+    return -1;
+  accum_add(acc->limbs + s, right->data, n, right->span);
+  if (s + n > acc->size)
+    acc->size = s + n;
+  acc->bound += acc->base - 1;
+  return 0;
+}
+
+int bi_accum_add_sc(
+    struct bi_accum* acc,
+    const uint64_t right)
+{
+  // As base digits every limb gets at most base - 1, same as add_bi
+  uint64_t digits[64];
+  size_t n = 0;
+  if (acc->base == BI_BASE_2_64)
+    digits[n++] = right;
+  else
+    for (uint64_t v = right; v; v /= acc->base)
+      digits[n++] = v % acc->base;
+
+  struct big_uint sc = { .data = (uint8_t*)digits, .size = n, .capacity = sizeof(digits),
+                         .base = acc->base, .span = UI64 };
+  return bi_accum_add_bi(acc, &sc);
+}
+
+int bi_accum_get(
+    struct bi_accum* acc,
+    struct big_uint* dest)
+{
+  if (acc->base != dest->base) {
+    bi_error("bi_accum_get needs dest in the accumulator's base\n");
+    return -1;
+  }
+  if (accum_normalize(acc) || ensure_capacity_big_enough(dest, acc->size))
+    return -1;
+  for (size_t i = 0; i < acc->size; ++i)
+    limb_set(dest->data, i, dest->span, acc->limbs[i]);
+  dest->size = limbs_strip(dest->data, acc->size, dest->span);
+  return 0;
+}
+
+static int test_bi_accum_once(uint64_t base, size_t adds, size_t limbs)
+{
+  struct bi_accum acc;
+  struct big_uint x, ref, out;
+  int ret = bi_accum_init(&acc, base) || bi_init_base(&x, 0, base)
+            || bi_init_base(&ref, 0, base) || bi_init_base(&out, 0, base);
+
+  for (size_t i = 0; !ret && i < adds; ++i) {
+    if (i % 3 == 2) {
+      uint64_t sc = test_rand() >> (i % 64);
+      ret = bi_accum_add_sc(&acc, sc) || bi_add_sc(&ref, sc);
+    } else {
+      ret = test_rand_bi(&x, i % limbs);
+      // All base - 1 now and then, so the limbs fill up as fast as they can
+      for (size_t j = 0; !ret && i % 5 == 0 && j < x.size; ++j)
+        limb_set(x.data, j, x.span, base - 1);
+      ret = ret || bi_accum_add_bi(&acc, &x) || bi_add_bi(&ref, &x);
+    }
+    // Reads in the middle normalize early, which mustn't change anything
+    if (!ret && i % 97 == 0)
+      ret = bi_accum_get(&acc, &out) || limbs_cmp(out.data, out.size, ref.data, ref.size, out.span);
+  }
+  ret = ret || bi_accum_get(&acc, &out) || limbs_cmp(out.data, out.size, ref.data, ref.size, out.span);
+
+  if (ret)
+    bi_test_failed("bi_accum (base = %" PRIu64 ", adds = %zu, limbs = %zu, simd level = %d)\n", base, adds, limbs, simd_add_level);
+  else
+    bi_test_passed("bi_accum (base = %" PRIu64 ", adds = %zu, limbs = %zu, simd level = %d)\n", base, adds, limbs, simd_add_level);
+  bi_accum_free(&acc);
+  bi_free(&x);
+  bi_free(&ref);
+  bi_free(&out);
+  return ret;
+}
+
+/**
+ * The same full length value over and over, so the sum keeps outgrowing
+ * the accumulator by a limb
+ */
+static int test_bi_accum_repeat(uint64_t base, size_t limbs)
+{
+  struct bi_accum acc;
+  struct big_uint x, ref, out;
+  int ret = bi_accum_init(&acc, base) || bi_init_base(&x, 0, base)
+            || bi_init_base(&ref, 0, base) || bi_init_base(&out, 0, base);
+  ret = ret || test_rand_bi(&x, limbs);
+  for (size_t j = 0; !ret && j < limbs; ++j)
+    limb_set(x.data, j, x.span, base - 1);
+  for (size_t i = 0; !ret && i < 300; ++i)
+    ret = bi_accum_add_bi(&acc, &x) || bi_add_bi(&ref, &x);
+  ret = ret || bi_accum_get(&acc, &out) || limbs_cmp(out.data, out.size, ref.data, ref.size, out.span);
+
+  if (ret)
+    bi_test_failed("bi_accum repeated adds (base = %" PRIu64 ", limbs = %zu)\n", base, limbs);
+  else
+    bi_test_passed("bi_accum repeated adds (base = %" PRIu64 ", limbs = %zu)\n", base, limbs);
+  bi_accum_free(&acc);
+  bi_free(&x);
+  bi_free(&ref);
+  bi_free(&out);
+  return ret;
+}
+
+int test_bi_accum()
+{
+  int ret = 0;
+  uint64_t bases[] = { 2, 3, 10, 255, 1000000000, 1lu << 32, MAX_BASE, BI_BASE_2_64 };
+  int saved = simd_add_level_get();
+  for (int level = 0; level <= saved; ++level) {
+    simd_add_level = level;
+    for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i) {
+      ret = test_bi_accum_once(bases[i], 10, 3) || ret;
+      ret = test_bi_accum_once(bases[i], 2000, 17) || ret;
+      ret = test_bi_accum_repeat(bases[i], 10) || ret;
+    }
+  }
+  simd_add_level = saved;
+  return -ret;
+}
+
+////////////////////////////////////////////// File Format
+/**
+ * bi_save layout: this header (host byte order, [endian] tells which),
+ * zeros up to [offset] (a multiple of the writer's page size), then the
+ * size * span bytes of limbs exactly as they sit in memory
+ */
+#define BI_FILE_MAGIC "BIGUINT"
+#define BI_FILE_VERSION 1
+#define BI_FILE_ENDIAN 0x01020304u
+
+struct bi_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint64_t base;
+  uint64_t span;
+  uint64_t size;        // Limbs
+  uint64_t offset;      // Bytes from the start of the file to the limbs
+  uint64_t checksum;    // file_checksum of the limbs
+};
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * Four independent word lanes so it keeps up with memory, then folded
+ * together with the length. Not cryptographic, just catches torn / flipped
+ * files
+ */
+static uint64_t file_checksum(const uint8_t* p, size_t n)
+{
+  const uint64_t p1 = 0x9E3779B185EBCA87lu;
+  const uint64_t p2 = 0xC2B2AE3D27D4EB4Flu;
+  uint64_t h[4] = { p1 + p2, p2, 0, -p1 };
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32)
+    for (int k = 0; k < 4; ++k) {
+      uint64_t w;
+      memcpy(&w, p + i + 8 * k, sizeof(w));
+      h[k] = rotl64(h[k] + w * p2, 31) * p1;
+    }
+  uint64_t ret = rotl64(h[0], 1) + rotl64(h[1], 7) + rotl64(h[2], 12) + rotl64(h[3], 18);
+  for (; i < n; ++i)
+    ret = rotl64(ret ^ (p[i] * p1), 11) * p2;
+  ret ^= n;
+  ret ^= ret >> 33;
+  ret *= p2;
+  ret ^= ret >> 29;
+  return ret;
+}
+
+/**
+ * write() until everything is out
+ */
+static int write_all(int fd, const void* buf, size_t n)
+{
+  const uint8_t* p = buf;
+  while (n) {
+    ssize_t w = write(fd, p, n);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      return -1;
+    p += w;
+    n -= (size_t)w;
+  }
+  return 0;
+}
+
+/**
+ * fsyncs the directory path is in, which makes a rename into it durable
+ */
+static int file_sync_dir(const char* path)
+{
+  const char* slash = strrchr(path, '/');
+  char* dir = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+  int fd = dir ? open(dir, O_RDONLY | O_DIRECTORY) : -1;
+  int ret = fd < 0 || fsync(fd);
+  if (ret)
+    bi_error("Couldn't sync the directory of %s\n", path);
+  if (fd >= 0)
+    close(fd);
+  free(dir);
+  return ret ? -1 : 0;
+}
+
+int bi_save(
+    const struct big_uint* bi,
+    const char* path)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  struct bi_file_header h = {
+    .magic = BI_FILE_MAGIC,
+    .version = BI_FILE_VERSION,
+    .endian = BI_FILE_ENDIAN,
+    .base = bi->base,
+    .span = bi->span,
+    .size = bi->size,
+    .offset = page > 4096 ? (uint64_t)page : 4096,
+    .checksum = file_checksum(bi->data, bi->size * bi->span),
+  };
+
+  // Written to a file of its own next to path and renamed over it, so
+  // path holds either the old file or the whole new one, even with other
+  // saves to it going on (and live mappings of the old one stay valid).
+  // The syncs make that hold across a crash too
+  size_t len = strlen(path);
+  char* tmp = malloc(len + 8);
+  if (!tmp) {
+    bi_error("Couldn't allocate data in bi_save\n");
+    return -1;
+  }
+  memcpy(tmp, path, len);
+  memcpy(tmp + len, ".XXXXXX", 8);
+  int fd = mkstemp(tmp);
+  if (fd < 0) {
+    bi_error("Couldn't create a file next to %s: %s\n", path, strerror(errno));
+    free(tmp);
+    return -1;
+  }
+  // mkstemp leaves it private, saved files are readable like any other
+  uint8_t* pad = calloc(h.offset, 1);
+  int ret = !pad || fchmod(fd, 0644);
+  if (!ret) {
+    memcpy(pad, &h, sizeof(h));
+    ret = write_all(fd, pad, h.offset) || write_all(fd, bi->data, bi->size * bi->span)
+          || fsync(fd);
+  }
+  // The first failure is the one to report, before cleanup overwrites errno
+  int err = ret ? errno : 0;
+  if (close(fd) && !ret) {
+    ret = 1;
+    err = errno;
+  }
+  free(pad);
+  if (!ret && rename(tmp, path)) {
+    ret = 1;
+    err = errno;
+  }
+  if (ret) {
+    bi_error("Couldn't write %s: %s\n", path, strerror(err));
+    unlink(tmp);
+  }
+  free(tmp);
+  return ret ? -1 : file_sync_dir(path);
+}
+
+int bi_map(
+    struct bi_mapping* map,
+    const char* path,
+    int verify)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    bi_error("Couldn't open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  struct bi_file_header h;
+  int ret = fstat(fd, &st) || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h);
+  if (ret) {
+    bi_error("Couldn't read the header of %s\n", path);
+    close(fd);
+    return -1;
+  }
+
+  // Only what this build would have written itself maps straight in
+  size_t length = (size_t)st.st_size;
+  int valid_base = h.base == BI_BASE_2_64 || (h.base >= 2 && h.base <= MAX_BASE);
+  size_t span = h.base == BI_BASE_2_64 ? UI64 : valid_base ? span_from_base(h.base) : 0;
+  if (memcmp(h.magic, BI_FILE_MAGIC, sizeof(h.magic)) || h.version != BI_FILE_VERSION
+      || h.endian != BI_FILE_ENDIAN || !valid_base || h.span != span
+      || h.offset < sizeof(h) || h.offset % 8 || h.offset > length
+      || h.size > (length - h.offset) / span) {
+    bi_error("%s isn't a big_uint file this build can map\n", path);
+    close(fd);
+    return -1;
+  }
+
+  void* addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    bi_error("Couldn't map %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  uint8_t* data = (uint8_t*)addr + h.offset;
+  if (verify && file_checksum(data, h.size * span) != h.checksum) {
+    bi_error("Checksum mismatch in %s\n", path);
+    munmap(addr, length);
+    return -1;
+  }
+
+  struct bi_mapping ret_map = {
+    .value = {
+      .data = data,
+      .size = h.size,
+      .capacity = h.size * span,
+      .base = h.base,
+      .span = span,
+    },
+    .addr = addr,
+    .length = length,
+  };
+  memcpy(map, &ret_map, sizeof(struct bi_mapping));
+  return 0;
+}
+
+void bi_unmap(struct bi_mapping* map)
+{
+  if (map->addr)
+    munmap(map->addr, map->length);
+  map->addr = NULL;
+  map->value.data = NULL;
+}
+
+static int test_bi_save_once(const char* path, size_t n, uint64_t base)
+{
+  struct big_uint bi;
+  struct bi_mapping map = { .addr = NULL };
+  int ret = bi_init_base(&bi, 0, base) || test_rand_bi(&bi, n) || bi_save(&bi, path)
+            || bi_map(&map, path, 1);
+  ret = ret || map.value.base != bi.base || map.value.span != bi.span
+        || limbs_cmp(map.value.data, map.value.size, bi.data, bi.size, bi.span)
+        || (uintptr_t)map.value.data % 4096;
+
+  // Reads work straight off the mapping
+  char* a = ret ? NULL : bi_to_str(&bi);
+  char* b = ret ? NULL : bi_to_str(&map.value);
+  ret = ret || !a || !b || strcmp(a, b);
+
+  if (ret)
+    bi_test_failed("bi_save / bi_map (n = %zu, base = %" PRIu64 ")\n", n, base);
+  else
+    bi_test_passed("bi_save / bi_map (n = %zu, base = %" PRIu64 ")\n", n, base);
+  free(a);
+  free(b);
+  bi_unmap(&map);
+  bi_free(&bi);
+  return ret;
+}
+
+/**
+ * Whether any of bi_save's temporary files are left next to path
+ */
+static int test_save_leftovers(const char* path)
+{
+  char pattern[64];
+  glob_t g;
+  snprintf(pattern, sizeof(pattern), "%s.*", path);
+  int found = glob(pattern, 0, NULL, &g) == 0;
+  if (found)
+    globfree(&g);
+  return found;
+}
+
+struct test_save_race {
+  const char* path;
+  const struct big_uint* bi;
+  int fail;
+};
+
+static void* test_save_racer(void* arg)
+{
+  struct test_save_race* race = arg;
+  for (int i = 0; i < 50; ++i)
+    race->fail = bi_save(race->bi, race->path) || race->fail;
+  return NULL;
+}
+
+int test_bi_save()
+{
+  int ret = 0;
+  char path[] = "/tmp/bi_test_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    bi_test_failed("bi_save: no temp file\n");
+    return -1;
+  }
+  close(fd);
+
+  uint64_t bases[] = { 2, 10, 1000, 1000000000, MAX_BASE, BI_BASE_2_64 };
+  size_t sizes[] = { 0, 1, 1000, 100000 };
+  for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i)
+    for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j)
+      ret = test_bi_save_once(path, sizes[j], bases[i]) || ret;
+
+  // A flipped limb byte only shows up when verifying, a bad header always
+  struct big_uint bi;
+  struct bi_mapping map;
+  bi_init(&bi, 0, 10);
+  test_rand_bi(&bi, 5000);
+  int fail = bi_save(&bi, path);
+  fd = open(path, O_RDWR);
+  uint8_t byte = 0;
+  fail = fail || fd < 0 || pread(fd, &byte, 1, 4096 + 1234) != 1;
+  byte ^= 1;
+  fail = fail || pwrite(fd, &byte, 1, 4096 + 1234) != 1;
+  fail = fail || bi_map(&map, path, 0);
+  if (!fail)
+    bi_unmap(&map);
+  fail = fail || !bi_map(&map, path, 1);
+  fail = fail || pwrite(fd, "X", 1, 0) != 1 || !bi_map(&map, path, 0);
+  fail = fail || ftruncate(fd, 4096 + 100) || !bi_map(&map, path, 0);
+  if (fd >= 0)
+    close(fd);
+  fail = fail || !bi_map(&map, "/nonexistent/bi_file", 0);
+  if (fail)
+    bi_test_failed("bi_map rejects bad files\n");
+  else
+    bi_test_passed("bi_map rejects bad files\n");
+  ret |= fail;
+
+  // Saving over a mapped file leaves the mapping with the old value
+  struct big_uint other;
+  bi_init(&other, 0, 10);
+  fail = test_rand_bi(&bi, 3000) || test_rand_bi(&other, 7000) || bi_save(&bi, path)
+         || bi_map(&map, path, 1);
+  if (!fail) {
+    fail = bi_save(&other, path) || limbs_cmp(map.value.data, map.value.size, bi.data, bi.size, bi.span);
+    bi_unmap(&map);
+  }
+  fail = fail || bi_map(&map, path, 1);
+  if (!fail) {
+    fail = limbs_cmp(map.value.data, map.value.size, other.data, other.size, other.span);
+    bi_unmap(&map);
+  }
+  fail = fail || test_save_leftovers(path) || !bi_save(&bi, "/nonexistent/bi_file");
+  if (fail)
+    bi_test_failed("bi_save replaces files whole\n");
+  else
+    bi_test_passed("bi_save replaces files whole\n");
+
+  // Saves racing on one path all land, and it ends up holding one of them
+  struct test_save_race race[2] = { { path, &bi, 0 }, { path, &other, 0 } };
+  pthread_t th;
+  fail = pthread_create(&th, NULL, test_save_racer, &race[1]);
+  if (!fail) {
+    test_save_racer(&race[0]);
+    pthread_join(th, NULL);
+  }
+  fail = fail || race[0].fail || race[1].fail || test_save_leftovers(path)
+         || bi_map(&map, path, 1);
+  if (!fail) {
+    fail = limbs_cmp(map.value.data, map.value.size, bi.data, bi.size, bi.span)
+           && limbs_cmp(map.value.data, map.value.size, other.data, other.size, other.span);
+    bi_unmap(&map);
+  }
+  if (fail)
+    bi_test_failed("bi_save from two threads at once\n");
+  else
+    bi_test_passed("bi_save from two threads at once\n");
+  bi_free(&other);
+  bi_free(&bi);
+
+  unlink(path);
+  return -(ret || fail);
+}
+
+////////////////////////////////////////////// Stats
+#ifdef BI_STATS
+/**
+ * Each thread's counters, linked in so readers can find them. Only the
+ * owner writes them (relaxed load + store, no locked ops), readers take
+ * relaxed loads. Exiting threads fold theirs into stats.retired
+ */
+struct stats_thread {
+  struct bi_stats counts;
+  struct stats_thread* next;
+  int linked;
+};
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_once_t once;
+  pthread_key_t key;
+  struct stats_thread* threads;
+  struct bi_stats retired;
+  struct bi_stats zero;       // Totals at the last reset
+} stats = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .once = PTHREAD_ONCE_INIT,
+};
+
+static _Thread_local struct stats_thread stats_self;
+
+#define STATS_WORDS (sizeof(struct bi_stats) / sizeof(uint64_t))
+
+static void stats_add(uint64_t* counter, uint64_t n)
+{
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+/**
+ * dest += src word by word
+ */
+static void stats_sum(struct bi_stats* dest, const struct bi_stats* src)
+{
+  uint64_t* d = (uint64_t*)dest;
+  const uint64_t* s = (const uint64_t*)src;
+  for (size_t i = 0; i < STATS_WORDS; ++i)
+    d[i] += __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+}
+
+static void stats_thread_exit(void* arg)
+{
+  struct stats_thread* self = arg;
+  pthread_mutex_lock(&stats.lock);
+  stats_sum(&stats.retired, &self->counts);
+  for (struct stats_thread** p = &stats.threads; *p; p = &(*p)->next)
+    if (*p == self) {
+      *p = self->next;
+      break;
+    }
+  pthread_mutex_unlock(&stats.lock);
+}
+
+static void stats_key_init(void)
+{
+  pthread_key_create(&stats.key, stats_thread_exit);
+}
+
+static struct bi_stats* stats_local(void)
+{
+  struct stats_thread* self = &stats_self;
+  if (__builtin_expect(!self->linked, 0)) {
+    pthread_once(&stats.once, stats_key_init);
+    pthread_mutex_lock(&stats.lock);
+    self->next = stats.threads;
+    stats.threads = self;
+    pthread_mutex_unlock(&stats.lock);
+    pthread_setspecific(stats.key, self);
+    self->linked = 1;
+  }
+  return &self->counts;
+}
+
+static uint64_t stats_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static struct stats_timer stats_begin(enum bi_stats_op op, size_t limbs, size_t span)
+{
+  struct bi_stats* s = stats_local();
+  stats_add(&s->op_calls[op], 1);
+  stats_add(&s->op_limbs[op], limbs);
+  if (span)
+    stats_add(&s->span_limbs[__builtin_ctzl(span)], limbs);
+  struct stats_timer ret = { op, stats_now() };
+  return ret;
+}
+
+static void stats_end(struct stats_timer* timer)
+{
+  stats_add(&stats_local()->op_ns[timer->op], stats_now() - timer->start);
+}
+
+static void stats_chain(struct bi_stats* s, uint64_t len)
+{
+  stats_add(&s->carry_chains, 1);
+  stats_add(&s->carry_limbs, len);
+  // Anything from 2^(BUCKETS - 1) limbs up shares the last bucket
+  size_t k = 63 - __builtin_clzll(len);
+  if (k >= BI_STATS_CHAIN_BUCKETS)
+    k = BI_STATS_CHAIN_BUCKETS - 1;
+  stats_add(&s->carry_hist[k], 1);
+}
+
+/**
+ * Replays the carries of a + b: a chain is a run of limbs that each carry
+ * out (one that generates, then the ones it ripples through)
+ */
+static void stats_carries(
+  const uint8_t* a, size_t an,
+  const uint8_t* b, size_t bn,
+  size_t span, uint64_t base)
+{
+  struct bi_stats* s = stats_local();
+  size_t n = an > bn ? an : bn;
+  uint64_t c = 0;
+  uint64_t run = 0;
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t x = i < an ? limb_get(a, i, span) : 0;
+    uint64_t y = i < bn ? limb_get(b, i, span) : 0;
+    if (base == BI_BASE_2_64) {
+      unsigned char o = __builtin_add_overflow(x, y, &x);
+      c = o | __builtin_add_overflow(x, c, &x);
+    } else {
+      c = x + y + c >= base;
+    }
+    if (c) {
+      run++;
+    } else if (run) {
+      stats_chain(s, run);
+      run = 0;
+    }
+  }
+  if (run)
+    stats_chain(s, run);
+}
+
+/**
+ * Everything counted so far, exited threads included
+ */
+static void stats_total(struct bi_stats* total)
+{
+  memcpy(total, &stats.retired, sizeof(struct bi_stats));
+  for (struct stats_thread* t = stats.threads; t; t = t->next)
+    stats_sum(total, &t->counts);
+}
+
+int bi_stats_get(struct bi_stats* out)
+{
+  struct bi_stats total;
+  pthread_mutex_lock(&stats.lock);
+  stats_total(&total);
+  uint64_t* d = (uint64_t*)out;
+  const uint64_t* t = (const uint64_t*)&total;
+  const uint64_t* z = (const uint64_t*)&stats.zero;
+  for (size_t i = 0; i < STATS_WORDS; ++i)
+    d[i] = t[i] - z[i];
+  pthread_mutex_unlock(&stats.lock);
+  return 0;
+}
+
+void bi_stats_reset(void)
+{
+  // Owners never see a reset, their counters just get a new zero
+  pthread_mutex_lock(&stats.lock);
+  stats_total(&stats.zero);
+  pthread_mutex_unlock(&stats.lock);
+}
+#else
+int bi_stats_get(struct bi_stats* out)
+{
+  memset(out, 0, sizeof(struct bi_stats));
+  return -1;
+}
+
+void bi_stats_reset(void)
+{
+}
+#endif
+
+#ifdef BI_STATS
+static void *test_bi_stats_worker(void* arg)
+{
+  struct big_uint* bi = arg;
+  struct big_uint one;
+  bi_init(&one, 1, 10);
+  bi_add_bi(bi, &one);
+  bi_free(&one);
+  return NULL;
+}
+#endif
+
+int test_bi_stats()
+{
+  struct bi_stats s;
+#ifndef BI_STATS
+  if (bi_stats_get(&s) != -1 || s.op_calls[BI_OP_ADD_BI]) {
+    bi_test_failed("bi_stats_get without BI_STATS\n");
+    return -1;
+  }
+  bi_test_passed("bi_stats_get without BI_STATS\n");
+  return 0;
+#else
+  struct big_uint a;
+  struct big_uint b;
+  bi_init(&a, 0, 10);
+  bi_init(&b, 1, 10);
+  int ret = ensure_capacity_big_enough(&a, 32);
+  for (int i = 0; i < 32; ++i)
+    limb_set(a.data, i, a.span, 9);
+  a.size = 32;
+
+  // 99..9 (32 nines) + 1 carries all the way (one chain of 32) into a 33rd
+  // limb, which doubles the capacity once
+  bi_stats_reset();
+  ret = ret || bi_add_bi(&a, &b) || bi_stats_get(&s);
+  ret = ret || s.carry_chains != 1 || s.carry_limbs != 32 || s.carry_hist[5] != 1
+        || s.op_calls[BI_OP_ADD_BI] != 1 || s.op_limbs[BI_OP_ADD_BI] != 33
+        || s.span_limbs[0] != 33 || s.grow_calls != 1 || s.grow_bytes != 64;
+  if (ret)
+    bi_test_failed("bi_stats counts one add\n");
+  else
+    bi_test_passed("bi_stats counts one add\n");
+
+  // A thread's counts stay in the totals after it exits
+  pthread_t th;
+  int fail = pthread_create(&th, NULL, test_bi_stats_worker, &a) || pthread_join(th, NULL);
+  fail = fail || bi_stats_get(&s) || s.op_calls[BI_OP_ADD_BI] != 2 || s.carry_chains != 1;
+  bi_stats_reset();
+  fail = fail || bi_stats_get(&s) || s.op_calls[BI_OP_ADD_BI] || s.grow_calls;
+  if (fail)
+    bi_test_failed("bi_stats merges threads and resets\n");
+  else
+    bi_test_passed("bi_stats merges threads and resets\n");
+
+  bi_free(&a);
+  bi_free(&b);
+  return -(ret || fail);
+#endif
+}
+
+////////////////////////////////////////////// Allocators
+static void* malloc_alloc(void* ctx, size_t bytes)
+{
+  (void)ctx;
+  return malloc(bytes);
+}
+
+static void* malloc_resize(void* ctx, void* p, size_t old_bytes, size_t new_bytes)
+{
+  (void)ctx; (void)old_bytes;
+  return realloc(p, new_bytes);
+}
+
+static void malloc_free(void* ctx, void* p, size_t bytes)
+{
+  (void)ctx; (void)bytes;
+  free(p);
+}
+
+const struct bi_allocator bi_allocator_malloc = {
+  .alloc = malloc_alloc,
+  .resize = malloc_resize,
+  .free = malloc_free,
+};
+
+/**
+ * Anything this big gets its own mapping, in steps of one huge page
+ */
+#define HUGE_PAGE ((size_t)1 << 21)
+#define HUGE_LEN(bytes) (((bytes) + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1))
+
+static void* huge_map(size_t bytes)
+{
+  size_t len = HUGE_LEN(bytes);
+  void* p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+#ifdef MADV_HUGEPAGE
+  madvise(p, len, MADV_HUGEPAGE);   // Only advice, THP may be off
+#endif
+  return p;
+}
+
+static void* huge_alloc(void* ctx, size_t bytes)
+{
+  (void)ctx;
+  return bytes < HUGE_PAGE ? malloc(bytes) : huge_map(bytes);
+}
+
+static void huge_free(void* ctx, void* p, size_t bytes)
+{
+  (void)ctx;
+  if (bytes < HUGE_PAGE)
+    free(p);
+  else
+    munmap(p, HUGE_LEN(bytes));
+}
+
+static void* huge_resize(void* ctx, void* p, size_t old_bytes, size_t new_bytes)
+{
+  if (old_bytes < HUGE_PAGE && new_bytes < HUGE_PAGE)
+    return realloc(p, new_bytes);
+  if (old_bytes >= HUGE_PAGE && new_bytes >= HUGE_PAGE) {
+    size_t old_len = HUGE_LEN(old_bytes);
+    size_t new_len = HUGE_LEN(new_bytes);
+    if (old_len == new_len)
+      return p;
+#if defined(__linux__)
+    // The kernel moves the page tables, not the limbs
+    void* q = mremap(p, old_len, new_len, MREMAP_MAYMOVE);
+    if (q == MAP_FAILED)
+      return NULL;
+#ifdef MADV_HUGEPAGE
+    if (new_len > old_len)
+      madvise(q, new_len, MADV_HUGEPAGE);
+#endif
+    return q;
+#endif
+  }
+
+  // Switching between malloc and a mapping (or no mremap): copy over
+  void* q = huge_alloc(ctx, new_bytes);
+  if (!q)
+    return NULL;
+  memcpy(q, p, old_bytes < new_bytes ? old_bytes : new_bytes);
+  huge_free(ctx, p, old_bytes);
+  return q;
+}
+
+const struct bi_allocator bi_allocator_huge = {
+  .alloc = huge_alloc,
+  .resize = huge_resize,
+  .free = huge_free,
+};
+
+static const struct bi_allocator* default_allocator = &bi_allocator_malloc;
+
+void bi_set_default_allocator(const struct bi_allocator* alloc)
+{
+  __atomic_store_n(&default_allocator, alloc ? alloc : &bi_allocator_malloc, __ATOMIC_RELEASE);
+}
+
+const struct bi_allocator* bi_get_default_allocator(void)
+{
+  return __atomic_load_n(&default_allocator, __ATOMIC_ACQUIRE);
+}
+
+int bi_set_allocator(
+    struct big_uint* bi,
+    const struct bi_allocator* alloc)
+{
+  alloc = alloc ? alloc : &bi_allocator_malloc;
+  const struct bi_allocator* old = BI_ALLOC(bi);
+  if (alloc != old && !bi->arena && bi->data && !BI_IS_SMALL(bi)) {
+    uint8_t* data = alloc->alloc(alloc->ctx, bi->capacity);
+    if (!data) {
+      bi_error("Couldn't allocate data in bi_set_allocator\n");
+      return -1;
+    }
+    memcpy(data, bi->data, bi->size * bi->span);
+    old->free(old->ctx, bi->data, bi->capacity);
+    bi->data = data;
+  }
+  bi->alloc = alloc;
+  return 0;
+}
+
+int bi_reserve(
+    struct big_uint* bi,
+    size_t limbs)
+{
+  if (bi->capacity >= limbs * bi->span)
+    return 0;
+  return grow_capacity(bi, limbs * bi->span);
+}
+
+int bi_shrink_to_fit(struct big_uint* bi)
+{
+  size_t bytes = bi->size * bi->span;
+  if (bi->arena || BI_IS_SMALL(bi) || !bi->data || bytes >= bi->capacity)
+    return 0;
+
+  const struct bi_allocator* alloc = BI_ALLOC(bi);
+  if (bytes <= BI_INLINE_BYTES) {
+    memcpy(bi->small, bi->data, bytes);
+    alloc->free(alloc->ctx, bi->data, bi->capacity);
+    bi->data = (uint8_t*)bi->small;
+    bi->capacity = BI_INLINE_BYTES;
+    return 0;
+  }
+  uint8_t* data = alloc->resize(alloc->ctx, bi->data, bi->capacity, bytes);
+  if (!data) {
+    bi_error("Couldn't reallocate data in bi_shrink_to_fit\n");
+    return -1;
+  }
+  bi->data = data;
+  bi->capacity = bytes;
+  return 0;
+}
+
+/**
+ * Counts live bytes on top of malloc
+ */
+static size_t test_alloc_live;
+
+static void* test_alloc_alloc(void* ctx, size_t bytes)
+{
+  *(size_t*)ctx += bytes;
+  return malloc(bytes);
+}
+
+static void* test_alloc_resize(void* ctx, void* p, size_t old_bytes, size_t new_bytes)
+{
+  void* q = realloc(p, new_bytes);
+  if (q)
+    *(size_t*)ctx += new_bytes - old_bytes;
+  return q;
+}
+
+static void test_alloc_free(void* ctx, void* p, size_t bytes)
+{
+  *(size_t*)ctx -= bytes;
+  free(p);
+}
+
+static const struct bi_allocator test_allocator = {
+  .alloc = test_alloc_alloc,
+  .resize = test_alloc_resize,
+  .free = test_alloc_free,
+  .ctx = &test_alloc_live,
+};
+
+/**
+ * Grows a number on [alloc] to n limbs through reserve, an add and a
+ * multiply, checks it against the same on malloc, then shrinks it back
+ */
+static int test_bi_allocator_once(const struct bi_allocator* alloc, size_t n, uint64_t base)
+{
+  struct big_uint a, b, c, ref;
+  bi_set_default_allocator(alloc);
+  int ret = bi_init_base(&a, 0, base) || bi_init_base(&b, 0, base) || bi_init_base(&c, 0, base);
+  bi_set_default_allocator(NULL);
+  ret = ret || bi_init_base(&ref, 0, base) || a.alloc != alloc;
+
+  ret = ret || bi_reserve(&a, n) || a.capacity != (BI_IS_SMALL(&a) ? BI_INLINE_BYTES : n * a.span)
+        || test_rand_bi(&a, n)
+        || test_rand_bi(&b, n) || bi_set_limbs(&ref, a.data, a.size)
+        || bi_add_bi(&a, &b) || bi_add_bi(&ref, &b)
+        || bi_shrink_to_fit(&a) || (!BI_IS_SMALL(&a) && a.capacity != a.size * a.span)
+        || limbs_cmp(a.data, a.size, ref.data, ref.size, a.span)
+        || bi_mul_bi(&c, &a, &b) || bi_mul_bi(&ref, &a, &b)
+        || limbs_cmp(c.data, c.size, ref.data, ref.size, c.span);
+
+  // c came back from a scratch buffer, so it had to be copied in
+  ret = ret || c.alloc != alloc;
+  c.size = 1;
+  ret = ret || bi_shrink_to_fit(&c) || !BI_IS_SMALL(&c);
+
+  if (ret)
+    bi_test_failed("bi_allocator (n = %zu, base = %" PRIu64 ")\n", n, base);
+  else
+    bi_test_passed("bi_allocator (n = %zu, base = %" PRIu64 ")\n", n, base);
+  bi_free(&a);
+  bi_free(&b);
+  bi_free(&c);
+  bi_free(&ref);
+  return ret;
+}
+
+int test_bi_allocator()
+{
+  int ret = 0;
+  uint64_t bases[] = { 10, 1000000000, BI_BASE_2_64 };
+  size_t sizes[] = { 1, 100, 300000 };
+  for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i)
+    for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j) {
+      ret = test_bi_allocator_once(&test_allocator, sizes[j], bases[i]) || ret;
+      ret = test_bi_allocator_once(&bi_allocator_huge, sizes[j], bases[i]) || ret;
+    }
+
+  int fail = test_alloc_live != 0;
+  if (fail)
+    bi_test_failed("bi_allocator frees everything (%zu bytes live)\n", test_alloc_live);
+  else
+    bi_test_passed("bi_allocator frees everything\n");
+
+  // Moving between allocators, and huge mappings growing through mremap
+  struct big_uint bi;
+  bi_init(&bi, 0, 10);
+  fail = test_rand_bi(&bi, 1000) || bi_set_allocator(&bi, &test_allocator)
+         || test_alloc_live != bi.capacity || bi_set_allocator(&bi, &bi_allocator_huge)
+         || test_alloc_live || bi_reserve(&bi, 3 << 20) || test_rand_bi(&bi, 3 << 20)
+         || bi_reserve(&bi, 9 << 20) || bi_set_allocator(&bi, NULL)
+         || bi.alloc != &bi_allocator_malloc || bi.size != 3 << 20;
+  if (fail)
+    bi_test_failed("bi_set_allocator\n");
+  else
+    bi_test_passed("bi_set_allocator\n");
+  bi_free(&bi);
+
+  return -(ret || fail);
+}
+
+////////////////////////////////////////////// Fixed Width
+int bi_from_limbs(
+    struct big_uint* dest,
+    const void* limbs,
+    size_t n,
+    size_t width,
+    uint64_t base)
+{
+  if (dest->base != base) {
+    bi_error("Can only copy limbs into a big int of the same base\n");
+    return -1;
+  }
+  if (width == dest->span)
+    return bi_set_limbs(dest, limbs, n);
+  if (ensure_capacity_big_enough(dest, n))
+    return -1;
+  for (size_t i = 0; i < n; ++i)
+    limb_set(dest->data, i, dest->span, limb_get(limbs, i, width));
+  dest->size = limbs_strip(dest->data, n, dest->span);
+  return 0;
+}
+
+int bi_to_limbs(
+    const struct big_uint* src,
+    void* limbs,
+    size_t n,
+    size_t width,
+    uint64_t base)
+{
+  if (src->base != base) {
+    bi_error("Can only copy limbs out of a big int of the same base\n");
+    return -1;
+  }
+  if (src->size > n) {
+    bi_error("%zu limbs don't fit in %zu\n", src->size, n);
+    return -1;
+  }
+  for (size_t i = 0; i < n; ++i)
+    limb_set(limbs, i, width, i < src->size ? limb_get(src->data, i, src->span) : 0);
+  return 0;
+}
+
+BI_DEFINE_FIXED(test_fx_u256, 4, BI_BASE_2_64)
+BI_DEFINE_FIXED(test_fx_d72, 8, 1000000000)
+BI_DEFINE_FIXED_T(test_fx_d64, uint8_t, 64, 10)
+BI_DEFINE_FIXED_T(test_fx_h16, uint16_t, 16, 30000)
+
+/**
+ * Checks add, add_sc and cmp of a fixed width type against big_uint on
+ * random full width operands. Results are compared mod base^limbs, with
+ * the carry / overflow flag standing for the limb that fell off
+ */
+#define TEST_BI_FIXED(name, limbs, base)                                      \
+static int test_bi_fixed_##name(void)                                         \
+{                                                                             \
+  struct big_uint a, b, t;                                                    \
+  struct name x, y, z;                                                        \
+  int ret = bi_init_base(&a, 0, (base)) || bi_init_base(&b, 0, (base))        \
+            || bi_init_base(&t, 0, (base));                                   \
+  for (int k = 0; k < 200 && !ret; ++k) {                                     \
+    size_t an = 1 + test_rand() % (limbs);                                    \
+    ret = test_rand_bi(&a, k % 2 ? an : (limbs))                              \
+          || test_rand_bi(&b, k % 3 ? (limbs) : 1 + test_rand() % (limbs))    \
+          || name##_from_bi(&x, &a) || name##_from_bi(&y, &b);                \
+    ret = ret || name##_cmp(&x, &y) != limbs_cmp(a.data, a.size, b.data, b.size, a.span); \
+                                                                              \
+    int c = name##_add(&z, &x, &y);                                           \
+    ret = ret || bi_add_bi(&a, &b) || c != (a.size > (limbs));                \
+    a.size = limbs_strip(a.data, a.size < (limbs) ? a.size : (limbs), a.span); \
+    ret = ret || name##_to_bi(&t, &z) || limbs_cmp(t.data, t.size, a.data, a.size, a.span); \
+                                                                              \
+    uint64_t v = test_rand();                                                 \
+    c = name##_add_sc(&z, v);                                                 \
+    ret = ret || bi_add_sc(&a, v) || c != (a.size > (limbs));                 \
+    a.size = limbs_strip(a.data, a.size < (limbs) ? a.size : (limbs), a.span); \
+    ret = ret || name##_to_bi(&t, &z) || limbs_cmp(t.data, t.size, a.data, a.size, a.span); \
+  }                                                                           \
+                                                                              \
+  /* Too big for the width, and the wrong base */                             \
+  ret = ret || test_rand_bi(&a, (limbs) + 1) || !name##_from_bi(&x, &a)       \
+        || name##_set(&x, 0) || name##_to_bi(&t, &x) || t.size                \
+        || !name##_from_bi(&x, &test_fixed_other);                            \
+                                                                              \
+  if (ret)                                                                    \
+    bi_test_failed("BI_DEFINE_FIXED(%s, %d, %" PRIu64 ")\n", #name, (limbs), (uint64_t)(base)); \
+  else                                                                        \
+    bi_test_passed("BI_DEFINE_FIXED(%s, %d, %" PRIu64 ")\n", #name, (limbs), (uint64_t)(base)); \
+  bi_free(&a);                                                                \
+  bi_free(&b);                                                                \
+  bi_free(&t);                                                                \
+  return ret;                                                                 \
+}
+
+static struct big_uint test_fixed_other;
+
+TEST_BI_FIXED(test_fx_u256, 4, BI_BASE_2_64)
+TEST_BI_FIXED(test_fx_d72, 8, 1000000000)
+TEST_BI_FIXED(test_fx_d64, 64, 10)
+TEST_BI_FIXED(test_fx_h16, 16, 30000)
+
+int test_bi_fixed()
+{
+  int ret = bi_init(&test_fixed_other, 0, 7);
+
+  // Carry / overflow right at the top
+  struct test_fx_u256 x, y;
+  for (int i = 0; i < 4; ++i)
+    x.limb[i] = UINT64_MAX;
+  int fail = test_fx_u256_set(&y, 1) || !test_fx_u256_add(&x, &x, &y)
+             || x.limb[3] || test_fx_u256_set(&y, 0) || test_fx_u256_cmp(&x, &y)
+             || test_fx_u256_add_sc(&x, 5) || x.limb[0] != 5;
+  struct test_fx_d72 d;
+  fail = fail || test_fx_d72_set(&d, UINT64_MAX) || d.limb[0] != 709551615
+         || d.limb[1] != 446744073 || d.limb[2] != 18 || d.limb[3];
+  struct test_fx_d64 small;
+  for (int i = 0; i < 64; ++i)
+    small.limb[i] = 9;
+  fail = fail || !test_fx_d64_add_sc(&small, 1) || small.limb[63];
+  if (fail)
+    bi_test_failed("BI_DEFINE_FIXED carries and overflow\n");
+  else
+    bi_test_passed("BI_DEFINE_FIXED carries and overflow\n");
+
+  ret = test_bi_fixed_test_fx_u256() || ret;
+  ret = test_bi_fixed_test_fx_d72() || ret;
+  ret = test_bi_fixed_test_fx_d64() || ret;
+  ret = test_bi_fixed_test_fx_h16() || ret;
+  bi_free(&test_fixed_other);
+  return -(ret || fail);
+}
+
+////////////////////////////////////////////// Multi-operand Add
+/**
+ * A multi-operand add goes a block of limbs at a time. Every term is added
+ * into the block's columns first with no carries between limbs: r keeps a
+ * digit and q counts how often it wrapped. That leaves r + q * base, and
+ * since q (at most the number of terms) is itself a digit, shifting q up a
+ * limb turns the block into a plain two operand add. Terms are only read
+ * once and the result only written once
+ */
+#define ADD_MANY_BLOCK 512
+#define ADD_MANY_TERMS 64
+
+/**
+ * r += t[0] + ... + t[n - 1] over m columns, counting wraps into q. Each
+ * vector of columns stays in registers across all the terms. Returns how
+ * many columns were done (the rest is left to ADD_MANY_COLS)
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define ADD_MANY_COLS_AVX2(bits, set1) \
+TARGET_AVX2 static size_t add_many_cols_avx2_##bits(                                 \
+  uint8_t* r, uint8_t* q, const uint8_t* const* t, size_t n, size_t m,        \
+  uint64_t base)                                                              \
+{                                                                             \
+  const size_t lanes = 256 / bits;                                            \
+  const __m256i sign = set1((int##bits##_t)((uint64_t)1 << (bits - 1)));      \
+  const __m256i vb = set1((int##bits##_t)base);                               \
+  const __m256i vbs = _mm256_xor_si256(vb, sign);                             \
+  const __m256i ones = _mm256_set1_epi64x(-1);                                \
+  size_t i = 0;                                                               \
+  for(; i + lanes <= m; i += lanes) {                                         \
+    size_t off = i * (bits / 8);                                              \
+    __m256i s = _mm256_loadu_si256((const __m256i*)(r + off));                \
+    __m256i vq = _mm256_loadu_si256((const __m256i*)(q + off));               \
+    for(size_t k = 0; k < n; ++k) {                                           \
+      __m256i vt = _mm256_loadu_si256((const __m256i*)(t[k] + off));          \
+      s = _mm256_add_epi##bits(s, vt);                                        \
+      __m256i w;                                                              \
+      if(base == BI_BASE_2_64) {                                              \
+        /* Wrapped past 2^64 when the sum came out below t */                 \
+        w = _mm256_cmpgt_epi##bits(_mm256_xor_si256(vt, sign), _mm256_xor_si256(s, sign)); \
+      } else {                                                                \
+        w = _mm256_xor_si256(_mm256_cmpgt_epi##bits(vbs, _mm256_xor_si256(s, sign)), ones); \
+        s = _mm256_sub_epi##bits(s, _mm256_and_si256(w, vb));                 \
+      }                                                                       \
+      vq = _mm256_sub_epi##bits(vq, w);                                       \
+    }                                                                         \
+    _mm256_storeu_si256((__m256i*)(r + off), s);                              \
+    _mm256_storeu_si256((__m256i*)(q + off), vq);                             \
+  }                                                                           \
+  return i;                                                                   \
+}
+
+ADD_MANY_COLS_AVX2(8, _mm256_set1_epi8)
+ADD_MANY_COLS_AVX2(16, _mm256_set1_epi16)
+ADD_MANY_COLS_AVX2(32, _mm256_set1_epi32)
+ADD_MANY_COLS_AVX2(64, _mm256_set1_epi64x)
+
+#define ADD_MANY_COLS_AVX512(bits) \
+TARGET_AVX512 static size_t add_many_cols_avx512_##bits(                             \
+  uint8_t* r, uint8_t* q, const uint8_t* const* t, size_t n, size_t m,        \
+  uint64_t base)                                                              \
+{                                                                             \
+  const size_t lanes = 512 / bits;                                            \
+  const __m512i vb = _mm512_set1_epi##bits((int##bits##_t)base);             \
+  const __m512i one = _mm512_set1_epi##bits(1);                               \
+  size_t i = 0;                                                               \
+  for(; i + lanes <= m; i += lanes) {                                         \
+    size_t off = i * (bits / 8);                                              \
+    __m512i s = _mm512_loadu_si512(r + off);                                  \
+    __m512i vq = _mm512_loadu_si512(q + off);                                 \
+    for(size_t k = 0; k < n; ++k) {                                           \
+      __m512i vt = _mm512_loadu_si512(t[k] + off);                            \
+      s = _mm512_add_epi##bits(s, vt);                                        \
+      uint64_t w;                                                             \
+      if(base == BI_BASE_2_64) {                                              \
+        w = _mm512_cmplt_epu##bits##_mask(s, vt);                             \
+      } else {                                                                \
+        w = _mm512_cmpge_epu##bits##_mask(s, vb);                             \
+        s = _mm512_mask_sub_epi##bits(s, w, s, vb);                           \
+      }                                                                       \
+      vq = _mm512_mask_add_epi##bits(vq, w, vq, one);                         \
+    }                                                                         \
+    _mm512_storeu_si512(r + off, s);                                          \
+    _mm512_storeu_si512(q + off, vq);                                         \
+  }                                                                           \
+  return i;                                                                   \
+}
+
+ADD_MANY_COLS_AVX512(8)
+ADD_MANY_COLS_AVX512(16)
+ADD_MANY_COLS_AVX512(32)
+ADD_MANY_COLS_AVX512(64)
+#endif
+
+static size_t add_many_cols_simd(
+  uint8_t* r, uint8_t* q, const uint8_t* const* t, size_t n, size_t m,
+  size_t span, uint64_t base)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+  switch(simd_add_level_get()) {
+    case 2:
+      switch(span) {
+        case UI8: return add_many_cols_avx512_8(r, q, t, n, m, base);
+        case UI16: return add_many_cols_avx512_16(r, q, t, n, m, base);
+        case UI32: return add_many_cols_avx512_32(r, q, t, n, m, base);
+        case UI64: return add_many_cols_avx512_64(r, q, t, n, m, base);
+      }
+      break;
+    case 1:
+      switch(span) {
+        case UI8: return add_many_cols_avx2_8(r, q, t, n, m, base);
+        case UI16: return add_many_cols_avx2_16(r, q, t, n, m, base);
+        case UI32: return add_many_cols_avx2_32(r, q, t, n, m, base);
+        case UI64: return add_many_cols_avx2_64(r, q, t, n, m, base);
+      }
+      break;
+  }
+#endif
+  (void)r; (void)q; (void)t; (void)n; (void)m; (void)span; (void)base;
+  return 0;
+}
+
+#define ADD_MANY_COLS(type, r, q, t, i0, m, base) do {                        \
+  type* _r = (type*)(r);                                                      \
+  type* _q = (type*)(q);                                                      \
+  const type* _t = (const type*)(t);                                          \
+  const type _base = (type)(base);                                            \
+  for(size_t _i = (i0); _i < (m); ++_i) {                                     \
+    type _s = _r[_i] + _t[_i];                                                \
+    type _w = _base ? _s >= _base : _s < _t[_i];                              \
+    _r[_i] = _w ? _s - _base : _s;                                            \
+    _q[_i] += _w;                                                             \
+  }                                                                           \
+} while(0)
+
+/**
+ * add_many_cols_simd then ADD_MANY_COLS for the columns it left
+ */
+static void add_many_cols(
+  uint8_t* r, uint8_t* q, const uint8_t* const* t, size_t n, size_t m,
+  size_t span, uint64_t base)
+{
+  size_t i = add_many_cols_simd(r, q, t, n, m, span, base);
+  for(size_t k = 0; k < n; ++k)
+    switch(span) {
+      case UI8: ADD_MANY_COLS(uint8_t, r, q, t[k], i, m, base); break;
+      case UI16: ADD_MANY_COLS(uint16_t, r, q, t[k], i, m, base); break;
+      case UI32: ADD_MANY_COLS(uint32_t, r, q, t[k], i, m, base); break;
+      case UI64: ADD_MANY_COLS(uint64_t, r, q, t[k], i, m, base); break;
+    }
+}
+
+/**
+ * d = the sum of the n terms (limbs t, sizes tn) over dn limbs, where n
+ * is small enough for every q to be a digit. d may alias any term since
+ * a block is only written once all of them have been read. Returns the
+ * carry out of the top (< base)
+ */
+static uint64_t add_many_limbs(
+  uint8_t* d, size_t dn,
+  const uint8_t* const* t, const size_t* tn, size_t n,
+  size_t span, uint64_t base)
+{
+  uint64_t rbuf[ADD_MANY_BLOCK];
+  uint64_t qbuf[ADD_MANY_BLOCK + 1];
+  uint8_t* r = (uint8_t*)rbuf;
+  uint8_t* q = (uint8_t*)qbuf;
+  uint64_t carry = 0;
+  for(size_t b = 0; b < dn; b += ADD_MANY_BLOCK) {
+    size_t len = dn - b < ADD_MANY_BLOCK ? dn - b : ADD_MANY_BLOCK;
+    memset(r, 0, len * span);
+    memset(q, 0, (len + 1) * span);
+    limb_set(q, 0, span, carry);
+
+    // Column j's wraps land in q[j + 1], already shifted up a limb. Terms
+    // covering the whole block go through together
+    const uint8_t* full[ADD_MANY_TERMS];
+    size_t nfull = 0;
+    for(size_t k = 0; k < n; ++k) {
+      if(tn[k] <= b)
+        continue;
+      const uint8_t* tk = LIMB_PTR(t[k], b, span);
+      if(tn[k] - b >= len)
+        full[nfull++] = tk;
+      else
+        add_many_cols(r, q + span, &tk, 1, tn[k] - b, span, base);
+    }
+    add_many_cols(r, q + span, full, nfull, len, span, base);
+
+    uint64_t c = limbs_add(LIMB_PTR(d, b, span), r, len, q, len, span, base);
+    carry = limb_get(q, len, span) + c;
+  }
+  return carry;
+}
+
+/**
+ * dest = terms[0] + ... + terms[n - 1] in one pass, for n <= ADD_MANY_TERMS
+ * small enough that the block carries stay digits
+ */
+static int add_many_pass(
+    struct big_uint* dest,
+    const struct big_uint* const* terms,
+    size_t n)
+{
+  size_t dn = 0;
+  for(size_t k = 0; k < n; ++k)
+    dn = terms[k]->size > dn ? terms[k]->size : dn;
+  STATS_OP(BI_OP_ADD_MANY, dn * n, dest->span);
+  if(ensure_capacity_big_enough(dest, dn + 1))
+    return -1;
+
+  // Read after growing, dest may be a term
+  const uint8_t* t[ADD_MANY_TERMS];
+  size_t tn[ADD_MANY_TERMS];
+  for(size_t k = 0; k < n; ++k) {
+    t[k] = terms[k]->data;
+    tn[k] = terms[k]->size;
+  }
+  limb_set(dest->data, dn, dest->span, add_many_limbs(dest->data, dn, t, tn, n, dest->span, dest->base));
+  dest->size = limbs_strip(dest->data, dn + 1, dest->span);
+  return 0;
+}
+
+int bi_add_many(
+    struct big_uint* dest,
+    const struct big_uint* const* terms,
+    size_t n)
+{
+  uint64_t base = dest->base;
+  for(size_t k = 0; k < n; ++k)
+    if(terms[k]->base != base) {
+      bi_error("Can only add big ints with the same base\n");
+      return -1;
+    }
+
+  // The carry a block hands up (at most n + 1) has to stay a digit, so
+  // small bases take fewer terms a pass. Bases 2 and 3 just run bi_add_bi
+  size_t per_pass = base == BI_BASE_2_64 || base >= ADD_MANY_TERMS + 2
+                    ? ADD_MANY_TERMS : base - 2;
+  if(n <= per_pass)
+    return add_many_pass(dest, terms, n);
+
+  // Every further pass folds the running sum in as its first term, so
+  // there is only ever one partial sum whatever n is. dest may be any of
+  // the terms, so it's only written at the end
+  struct big_uint part;
+  if(bi_init_base(&part, 0, base))
+    return -1;
+  int ret = 0;
+  if(per_pass < 2) {
+    for(size_t k = 0; k < n && !ret; ++k)
+      ret = bi_add_bi(&part, terms[k]);
+  } else {
+    const struct big_uint* pass[ADD_MANY_TERMS];
+    pass[0] = &part;
+    for(size_t k = 0; k < n && !ret;) {
+      size_t take = n - k < per_pass - 1 ? n - k : per_pass - 1;
+      memcpy(pass + 1, terms + k, take * sizeof(*pass));
+      ret = add_many_pass(&part, pass, take + 1);
+      k += take;
+    }
+  }
+  ret = ret || bi_set_limbs(dest, part.data, part.size);
+  bi_free(&part);
+  return -ret;
+}
+
+/**
+ * bi_add_many against repeated bi_add_bi, n terms of up to [size] limbs
+ * (every other one shorter), with dest also being the first term
+ */
+static int test_bi_add_many_once(uint64_t base, size_t n, size_t size)
+{
+  struct big_uint terms[70];
+  const struct big_uint* ptrs[70];
+  struct big_uint ref;
+  struct big_uint sum;
+  int ret = bi_init_base(&ref, 0, base) || bi_init_base(&sum, 0, base);
+  for(size_t k = 0; k < n; ++k) {
+    ret = bi_init_base(&terms[k], 0, base) || ret;
+    ret = ret || test_rand_bi(&terms[k], k % 2 ? 1 + test_rand() % size : size);
+    ptrs[k] = &terms[k];
+  }
+  // All base - 1 limbs carry the whole way
+  if(!ret && n > 1)
+    for(size_t i = 0; i < terms[1].size; ++i)
+      limb_set(terms[1].data, i, terms[1].span, base - 1);
+
+  for(size_t k = 0; k < n && !ret; ++k)
+    ret = bi_add_bi(&ref, &terms[k]);
+  ret = ret || bi_add_many(&sum, ptrs, n)
+        || limbs_cmp(sum.data, sum.size, ref.data, ref.size, sum.span)
+        || (n && (bi_add_many(&terms[0], ptrs, n)
+                  || limbs_cmp(terms[0].data, terms[0].size, ref.data, ref.size, sum.span)));
+
+  if(ret)
+    bi_test_failed("bi_add_many (base = %" PRIu64 ", n = %zu, size = %zu)\n", base, n, size);
+  else
+    bi_test_passed("bi_add_many (base = %" PRIu64 ", n = %zu, size = %zu)\n", base, n, size);
+  for(size_t k = 0; k < n; ++k)
+    bi_free(&terms[k]);
+  bi_free(&sum);
+  bi_free(&ref);
+  return ret;
+}
+
+/**
+ * n one or two limb terms against a running bi_add_bi
+ */
+static int test_bi_add_many_large(uint64_t base, size_t n)
+{
+  struct big_uint* terms = malloc(n * sizeof(struct big_uint));
+  const struct big_uint** ptrs = malloc(n * sizeof(*ptrs));
+  struct big_uint ref, sum;
+  int ret = !terms || !ptrs || bi_init_base(&ref, 0, base) || bi_init_base(&sum, 0, base);
+  size_t made = 0;
+  for(; !ret && made < n; ++made) {
+    ret = bi_init_base(&terms[made], 0, base)
+          || test_rand_bi(&terms[made], 1 + made % 2)
+          || bi_add_bi(&ref, &terms[made]);
+    ptrs[made] = &terms[made];
+  }
+  ret = ret || bi_add_many(&sum, ptrs, n)
+        || limbs_cmp(sum.data, sum.size, ref.data, ref.size, sum.span);
+
+  if(ret)
+    bi_test_failed("bi_add_many (base = %" PRIu64 ", n = %zu terms)\n", base, n);
+  else
+    bi_test_passed("bi_add_many (base = %" PRIu64 ", n = %zu terms)\n", base, n);
+  for(size_t k = 0; k < made; ++k)
+    bi_free(&terms[k]);
+  free(terms);
+  free(ptrs);
+  bi_free(&sum);
+  bi_free(&ref);
+  return ret;
+}
+
+int test_bi_add_many()
+{
+  int ret = 0;
+  uint64_t bases[] = { 2, 10, 200, 60000, 1000000000, MAX_BASE, BI_BASE_2_64 };
+  size_t ns[] = { 0, 1, 2, 4, 65, 70 };
+  size_t sizes[] = { 1, 600, 3000 };
+  int saved = simd_add_level_get();
+  for(int level = 0; level <= saved; ++level) {
+    simd_add_level = level;
+    for(size_t i = 0; i < sizeof(bases) / sizeof(bases[0]); ++i)
+      for(size_t j = 0; j < sizeof(ns) / sizeof(ns[0]); ++j)
+        for(size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); ++k)
+          ret = test_bi_add_many_once(bases[i], ns[j], sizes[k]) || ret;
+  }
+  simd_add_level = saved;
+
+  struct big_uint a, b;
+  const struct big_uint* mixed[] = { &a, &b };
+  bi_init(&a, 1, 10);
+  bi_init(&b, 1, 100);
+  int fail = !bi_add_many(&a, mixed, 2);
+  if(fail)
+    bi_test_failed("bi_add_many different bases\n");
+  else
+    bi_test_passed("bi_add_many different bases\n");
+  bi_free(&a);
+  bi_free(&b);
+  ret = ret || fail;
+
+  // Far more terms than a pass takes, which used to recurse once a pass
+  uint64_t many_bases[] = { 2, 7, 10, BI_BASE_2_64 };
+  size_t many_ns[] = { 1000, 20000 };
+  for(size_t i = 0; i < sizeof(many_bases) / sizeof(many_bases[0]); ++i)
+    for(size_t j = 0; j < sizeof(many_ns) / sizeof(many_ns[0]); ++j)
+      ret = test_bi_add_many_large(many_bases[i], many_ns[j]) || ret;
+  return -ret;
+}
+
+////////////////////////////////////////////// Streaming Input
+size_t bi_from_fd_chunk = (size_t)1 << 20;
+
+#define FD_SLOTS 3
+#define FD_READ_BYTES 65536
+
+/**
+ * The reader thread turns the raw bytes into digit values, one chunk at a
+ * time, in a ring of FD_SLOTS buffers. It blocks when the ring is full, so
+ * only a few chunks are ever held however long the input is. A consumer
+ * that gives up also writes to [wake], which gets the reader out of a
+ * poll on an idle fd
+ */
+struct fd_stream {
+  int fd;
+  int wake[2];
+  uint64_t base;
+  size_t chunk;
+  uint8_t* slots[FD_SLOTS];
+  size_t lens[FD_SLOTS];
+  size_t produced;  // Chunks handed over so far
+  size_t consumed;
+  int eof;          // The last produced chunk is the final (short) one
+  int err;
+  int stop;         // The consumer gave up
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+/**
+ * Digit value of c, -2 for whitespace and -1 for anything else
+ */
+static int fd_digit(unsigned char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A' + 10;
+  if (c == ' ' || (c >= '\t' && c <= '\r'))
+    return -2;
+  return -1;
+}
+
+static void* fd_reader(void* arg)
+{
+  struct fd_stream* s = arg;
+  char* raw = malloc(FD_READ_BYTES);
+  size_t have = 0, pos = 0;
+  int eof = 0, err = !raw;
+  if (err)
+    bi_error("Couldn't allocate data in bi_from_fd\n");
+
+  do {
+    pthread_mutex_lock(&s->lock);
+    while (s->produced - s->consumed == FD_SLOTS && !s->stop)
+      pthread_cond_wait(&s->cond, &s->lock);
+    int stop = s->stop;
+    size_t slot = s->produced % FD_SLOTS;
+    pthread_mutex_unlock(&s->lock);
+    if (stop)
+      break;
+
+    uint8_t* out = s->slots[slot];
+    size_t len = 0;
+    while (!err && len < s->chunk) {
+      if (pos == have) {
+        struct pollfd p[2] = { { s->fd, POLLIN, 0 }, { s->wake[0], POLLIN, 0 } };
+        if (poll(p, 2, -1) < 0) {
+          if (errno == EINTR)
+            continue;
+          bi_error("Couldn't poll fd %d\n", s->fd);
+          err = 1;
+          break;
+        }
+        if (p[1].revents) {
+          free(raw);
+          return NULL;
+        }
+        ssize_t got = read(s->fd, raw, FD_READ_BYTES);
+        if (got < 0 && errno == EINTR)
+          continue;
+        if (got < 0) {
+          bi_error("Couldn't read from fd %d\n", s->fd);
+          err = 1;
+        }
+        if (got <= 0) {
+          eof = 1;
+          break;
+        }
+        have = (size_t)got;
+        pos = 0;
+      }
+      for (; pos < have && len < s->chunk; ++pos) {
+        int d = fd_digit((unsigned char)raw[pos]);
+        if (d >= 0 && (uint64_t)d < s->base) {
+          out[len++] = (uint8_t)d;
+        } else if (d != -2) {
+          bi_error("Invalid base %" PRIu64 " digit '%c'\n", s->base, raw[pos]);
+          err = 1;
+          break;
+        }
+      }
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->lens[slot] = len;
+    s->produced++;
+    s->eof = eof;
+    s->err = err;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+  } while (!eof && !err);
+
+  free(raw);
+  return NULL;
+}
+
+/**
+ * dest (zero) = the n digits (most significant first) in base B, packed
+ * into words of g digits in base w = B^g
+ */
+static int fd_convert(
+  struct big_uint* dest,
+  const uint8_t* digits, size_t n,
+  uint64_t B, size_t g, uint64_t w,
+  uint64_t* words)
+{
+  size_t nw = (n + g - 1) / g;
+  for (size_t j = 0; j < nw; ++j) {
+    size_t hi = n - g * j;
+    size_t lo = hi > g ? hi - g : 0;
+    uint64_t word = 0;
+    for (size_t i = lo; i < hi; ++i)
+      word = word * B + digits[i];
+    words[j] = word;
+  }
+  return nw ? convert_from_words(dest, words, nw, w) : 0;
+}
+
+/**
+ * dest (zero) = B^e, as the words of a 1 followed by e zeros
+ */
+static int fd_pow(struct big_uint* dest, uint64_t B, size_t g, uint64_t w, size_t e)
+{
+  uint64_t* words = calloc(e / g + 1, sizeof(uint64_t));
+  if (!words)
+    return -1;
+  words[e / g] = 1;
+  for (size_t i = 0; i < e % g; ++i)
+    words[e / g] *= B;
+  int ret = convert_from_words(dest, words, e / g + 1, w);
+  free(words);
+  return ret;
+}
+
+/**
+ * Chunk values waiting to be merged: seg[i] holds chunk 2^level digits,
+ * and levels strictly drop towards the top like a binary counter.
+ * pow[k] = B^(chunk 2^k) in dest's base
+ */
+struct fd_merge {
+  struct big_uint seg[64];
+  int level[64];
+  size_t nseg;
+  struct big_uint pow[64];
+  size_t npow;
+};
+
+static int fd_merge_pow(struct fd_merge* m, int k, uint64_t B, size_t g, uint64_t w, size_t chunk, uint64_t base)
+{
+  for (; m->npow <= (size_t)k; m->npow++) {
+    struct big_uint* p = &m->pow[m->npow];
+    if (bi_init_base(p, 0, base))
+      return -1;
+    int ret = m->npow ? bi_mul_bi(p, &m->pow[m->npow - 1], &m->pow[m->npow - 1])
+                      : fd_pow(p, B, g, w, chunk);
+    if (ret) {
+      bi_free(p);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int bi_from_fd(
+    struct big_uint* dest,
+    int fd,
+    uint64_t input_base)
+{
+  if (input_base < 2 || input_base > 36) {
+    bi_error("Invalid input base: %" PRIu64 ". Required: 2 <= base <= 36\n", input_base);
+    return -1;
+  }
+  size_t chunk = bi_from_fd_chunk ? bi_from_fd_chunk : 1;
+
+  // Largest g with B^g a word, the same packing bi_from_str does with 10^19
+  size_t g = 1;
+  uint64_t w = input_base;
+  while (w <= UINT64_MAX / input_base) {
+    w *= input_base;
+    g++;
+  }
+
+  struct fd_stream s = {
+    .fd = fd,
+    .wake = { -1, -1 },
+    .base = input_base,
+    .chunk = chunk,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+  };
+  struct fd_merge* m = calloc(1, sizeof(struct fd_merge));
+  uint64_t* words = malloc((chunk / g + 1) * sizeof(uint64_t));
+  int ret = !m || !words;
+  for (size_t i = 0; i < FD_SLOTS; ++i)
+    ret = ret || !(s.slots[i] = malloc(chunk));
+  pthread_t th;
+  if (ret || pipe(s.wake) || pthread_create(&th, NULL, fd_reader, &s)) {
+    bi_error("Couldn't start reading fd %d\n", fd);
+    if (s.wake[0] >= 0) {
+      close(s.wake[0]);
+      close(s.wake[1]);
+    }
+    for (size_t i = 0; i < FD_SLOTS; ++i)
+      free(s.slots[i]);
+    free(words);
+    free(m);
+    return -1;
+  }
+
+  size_t total = 0;
+  struct big_uint acc, accpow, t;
+  bi_init_base(&acc, 0, dest->base);
+  bi_init_base(&accpow, 0, dest->base);
+  bi_init_base(&t, 0, dest->base);
+  for (int last = 0; !ret && !last;) {
+    pthread_mutex_lock(&s.lock);
+    while (s.consumed == s.produced)
+      pthread_cond_wait(&s.cond, &s.lock);
+    size_t slot = s.consumed % FD_SLOTS;
+    size_t len = s.lens[slot];
+    last = s.eof && s.consumed + 1 == s.produced;
+    ret = s.err;
+    pthread_mutex_unlock(&s.lock);
+    if (ret)
+      break;
+
+    total += len;
+    STATS_OP(BI_OP_FROM_STR, len, 0);
+    if (last) {
+      // The short tail is the lowest part: fold the segments on top of it
+      ret = fd_convert(&acc, s.slots[slot], len, input_base, g, w, words)
+            || fd_pow(&accpow, input_base, g, w, len);
+    } else {
+      struct big_uint* top = &m->seg[m->nseg];
+      m->level[m->nseg++] = 0;
+      ret = bi_init_base(top, 0, dest->base)
+            || fd_convert(top, s.slots[slot], len, input_base, g, w, words);
+      while (!ret && m->nseg > 1 && m->level[m->nseg - 1] == m->level[m->nseg - 2]) {
+        int k = m->level[m->nseg - 1];
+        struct big_uint* hi = &m->seg[m->nseg - 2];
+        ret = fd_merge_pow(m, k, input_base, g, w, chunk, dest->base)
+              || bi_mul_bi(hi, hi, &m->pow[k])
+              || bi_add_bi(hi, &m->seg[m->nseg - 1]);
+        bi_free(&m->seg[--m->nseg]);
+        m->level[m->nseg - 1]++;
+      }
+    }
+
+    pthread_mutex_lock(&s.lock);
+    s.consumed++;
+    s.stop = ret;
+    pthread_cond_broadcast(&s.cond);
+    pthread_mutex_unlock(&s.lock);
+  }
+  // The reader may be waiting on an fd nobody writes to any more
+  if (ret && write(s.wake[1], "", 1) < 0)
+    bi_error("Couldn't stop the reader of fd %d\n", fd);
+  pthread_join(th, NULL);
+  close(s.wake[0]);
+  close(s.wake[1]);
+
+  if (!ret && !total) {
+    bi_error("Can't parse an empty stream\n");
+    ret = -1;
+  }
+  for (size_t i = m->nseg; !ret && i-- > 0;) {
+    ret = bi_mul_bi(&t, &m->seg[i], &accpow) || bi_add_bi(&acc, &t);
+    if (!ret && i)
+      ret = fd_merge_pow(m, m->level[i], input_base, g, w, chunk, dest->base)
+            || bi_mul_bi(&accpow, &accpow, &m->pow[m->level[i]]);
+  }
+  ret = ret || bi_set_limbs(dest, acc.data, acc.size);
+
+  for (size_t i = 0; i < m->nseg; ++i)
+    bi_free(&m->seg[i]);
+  for (size_t i = 0; i < m->npow; ++i)
+    bi_free(&m->pow[i]);
+  for (size_t i = 0; i < FD_SLOTS; ++i)
+    free(s.slots[i]);
+  bi_free(&acc);
+  bi_free(&accpow);
+  bi_free(&t);
+  free(words);
+  free(m);
+  return ret ? -1 : 0;
+}
+
+/**
+ * Parses [digits] through a tmpfile with the given chunk size and checks
+ * it against [expected]
+ */
+static int test_bi_from_fd_once(
+  const char* digits, size_t chunk, uint64_t input_base,
+  const struct big_uint* expected)
+{
+  struct big_uint bi;
+  bi_init_base(&bi, 7, expected->base);
+  FILE* f = tmpfile();
+  size_t len = strlen(digits);
+  size_t saved = bi_from_fd_chunk;
+  bi_from_fd_chunk = chunk;
+  int ret = !f || fwrite(digits, 1, len, f) != len || fflush(f);
+  if (!ret)
+    rewind(f);
+  ret = ret || bi_from_fd(&bi, fileno(f), input_base)
+        || limbs_cmp(bi.data, bi.size, expected->data, expected->size, bi.span);
+  bi_from_fd_chunk = saved;
+
+  if (ret)
+    bi_test_failed("bi_from_fd(%zu chars, chunk = %zu, %" PRIu64 " -> %" PRIu64 ")\n", len, chunk, input_base, expected->base);
+  else
+    bi_test_passed("bi_from_fd(%zu chars, chunk = %zu, %" PRIu64 " -> %" PRIu64 ")\n", len, chunk, input_base, expected->base);
+  if (f)
+    fclose(f);
+  bi_free(&bi);
+  return ret;
+}
+
+/**
+ * A pipe written to in odd sized pieces must parse the same as a file
+ */
+struct test_fd_pipe {
+  int fd;
+  const char* digits;
+};
+
+static void* test_bi_from_fd_writer(void* arg)
+{
+  struct test_fd_pipe* p = arg;
+  size_t len = strlen(p->digits);
+  for (size_t i = 0; i < len;) {
+    size_t n = len - i < 97 ? len - i : 97;
+    ssize_t w = write(p->fd, p->digits + i, n);
+    if (w <= 0)
+      break;
+    i += (size_t)w;
+  }
+  close(p->fd);
+  return NULL;
+}
+
+/**
+ * Every heap allocation fails, values can only use their inline limbs.
+ * Failing takes a while, which leaves the reader thread time to block
+ */
+static void* test_fd_alloc(void* ctx, size_t bytes)
+{
+  (void)ctx; (void)bytes;
+  usleep(100000);
+  return NULL;
+}
+
+static void* test_fd_resize(void* ctx, void* p, size_t old_bytes, size_t new_bytes)
+{
+  (void)ctx; (void)p; (void)old_bytes; (void)new_bytes;
+  usleep(100000);
+  return NULL;
+}
+
+static void test_fd_free(void* ctx, void* p, size_t bytes)
+{
+  (void)ctx; (void)bytes;
+  free(p);
+}
+
+static const struct bi_allocator test_fd_no_memory = {
+  test_fd_alloc, test_fd_resize, test_fd_free, NULL
+};
+
+int test_bi_from_fd()
+{
+  int ret = 0;
+  uint64_t in_bases[] = { 2, 10, 16, 36 };
+  uint64_t out_bases[] = { 10, 1000000000, MAX_BASE, BI_BASE_2_64, 7 };
+  size_t chunks[] = { 1, 7, 64, 1000, 1 << 20 };
+  size_t n = 3000;
+  char* digits = malloc(n + n / 50 + 1);
+  for (size_t ib = 0; ib < sizeof(in_bases) / sizeof(in_bases[0]); ++ib) {
+    uint64_t B = in_bases[ib];
+    // Random digits in both cases, a leading zero and some whitespace
+    size_t len = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (i && i % 50 == 0)
+        digits[len++] = i % 100 ? ' ' : '\n';
+      int d = i ? (int)(test_rand() % B) : 0;
+      digits[len++] = (char)(d < 10 ? '0' + d : (test_rand() & 1 ? 'a' : 'A') + d - 10);
+    }
+    digits[len] = 0;
+
+    for (size_t ob = 0; ob < sizeof(out_bases) / sizeof(out_bases[0]); ++ob) {
+      // Reference by Horner's rule, one digit at a time
+      struct big_uint expected;
+      if (out_bases[ob] == BI_BASE_2_64)
+        bi_init_bin(&expected, 0);
+      else
+        bi_init(&expected, 0, out_bases[ob]);
+      ensure_capacity_big_enough(&expected, 6 * n + 2);
+      for (size_t i = 0; i < len; ++i) {
+        int d = fd_digit((unsigned char)digits[i]);
+        if (d >= 0)
+          bi_mul_add_word(&expected, B, (uint64_t)d);
+      }
+      for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c)
+        if (chunks[c] > 1 || ob == 0)
+          ret |= test_bi_from_fd_once(digits, chunks[c], B, &expected);
+      bi_free(&expected);
+    }
+  }
+
+  // Decimal through a pipe against bi_from_str
+  struct big_uint a, b;
+  bi_init(&a, 0, 1000);
+  bi_init(&b, 0, 1000);
+  for (size_t i = 0; i < n; ++i)
+    digits[i] = (char)('0' + test_rand() % 10);
+  digits[n] = 0;
+  int fds[2];
+  pthread_t th;
+  size_t saved = bi_from_fd_chunk;
+  bi_from_fd_chunk = 100;
+  int fail = pipe(fds);
+  struct test_fd_pipe p = { fail ? -1 : fds[1], digits };
+  fail = fail || pthread_create(&th, NULL, test_bi_from_fd_writer, &p);
+  if (!fail) {
+    fail = bi_from_fd(&a, fds[0], 10);
+    pthread_join(th, NULL);
+    close(fds[0]);
+  }
+  bi_from_fd_chunk = saved;
+  fail = fail || bi_from_str(&b, digits) || limbs_cmp(a.data, a.size, b.data, b.size, a.span);
+  if (fail)
+    bi_test_failed("bi_from_fd pipe\n");
+  else
+    bi_test_passed("bi_from_fd pipe\n");
+  ret |= fail;
+
+  // Bad digits (also ones valid in a larger base), empty input, bad base
+  const char* bad[] = { "12x4", "1019", "", " \n\t", "123-" };
+  uint64_t bad_bases[] = { 10, 9, 10, 10, 10 };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    FILE* f = tmpfile();
+    fail = !f || fputs(bad[i], f) == EOF || fflush(f);
+    if (f)
+      rewind(f);
+    fail = fail || bi_from_fd(&a, fileno(f), bad_bases[i]) != -1;
+    if (fail)
+      bi_test_failed("bi_from_fd rejects \"%s\"\n", bad[i]);
+    else
+      bi_test_passed("bi_from_fd rejects \"%s\"\n", bad[i]);
+    ret |= fail;
+    if (f)
+      fclose(f);
+  }
+  fail = bi_from_fd(&a, 0, 37) != -1 || bi_from_fd(&a, 0, 1) != -1;
+  if (fail)
+    bi_test_failed("bi_from_fd invalid input base\n");
+  else
+    bi_test_passed("bi_from_fd invalid input base\n");
+  ret |= fail;
+
+  // The conversion fails while the writer keeps the pipe open and idle:
+  // the reader has to be woken rather than joined as it waits
+  // (converting even the first chunk needs the heap, and while that
+  // fails the reader runs out of input waiting for a second one)
+  const char* start = "12345678901234567890";
+  bi_from_fd_chunk = 20;
+  fail = pipe(fds);
+  if (!fail) {
+    fail = write(fds[1], start, strlen(start)) != (ssize_t)strlen(start);
+    bi_set_default_allocator(&test_fd_no_memory);
+    struct big_uint c;
+    bi_init_base(&c, 0, 10);
+    fail = fail || bi_from_fd(&c, fds[0], 10) != -1;
+    bi_set_default_allocator(NULL);
+    bi_free(&c);
+    close(fds[0]);
+    close(fds[1]);
+  }
+  bi_from_fd_chunk = saved;
+  if (fail)
+    bi_test_failed("bi_from_fd stops a reader blocked on an idle pipe\n");
+  else
+    bi_test_passed("bi_from_fd stops a reader blocked on an idle pipe\n");
+  ret |= fail;
+
+  bi_free(&a);
+  bi_free(&b);
+  free(digits);
+  return -ret;
+}
+
+////////////////////////////////////////////// Scalar Arithmetic
+int bi_mul_add_sc(
+    struct big_uint* dest,
+    uint64_t mul,
+    uint64_t add)
+{
+  // The carry out of the top limb is below 2^64, which takes this many
+  size_t per = dest->base == BI_BASE_2_64 ? 1 : 64 / (63 - __builtin_clzl(dest->base)) + 1;
+  if (ensure_capacity_big_enough(dest, dest->size + per))
+    return -1;
+  bi_mul_add_word(dest, mul, add);
+  dest->size = limbs_strip(dest->data, dest->size, dest->span);
+  return 0;
+}
+
+int bi_mul_sc(
+    struct big_uint* dest,
+    uint64_t right)
+{
+  return bi_mul_add_sc(dest, right, 0);
+}
+
+int bi_divmod_sc(
+    struct big_uint* dest,
+    uint64_t divisor,
+    uint64_t* rem)
+{
+  if (!divisor) {
+    bi_error("Division by zero\n");
+    return -1;
+  }
+  uint64_t r = limbs_divmod_1(dest->data, dest->data, dest->size, divisor, dest->span, dest->base);
+  dest->size = limbs_strip(dest->data, dest->size, dest->span);
+  if (rem)
+    *rem = r;
+  return 0;
+}
+
+static int test_recip_divmod()
+{
+  int ret = 0;
+  uint64_t divisors[] = { 1, 2, 3, 10, 1000000000, MAX_BASE, 1lu << 63, UINT64_MAX, 0 };
+  for (size_t k = 0; k < sizeof(divisors) / sizeof(divisors[0]); ++k) {
+    for (int i = 0; !ret && i < 10000; ++i) {
+      uint64_t d = divisors[k] ? divisors[k] : test_rand() >> (test_rand() % 64);
+      if (!d)
+        d = 1;
+      struct recip r = recip_init(d);
+      // Edges of the hi < d range as well as random words
+      uint64_t hi = i < 2 ? (i ? d - 1 : 0) : test_rand() % d;
+      uint64_t lo = i == 1 ? UINT64_MAX : test_rand();
+      uint64_t r1, r2;
+      uint64_t q1 = dw_divmod(hi, lo, d, &r1);
+      uint64_t q2 = recip_divmod(hi, lo, &r, &r2);
+      if (q1 != q2 || r1 != r2) {
+        bi_test_failed("recip_divmod(%" PRIu64 ":%" PRIu64 " / %" PRIu64 ")\n", hi, lo, d);
+        ret = -1;
+      }
+    }
+  }
+  if (!ret)
+    bi_test_passed("recip_divmod\n");
+  return ret;
+}
+
+/**
+ * x * m + c checked against bi_mul_bi, then divided back by m
+ */
+static int test_bi_scalar_once(uint64_t base, size_t n, uint64_t m, uint64_t c)
+{
+  struct big_uint x, y, mb;
+  bi_init_base(&x, 0, base);
+  bi_init_base(&y, 0, base);
+  bi_init_base(&mb, m, base);
+  int ret = test_rand_bi(&x, n) || bi_add_bi(&y, &x);
+
+  // y = x * m + c the long way
+  ret = ret || bi_mul_bi(&y, &y, &mb) || bi_add_sc(&y, c);
+  ret = ret || bi_mul_add_sc(&x, m, c)
+            || limbs_cmp(x.data, x.size, y.data, y.size, x.span);
+
+  // (x m + c) / m = x with c % m left over (x m + c fits the quotient)
+  uint64_t rem = 0;
+  if (!ret && m) {
+    ret = bi_divmod_sc(&x, m, &rem) || rem != c % m || bi_mul_add_sc(&x, m, rem)
+          || limbs_cmp(x.data, x.size, y.data, y.size, x.span);
+  }
+  ret = ret || (x.size && !limb_get(x.data, x.size - 1, x.span));
+
+  if (ret)
+    bi_test_failed("bi_mul_add_sc / bi_divmod_sc(%zu limbs * %" PRIu64 " + %" PRIu64 ", base = %" PRIu64 ")\n", n, m, c, base);
+  else
+    bi_test_passed("bi_mul_add_sc / bi_divmod_sc(%zu limbs * %" PRIu64 " + %" PRIu64 ", base = %" PRIu64 ")\n", n, m, c, base);
+  bi_free(&x);
+  bi_free(&y);
+  bi_free(&mb);
+  return ret;
+}
+
+int test_bi_scalar()
+{
+  int ret = test_recip_divmod();
+  uint64_t bases[] = { 2, 10, 200, 60000, 1000000000, MAX_BASE, BI_BASE_2_64 };
+  size_t sizes[] = { 0, 1, 2, 40, 300 };
+  for (size_t b = 0; b < sizeof(bases) / sizeof(bases[0]); ++b) {
+    uint64_t base = bases[b];
+    uint64_t ms[] = { 0, 1, base ? base - 1 : 2, base ? base : 3, UINT64_MAX, test_rand() };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+      for (size_t k = 0; k < sizeof(ms) / sizeof(ms[0]); ++k)
+        ret |= test_bi_scalar_once(base, sizes[s], ms[k], k % 2 ? UINT64_MAX : test_rand() >> 20);
+  }
+
+  // A hand built value (no stored reciprocal, room for any carry) and a
+  // zero divisor
+  uint64_t digits[32] = { 9, 9, 9 };
+  struct big_uint hand = { .data = (uint8_t*)digits, .size = 3, .capacity = sizeof(digits),
+                           .base = 10, .span = UI64 };
+  uint64_t rem;
+  int fail = bi_mul_add_sc(&hand, 1, 1) || hand.size != 4 || digits[3] != 1 || digits[0]
+             || bi_divmod_sc(&hand, 7, &rem) || rem != 6 || hand.size != 3 || digits[0] != 2
+             || !bi_divmod_sc(&hand, 0, NULL);
+  if (fail)
+    bi_test_failed("bi_mul_add_sc / bi_divmod_sc edge cases\n");
+  else
+    bi_test_passed("bi_mul_add_sc / bi_divmod_sc edge cases\n");
+  return -(ret || fail);
+}
+
+////////////////////////////////////////////// Hashing
+/**
+ * Whether the n bytes at a and b match. The vector kernels XOR whole
+ * blocks together and only test the OR of them, so the common equal case
+ * costs one branch per 64 bytes
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+TARGET_AVX2 static int bytes_eq_avx2(const uint8_t* a, const uint8_t* b, size_t n)
+{
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                 _mm256_loadu_si256((const __m256i*)(b + i)));
+    __m256i y = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i + 32)),
+                                 _mm256_loadu_si256((const __m256i*)(b + i + 32)));
+    x = _mm256_or_si256(x, y);
+    if (!_mm256_testz_si256(x, x))
+      return 0;
+  }
+  if (i + 32 <= n) {
+    __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                 _mm256_loadu_si256((const __m256i*)(b + i)));
+    if (!_mm256_testz_si256(x, x))
+      return 0;
+    i += 32;
+  }
+  return !memcmp(a + i, b + i, n - i);
+}
+
+TARGET_AVX512 static int bytes_eq_avx512(const uint8_t* a, const uint8_t* b, size_t n)
+{
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64)
+    if (_mm512_cmpneq_epu8_mask(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i)))
+      return 0;
+  // Masked loads don't touch the bytes past n
+  __mmask64 m = n - i ? ~0ull >> (64 - (n - i)) : 0;
+  return !_mm512_mask_cmpneq_epu8_mask(m, _mm512_maskz_loadu_epi8(m, a + i), _mm512_maskz_loadu_epi8(m, b + i));
+}
+#endif
+
+static int bytes_eq(const uint8_t* a, const uint8_t* b, size_t n)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+  switch(simd_add_level_get()) {
+    case 2:
+      return bytes_eq_avx512(a, b, n);
+    case 1:
+      return bytes_eq_avx2(a, b, n);
+  }
+#endif
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t x, y;
+    memcpy(&x, a + i, 8);
+    memcpy(&y, b + i, 8);
+    if (x != y)
+      return 0;
+  }
+  for (; i < n; ++i)
+    if (a[i] != b[i])
+      return 0;
+  return 1;
+}
+
+#define HASH_K0 0xa0761d6478bd642full
+#define HASH_K1 0xe7037ed1a0b428dbull
+#define HASH_K2 0x8ebc6af09c88c6e3ull
+#define HASH_K3 0x589965cc75374cc3ull
+
+/**
+ * Folds the full 128 bit product, so every input bit reaches every output
+ * bit in one multiply
+ */
+static inline uint64_t hash_mix(uint64_t a, uint64_t b)
+{
+  unsigned __int128 r = (unsigned __int128)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t hash_read(const uint8_t* p)
+{
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+/**
+ * Multiply-mix hash of n bytes (not meant to resist chosen inputs). Four
+ * independent lanes take 64 bytes a step so the multiplies overlap
+ */
+static uint64_t bytes_hash(const uint8_t* p, size_t n, uint64_t seed)
+{
+  uint64_t h0 = seed ^ HASH_K0, h1 = seed ^ HASH_K1;
+  uint64_t h2 = seed ^ HASH_K2, h3 = seed ^ HASH_K3;
+  size_t i = 0;
+  for (; i + 64 <= n; i += 64) {
+    h0 = hash_mix(hash_read(p + i) ^ HASH_K1, hash_read(p + i + 8) ^ h0);
+    h1 = hash_mix(hash_read(p + i + 16) ^ HASH_K2, hash_read(p + i + 24) ^ h1);
+    h2 = hash_mix(hash_read(p + i + 32) ^ HASH_K3, hash_read(p + i + 40) ^ h2);
+    h3 = hash_mix(hash_read(p + i + 48) ^ HASH_K0, hash_read(p + i + 56) ^ h3);
+  }
+  uint64_t h = h0 ^ hash_mix(h1 ^ HASH_K0, h2 ^ HASH_K3) ^ h3;
+  for (; i + 16 <= n; i += 16)
+    h = hash_mix(hash_read(p + i) ^ HASH_K1, hash_read(p + i + 8) ^ h);
+  if (i < n) {
+    uint64_t t[2] = { 0, 0 };
+    memcpy(t, p + i, n - i);
+    h = hash_mix(t[0] ^ HASH_K1, t[1] ^ h);
+  }
+  return hash_mix(h ^ HASH_K2, (uint64_t)n ^ HASH_K3);
+}
+
+int bi_cmp(
+    const struct big_uint* left,
+    const struct big_uint* right)
+{
+  if (left->base != right->base) {
+    bi_error("Can only compare two big ints if they have the same base\n");
+    return -2;
+  }
+  return limbs_cmp(left->data, left->size, right->data, right->size, left->span);
+}
+
+int bi_eq(
+    const struct big_uint* left,
+    const struct big_uint* right)
+{
+  size_t n = limbs_strip(left->data, left->size, left->span);
+  return left->base == right->base
+         && n == limbs_strip(right->data, right->size, right->span)
+         && bytes_eq(left->data, right->data, n * left->span);
+}
+
+uint64_t bi_hash(const struct big_uint* bi)
+{
+  size_t n = limbs_strip(bi->data, bi->size, bi->span);
+  return bytes_hash(bi->data, n * bi->span, bi->base);
+}
+
+int bi_hashmap_init(
+    struct bi_hashmap* map,
+    uint64_t base)
+{
+  if (base != BI_BASE_2_64 && (base < 2 || base > MAX_BASE)) {
+    bi_error("Invalid base: %" PRIu64 ". Required: 2 <= base <= %" PRIu64 "\n", base, MAX_BASE);
+    return -1;
+  }
+  struct bi_hashmap ret = {
+    .hashes = NULL,
+    .keys = NULL,
+    .values = NULL,
+    .count = 0,
+    .capacity = 0,
+    .base = base,
+  };
+  memcpy(map, &ret, sizeof(struct bi_hashmap));
+  return 0;
+}
+
+void bi_hashmap_free(struct bi_hashmap* map)
+{
+  for (size_t i = 0; i < map->capacity; ++i)
+    if (map->hashes[i])
+      bi_free(&map->keys[i]);
+  free(map->hashes);
+  free(map->keys);
+  free(map->values);
+  map->hashes = NULL;
+  map->keys = NULL;
+  map->values = NULL;
+  map->count = 0;
+  map->capacity = 0;
+}
+
+/**
+ * The slot of key's value, or the empty slot that ends its probe run
+ */
+static size_t hashmap_probe(const struct bi_hashmap* map, const struct big_uint* key, uint64_t h, int* found)
+{
+  size_t mask = map->capacity - 1;
+  size_t i = h & mask;
+  // The cached hashes rule out nearly every other key without touching it
+  for (; map->hashes[i]; i = (i + 1) & mask) {
+    if (map->hashes[i] == h && bi_eq(&map->keys[i], key)) {
+      *found = 1;
+      return i;
+    }
+  }
+  *found = 0;
+  return i;
+}
+
+/**
+ * Moves a key between slots (the inline buffer moves with it)
+ */
+static void map_move_key(struct big_uint* to, struct big_uint* from)
+{
+  memcpy((void*)to, from, sizeof(struct big_uint));
+  if (BI_IS_SMALL(from))
+    to->data = (uint8_t*)to->small;
+}
+
+static int hashmap_grow(struct bi_hashmap* map)
+{
+  size_t cap = map->capacity ? 2 * map->capacity : 16;
+  uint64_t* hashes = calloc(cap, sizeof(uint64_t));
+  struct big_uint* keys = malloc(cap * sizeof(struct big_uint));
+  uint64_t* values = malloc(cap * sizeof(uint64_t));
+  if (!hashes || !keys || !values) {
+    bi_error("Couldn't allocate data in bi_hashmap\n");
+    free(hashes);
+    free(keys);
+    free(values);
+    return -1;
+  }
+
+  // Rehoming reuses the cached hashes, no key gets hashed again
+  for (size_t i = 0; i < map->capacity; ++i) {
+    uint64_t h = map->hashes[i];
+    if (!h)
+      continue;
+    size_t j = h & (cap - 1);
+    while (hashes[j])
+      j = (j + 1) & (cap - 1);
+    hashes[j] = h;
+    map_move_key(&keys[j], &map->keys[i]);
+    values[j] = map->values[i];
+  }
+  free(map->hashes);
+  free(map->keys);
+  free(map->values);
+  map->hashes = hashes;
+  map->keys = keys;
+  map->values = values;
+  map->capacity = cap;
+  return 0;
+}
+
+/**
+ * 0 marks empty slots, so a zero hash is stored as 1
+ */
+static uint64_t hashmap_hash(const struct big_uint* key)
+{
+  uint64_t h = bi_hash(key);
+  return h ? h : 1;
+}
+
+uint64_t* bi_hashmap_slot(
+    struct bi_hashmap* map,
+    const struct big_uint* key)
+{
+  if (key->base != map->base) {
+    bi_error("bi_hashmap needs keys of the map's base\n");
+    return NULL;
+  }
+  uint64_t h = hashmap_hash(key);
+  int found = 0;
+  size_t i = 0;
+  if (map->capacity)
+    i = hashmap_probe(map, key, h, &found);
+  if (found)
+    return &map->values[i];
+
+  // Keep the load under 3/4 so probe runs stay short
+  if (4 * (map->count + 1) > 3 * map->capacity) {
+    if (hashmap_grow(map))
+      return NULL;
+    i = hashmap_probe(map, key, h, &found);
+  }
+  struct big_uint* k = &map->keys[i];
+  if (bi_init_base(k, 0, map->base) || bi_set_limbs(k, key->data, key->size)) {
+    bi_free(k);
+    return NULL;
+  }
+  map->hashes[i] = h;
+  map->values[i] = 0;
+  map->count++;
+  return &map->values[i];
+}
 
-  size_t start_cap = 8;
-  struct big_uint ret = {
-    .data = calloc(start_cap, 1),
-    .size = 1,
-    .capacity = start_cap,
-    .base = base,
-    .span = span_from_base(base)
-  };
+int bi_hashmap_insert(
+    struct bi_hashmap* map,
+    const struct big_uint* key)
+{
+  size_t count = map->count;
+  if (!bi_hashmap_slot(map, key))
+    return -1;
+  return map->count != count;
+}
 
-  memcpy(bi, &ret, sizeof(struct big_uint));
+uint64_t* bi_hashmap_find(
+    struct bi_hashmap* map,
+    const struct big_uint* key)
+{
+  if (key->base != map->base || !map->count)
+    return NULL;
+  int found;
+  size_t i = hashmap_probe(map, key, hashmap_hash(key), &found);
+  return found ? &map->values[i] : NULL;
+}
 
-  bi_add_sc(bi, start);
+int bi_hashmap_erase(
+    struct bi_hashmap* map,
+    const struct big_uint* key)
+{
+  if (key->base != map->base || !map->count)
+    return 0;
+  int found;
+  size_t i = hashmap_probe(map, key, hashmap_hash(key), &found);
+  if (!found)
+    return 0;
+  bi_free(&map->keys[i]);
+  map->count--;
 
-  return 0;
+  // Backward shift: pull later entries of the run into the hole unless
+  // that would put them before their home slot
+  size_t mask = map->capacity - 1;
+  for (size_t j = (i + 1) & mask; map->hashes[j]; j = (j + 1) & mask) {
+    size_t home = map->hashes[j] & mask;
+    if (((j - home) & mask) < ((j - i) & mask))
+      continue;
+    map->hashes[i] = map->hashes[j];
+    map_move_key(&map->keys[i], &map->keys[j]);
+    map->values[i] = map->values[j];
+    i = j;
+  }
+  map->hashes[i] = 0;
+  return 1;
 }
 
 /**
- * A simple test that has expected status and actual status
+ * bytes_eq at every SIMD level against memcmp, with one byte flipped at
+ * each position
  */
-static int test_bi_init_status_code_once(uint64_t start, uint64_t base, int status_exp) {
-  struct big_uint bi;
-  memset(&bi, 0, sizeof(struct big_uint));
-  int status_actual = bi_init(&bi, start, base);
-  bi_free(&bi);
-  int ret = -(status_exp != status_actual);
-  
-  if(ret)
-    bi_test_failed("bi_init(start = %" PRIu64 ", base = %" PRIu64 ") - "
-                   "Expected return status: %d, got: %d\n", start, base, status_exp, status_actual);
-  else
-    bi_test_passed("bi_init(start = %" PRIu64 ", base = %" PRIu64 ")\n", start, base);
+static int test_bytes_eq()
+{
+  uint8_t a[300], b[300];
+  for (size_t i = 0; i < sizeof(a); ++i)
+    a[i] = b[i] = (uint8_t)test_rand();
 
+  int saved = simd_add_level_get();
+  int ret = 0;
+  for (int level = 0; level <= saved; ++level) {
+    simd_add_level = level;
+    for (size_t n = 0; !ret && n < sizeof(a); n += n < 70 ? 1 : 37) {
+      ret = !bytes_eq(a, b, n);
+      for (size_t k = 0; !ret && k < n; ++k) {
+        b[k] ^= 1;
+        ret = bytes_eq(a, b, n);
+        b[k] ^= 1;
+      }
+    }
+  }
+  simd_add_level = saved;
+
+  if (ret)
+    bi_test_failed("bytes_eq at every SIMD level\n");
+  else
+    bi_test_passed("bytes_eq at every SIMD level\n");
   return ret;
 }
 
-int test_bi_init()
+/**
+ * Equal values hash and compare equal whatever their capacity, and
+ * bi_cmp agrees with adding one
+ */
+static int test_bi_hash_once(uint64_t base, size_t n)
 {
-  int ret = 0;
-  ret = test_bi_init_status_code_once(0, 0, -1) || ret;
-  ret = test_bi_init_status_code_once(0, 1, -1) || ret;
-  ret = test_bi_init_status_code_once(0, 1lu << 63, -1) || ret;
-  ret = test_bi_init_status_code_once(0, (1lu << 63) - 1, 0) || ret;
-  ret = test_bi_init_status_code_once(0, (uint64_t)-1, -1) || ret;
+  struct big_uint a, b;
+  bi_init_base(&a, 0, base);
+  bi_init_base(&b, 0, base);
+  int ret = test_rand_bi(&a, n) || bi_add_bi(&b, &a) || bi_reserve(&b, 4 * n + 8);
+  ret = ret || !bi_eq(&a, &b) || bi_cmp(&a, &b) || bi_hash(&a) != bi_hash(&b);
+  ret = ret || bi_add_sc(&b, 1) || bi_eq(&a, &b) || bi_cmp(&a, &b) != -1 || bi_cmp(&b, &a) != 1
+            || bi_hash(&a) == bi_hash(&b);
 
+  if (ret)
+    bi_test_failed("bi_eq / bi_cmp / bi_hash(%zu limbs, base = %" PRIu64 ")\n", n, base);
+  else
+    bi_test_passed("bi_eq / bi_cmp / bi_hash(%zu limbs, base = %" PRIu64 ")\n", n, base);
+  bi_free(&a);
+  bi_free(&b);
   return ret;
 }
 
-void bi_free(struct big_uint* bi)
+/**
+ * Counts a pool of distinct values inserted several times each, then
+ * erases every other one
+ */
+static int test_bi_hashmap_once(uint64_t base, size_t distinct)
 {
-  if (bi->data)
-    free(bi->data);
-  bi->data = NULL;
-}
-
-static void bi_print8(const struct big_uint* bi) {
-  uint8_t *data = bi->data;
-  printf("{BI: (size: %zu, capacity: %zu base: %" PRIu64") - ", bi->size, bi->capacity, bi->base);
-  printf("(");
-  for(int i = bi->size - 1; i > 0; --i){
-    printf("%d ", data[i]);
+  struct big_uint* pool = malloc(distinct * sizeof(struct big_uint));
+  struct bi_hashmap map;
+  int ret = !pool || bi_hashmap_init(&map, base);
+  if (ret) {
+    free(pool);
+    return -1;
   }
-  printf("%d)", data[0]);
-  printf("}\n");
-}
-
-static void bi_print16(const struct big_uint* bi) {
-  uint16_t *data = (uint16_t*)bi->data;
-  printf("{BI: (size: %zu, capacity: %zu base: %" PRIu64") - ", bi->size, bi->capacity, bi->base);
-  printf("(");
-  for(int i = bi->size - 1; i > 0; --i){
-    printf("%d ", data[i]);
+  for (size_t i = 0; i < distinct; ++i) {
+    bi_init_base(&pool[i], i, base);
+    // Some values big enough to live on the heap, all of them distinct
+    if (i % 3 == 0)
+      ret = ret || bi_mul_add_sc(&pool[i], UINT64_MAX, 1) || bi_mul_add_sc(&pool[i], UINT64_MAX, i);
   }
-  printf("%d)", data[0]);
-  printf("}\n");
-}
 
-static void bi_print32(const struct big_uint* bi) {
-  uint32_t *data = (uint32_t*)bi->data;
-  printf("{BI: (size: %zu, capacity: %zu base: %" PRIu64") - ", bi->size, bi->capacity, bi->base);
-  printf("(");
-  for(int i = bi->size - 1; i > 0; --i){
-    printf("%d ", data[i]);
+  for (size_t rep = 0; rep < 3; ++rep)
+    for (size_t i = 0; !ret && i < distinct; ++i) {
+      uint64_t* v = bi_hashmap_slot(&map, &pool[i]);
+      ret = !v;
+      if (v)
+        ++*v;
+    }
+  ret = ret || map.count != distinct;
+  for (size_t i = 0; !ret && i < distinct; ++i) {
+    uint64_t* v = bi_hashmap_find(&map, &pool[i]);
+    ret = !v || *v != 3 || bi_hashmap_insert(&map, &pool[i]) != 0;
   }
-  printf("%d)", data[0]);
-  printf("}\n");
+
+  for (size_t i = 0; !ret && i < distinct; i += 2)
+    ret = bi_hashmap_erase(&map, &pool[i]) != 1 || bi_hashmap_erase(&map, &pool[i]) != 0;
+  for (size_t i = 0; !ret && i < distinct; ++i)
+    ret = (bi_hashmap_find(&map, &pool[i]) != NULL) != (i % 2);
+  ret = ret || map.count != distinct / 2;
+
+  if (ret)
+    bi_test_failed("bi_hashmap(%zu keys, base = %" PRIu64 ")\n", distinct, base);
+  else
+    bi_test_passed("bi_hashmap(%zu keys, base = %" PRIu64 ")\n", distinct, base);
+  for (size_t i = 0; i < distinct; ++i)
+    bi_free(&pool[i]);
+  free(pool);
+  bi_hashmap_free(&map);
+  return ret;
 }
 
-static void bi_print64(const struct big_uint* bi) {
+int test_bi_hash()
+{
+  int ret = test_bytes_eq();
+  uint64_t bases[] = { 2, 10, 200, 60000, 1000000000, MAX_BASE, BI_BASE_2_64 };
+  size_t sizes[] = { 0, 1, 3, 17, 100, 1000 };
+  for (size_t b = 0; b < sizeof(bases) / sizeof(bases[0]); ++b) {
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+      ret |= test_bi_hash_once(bases[b], sizes[s]);
+    ret |= test_bi_hashmap_once(bases[b], 5000);
+  }
 
+  // Different bases never match, and neither do wrong base keys
+  struct big_uint a, b;
+  struct bi_hashmap map;
+  bi_init(&a, 5, 10);
+  bi_init(&b, 5, 100);
+  bi_hashmap_init(&map, 10);
+  int fail = bi_eq(&a, &b) || bi_hashmap_slot(&map, &b) || bi_hashmap_find(&map, &b)
+             || bi_hashmap_insert(&map, &a) != 1 || bi_hashmap_find(&map, &b) || bi_hashmap_erase(&map, &b);
+  if (fail)
+    bi_test_failed("bi_eq / bi_hashmap with different bases\n");
+  else
+    bi_test_passed("bi_eq / bi_hashmap with different bases\n");
+  bi_free(&a);
+  bi_free(&b);
+  bi_hashmap_free(&map);
+  return -(ret || fail);
 }
 
-#define BI_PRINT(type, bi) ({ \
-  type *data = (type*)bi->data; \
-  printf("{BI: (size: %zu, capacity: %zu base: %" PRIu64") - ", bi->size, bi->capacity, bi->base); \
-  printf("("); \
-  for(int i = bi->size - 1; i > 0; --i) \
-    printf("%" PRIu64 " ", data[i]); \
-  printf("%" PRIu64 ")", data[0]); \
-  printf("}\n"); \
-})
+////////////////////////////////////////////// Views
+void bi_view_init(
+    struct bi_view* view,
+    const struct big_uint* bi)
+{
+  struct bi_view ret = {
+    .data = bi->data,
+    .size = limbs_strip(bi->data, bi->size, bi->span),
+    .shift = 0,
+    .base = bi->base,
+    .span = bi->span,
+  };
+  memcpy(view, &ret, sizeof(struct bi_view));
+}
 
-void bi_print(const struct big_uint* bi) {
-  switch(bi->span){
-    case UI8:
-      BI_PRINT(uint8_t, bi);
-      return;
-    case UI16:
-      bi_print16(bi);
-      return;
-    case UI32:
-      bi_print32(bi);
-      return;
-    case UI64:
-      bi_print64(bi);
-      return;
-    default:
-      assert(0);
+void bi_view_slice(
+    struct bi_view* view,
+    size_t lo,
+    size_t n)
+{
+  // The limbs stored at data sit at [shift, shift + size) of the value
+  size_t hi = n > SIZE_MAX - lo ? SIZE_MAX : lo + n;
+  size_t start = view->shift > lo ? view->shift : lo;
+  size_t end = view->shift + view->size < hi ? view->shift + view->size : hi;
+  if (start >= end) {
+    view->size = 0;
+    view->shift = 0;
+    return;
   }
+  view->data += (start - view->shift) * view->span;
+  view->size = limbs_strip(view->data, end - start, view->span);
+  view->shift = view->size ? start - lo : 0;
 }
 
-static void ensure_capacity_big_enough(
-  struct big_uint* bi,
-  size_t size
-) {
-  while(bi->capacity < bi->span * size)
-    double_capacity(bi);
-  assert(bi->capacity >= bi->span * size);
+void bi_view_shift(
+    struct bi_view* view,
+    size_t limbs)
+{
+  if (view->size)
+    view->shift += limbs;
 }
 
-#define BI_ADD_BI(type, dest, right) ({                                       \
-  type* dest_data = (type*)dest->data;                                        \
-  type* right_data = (type*)right->data;                                      \
-                                                                              \
-  /* Size of the maximum number plus one for carry */                         \
-  size_t max_size = dest->size > right->size ? dest->size : right->size + 1;  \
-  ensure_capacity_big_enough(dest, max_size);                                 \
-                                                                              \
-  /* Set the uninitialized space of dest to zero */                           \
-  memset(dest + dest->size, 0, max_size - dest->size);                        \
-  int carry = 0;                                                              \
-  int i = 0;                                                                  \
-                                                                              \
-  /* Add up until right is done (dest is 0 if it's done) */                   \
-  for(; i < right->size; ++i) {                                               \
-    dest_data[i] += carry + right_data[i];                                    \
-    if((carry = dest_data[i] >= dest->base))                                  \
-      dest_data[i] -= dest->base;                                             \
-  }                                                                           \
-                                                                              \
-  /* Continue to add the rest of left */                                      \
-  /* TODO - I think there's an optimization here where you can break early */ \
-  for(; i < max_size; ++i) {                                                  \
-    dest_data[i] += carry;                                                    \
-    if((carry = dest_data[i] >= dest->base))                                  \
-      dest_data[i] -= dest->base;                                             \
-  }                                                                           \
-  dest->size = dest_data[max_size - 1] ? max_size : max_size - 1;             \
-})
+/**
+ * Byte offset of view's limbs inside bi's buffer, or -1 if they live
+ * elsewhere. Growing bi moves them, so writers go through the offset
+ */
+static ptrdiff_t view_offset(const struct big_uint* bi, const struct bi_view* view)
+{
+  uintptr_t p = (uintptr_t)view->data;
+  if (!view->size || p < (uintptr_t)bi->data || p >= (uintptr_t)bi->data + bi->capacity)
+    return -1;
+  return (ptrdiff_t)(p - (uintptr_t)bi->data);
+}
 
-int bi_add_bi(
+int bi_set_view(
     struct big_uint* dest,
-    const struct big_uint* right)
+    const struct bi_view* src)
+{
+  if (dest->base != src->base) {
+    bi_error("Can only set a big int from a view of the same base\n");
+    return -1;
+  }
+  size_t span = dest->span;
+  size_t n = src->size ? src->shift + src->size : 0;
+  ptrdiff_t off = view_offset(dest, src);
+  if (ensure_capacity_big_enough(dest, n))
+    return -1;
+  const uint8_t* data = off < 0 ? src->data : dest->data + off;
+  memmove(dest->data + (n - src->size) * span, data, src->size * span);
+  memset(dest->data, 0, (n - src->size) * span);
+  dest->size = n;
+  return 0;
+}
+
+int bi_add_view(
+    struct big_uint* dest,
+    const struct bi_view* right)
 {
-  // I think you _can_ add different bases, but I'll worry about that later
   if (dest->base != right->base) {
     bi_error("Can only add two big ints if they have the same base\n");
     return -1;
   }
+  if (!right->size)
+    return 0;
 
-  switch(dest->span){
-    case UI8:
-      BI_ADD_BI(uint8_t, dest, right);
-      break;
-    case UI16:
-      BI_ADD_BI(uint16_t, dest, right);
-      break;
-    case UI32:
-      BI_ADD_BI(uint32_t, dest, right);
-      break;
-    case UI64:
-      BI_ADD_BI(uint64_t, dest, right);
-      break;
-    default:
-      assert(0);
+  // Limbs of dest itself at another offset would be overwritten while
+  // they're read, so add a copy of them
+  if (view_offset(dest, right) >= 0) {
+    struct big_uint tmp;
+    struct bi_view v;
+    int ret = bi_init_base(&tmp, 0, dest->base) || bi_set_view(&tmp, right);
+    if (!ret) {
+      bi_view_init(&v, &tmp);
+      ret = bi_add_view(dest, &v);
+    }
+    bi_free(&tmp);
+    return ret ? -1 : 0;
   }
+
+  // Only the limbs from shift up take part, the ones below stay as they are
+  size_t span = dest->span;
+  size_t s = right->shift;
+  size_t top = right->shift + right->size;
+  size_t max_size = (dest->size > top ? dest->size : top) + 1;
+  STATS_OP(BI_OP_ADD_BI, max_size - s, span);
+  if (ensure_capacity_big_enough(dest, max_size))
+    return -1;
+  memset(dest->data + dest->size * span, 0, (max_size - dest->size) * span);
+  limb_set(dest->data, max_size - 1, span, limbs_add(
+      LIMB_PTR(dest->data, s, span), LIMB_PTR(dest->data, s, span), max_size - 1 - s,
+      right->data, right->size, span, dest->base));
+  dest->size = limbs_strip(dest->data, max_size, span);
   return 0;
 }
 
-int test_bi_add_bi()
+int bi_mul_view(
+    struct big_uint* dest,
+    const struct bi_view* left,
+    const struct bi_view* right)
 {
-  struct big_uint left;
-  struct big_uint right;
-  int ret = 0;
+  if (dest->base != left->base || dest->base != right->base) {
+    bi_error("Can only multiply two big ints if they have the same base\n");
+    return -1;
+  }
+  size_t an = left->size;
+  size_t bn = right->size;
+  size_t span = dest->span;
+  STATS_OP(BI_OP_MUL_BI, an + bn, span);
+  if (!an || !bn) {
+    dest->size = 0;
+    return 0;
+  }
 
-  bi_init(&left, 10, 10);
-  bi_init(&right, 10, 2);
-  if (!bi_add_bi(&left, &right)) {
-    bi_test_failed("bi_add_bi different bases\n");
-    ret = -1;
+  // The shifts just move where the product lands
+  size_t s = left->shift + right->shift;
+  size_t dn = s + an + bn;
+  uint8_t* d;
+  if (view_offset(dest, left) >= 0 || view_offset(dest, right) >= 0) {
+    if (!(d = malloc(dn * span))) {
+      bi_error("Couldn't allocate data in bi_mul_view\n");
+      return -1;
+    }
   } else {
-    bi_test_passed("bi_add_bi different bases\n");
+    if (ensure_capacity_big_enough(dest, dn))
+      return -1;
+    d = dest->data;
   }
-  bi_free(&left);
-  bi_free(&right);
 
-  bi_init(&left, 10, 10);
-  bi_init(&right, 10, 10);
-  if (bi_add_bi(&left, &right)) {
-    bi_test_failed("bi_add_bi (10 + 10)\n");
-    ret = -1;
-  } else {
-    bi_test_passed("bi_add_bi (10 + 10)\n");
+  memset(d, 0, s * span);
+  if (limbs_mul_alloc(LIMB_PTR(d, s, span), left->data, an, right->data, bn, span, dest->base)) {
+    if (d != dest->data)
+      free(d);
+    return -1;
   }
-  bi_free(&left);
-  bi_free(&right);
+  if (d != dest->data)
+    return bi_take_limbs(dest, d, dn);
+  dest->size = limbs_strip(d, dn, span);
+  return 0;
+}
 
-  return ret;
+int bi_cmp_view(
+    const struct bi_view* left,
+    const struct bi_view* right)
+{
+  if (left->base != right->base) {
+    bi_error("Can only compare two views if they have the same base\n");
+    return -2;
+  }
+  size_t ln = left->size ? left->shift + left->size : 0;
+  size_t rn = right->size ? right->shift + right->size : 0;
+  if (ln != rn)
+    return ln < rn ? -1 : 1;
+
+  // Below both shifts everything is zero
+  size_t lo = left->shift < right->shift ? left->shift : right->shift;
+  for (size_t i = ln; i-- > lo;) {
+    uint64_t x = i < left->shift ? 0 : limb_get(left->data, i - left->shift, left->span);
+    uint64_t y = i < right->shift ? 0 : limb_get(right->data, i - right->shift, right->span);
+    if (x != y)
+      return x < y ? -1 : 1;
+  }
+  return 0;
+}
+
+int bi_eq_view(
+    const struct bi_view* left,
+    const struct bi_view* right)
+{
+  return left->base == right->base && !bi_cmp_view(left, right);
 }
 
 /**
- * Big Int += Scalar
+ * A big_uint to read view through: a wrapper around its limbs when there's
+ * no shift and they aren't in [out1] or [out2] (nothing is copied), else a
+ * copy in tmp. tmp gets initialized either way, free it once done
  */
-int bi_add_sc(
+static const struct big_uint* view_read(
+  const struct bi_view* view,
+  struct big_uint* wrap,
+  struct big_uint* tmp,
+  const struct big_uint* out1,
+  const struct big_uint* out2)
+{
+  if (bi_init_base(tmp, 0, view->base))
+    return NULL;
+  if (view->shift || (out1 && view_offset(out1, view) >= 0) || (out2 && view_offset(out2, view) >= 0))
+    return bi_set_view(tmp, view) ? NULL : tmp;
+  struct big_uint ret = { .data = (uint8_t*)view->data, .size = view->size,
+                          .capacity = view->size * view->span,
+                          .base = view->base, .span = view->span };
+  memcpy(wrap, &ret, sizeof(struct big_uint));
+  return wrap;
+}
+
+uint64_t bi_hash_view(const struct bi_view* view)
+{
+  struct big_uint wrap, tmp;
+  const struct big_uint* bi = view_read(view, &wrap, &tmp, NULL, NULL);
+  uint64_t h = bi ? bi_hash(bi) : 0;
+  bi_free(&tmp);
+  return h;
+}
+
+int bi_divmod_view(
+    struct big_uint* q,
+    struct big_uint* r,
+    const struct bi_view* a,
+    const struct bi_view* b)
+{
+  struct big_uint wa, wb, ta, tb;
+  const struct big_uint* x = view_read(a, &wa, &ta, q, r);
+  const struct big_uint* y = view_read(b, &wb, &tb, q, r);
+  int ret = !x || !y || bi_divmod_bi(q, r, x, y);
+  bi_free(&ta);
+  bi_free(&tb);
+  return ret ? -1 : 0;
+}
+
+int bi_divmod_sc_view(
     struct big_uint* dest,
-    const uint64_t _right)
-{
-  uint64_t right = _right;
-  int i = 0;
-  while(right) {
-    if(dest->capacity <= i)
-      double_capacity(dest);
-    dest->data[i] += (right % dest->base);
-    right /= dest->base;
-    i++;
+    const struct bi_view* src,
+    uint64_t divisor,
+    uint64_t* rem)
+{
+  // The quotient is as long as src anyway, so divide a copy in place
+  if (!divisor) {
+    bi_error("Division by zero\n");
+    return -1;
   }
-  dest->size = i;
-  return -1;
+  return bi_set_view(dest, src) || bi_divmod_sc(dest, divisor, rem) ? -1 : 0;
+}
+
+char* bi_to_str_view(const struct bi_view* view)
+{
+  struct big_uint wrap, tmp;
+  const struct big_uint* bi = view_read(view, &wrap, &tmp, NULL, NULL);
+  char* str = bi ? bi_to_str(bi) : NULL;
+  bi_free(&tmp);
+  return str;
+}
+
+/**
+ * Splits a into views and puts it back together with bi_set_view,
+ * bi_add_view and bi_mul_view, against copies of the same limbs
+ */
+static int test_bi_view_once(uint64_t base, size_t n, size_t h)
+{
+  struct big_uint a, x, y, lo_c, hi_c, ref;
+  bi_init_base(&a, 0, base);
+  bi_init_base(&x, 0, base);
+  bi_init_base(&y, 0, base);
+  bi_init_base(&lo_c, 0, base);
+  bi_init_base(&hi_c, 0, base);
+  bi_init_base(&ref, 0, base);
+  int ret = test_rand_bi(&a, n);
+
+  struct bi_view va, lo, hi;
+  bi_view_init(&va, &a);
+  lo = hi = va;
+  bi_view_slice(&lo, 0, h);
+  bi_view_slice(&hi, h, SIZE_MAX);
+
+  // hi base^h + lo = a
+  struct bi_view hs = hi;
+  bi_view_shift(&hs, h);
+  ret = ret || bi_set_view(&x, &hs) || bi_add_view(&x, &lo) || bi_cmp(&x, &a);
+  bi_view_init(&va, &a);
+  struct bi_view vx;
+  bi_view_init(&vx, &x);
+  ret = ret || bi_cmp_view(&va, &vx) || bi_cmp_view(&hs, &va) > 0;
+
+  // (hi base^h) * lo against the product of copies
+  size_t hn = n > h ? n - h : 0;
+  ret = ret || bi_set_limbs(&lo_c, a.data, n < h ? n : h) || bi_set_limbs(&hi_c, LIMB_PTR(a.data, n - hn, a.span), hn);
+  ret = ret || bi_mul_bi(&ref, &hi_c, &lo_c) || bi_mul_view(&y, &hi, &lo) || bi_cmp(&y, &ref);
+
+  // The shift only moves the product up
+  ret = ret || bi_mul_view(&x, &hs, &lo);
+  struct bi_view vref;
+  bi_view_init(&vref, &ref);
+  bi_view_shift(&vref, h);
+  bi_view_init(&vx, &x);
+  ret = ret || bi_cmp_view(&vx, &vref);
+
+  // Views of dest itself: a += hi, then a = hi * lo
+  ret = ret || bi_set_limbs(&ref, a.data, a.size) || bi_add_bi(&ref, &hi_c);
+  ret = ret || bi_add_view(&a, &hi) || bi_cmp(&a, &ref);
+  bi_view_init(&va, &a);
+  lo = hi = va;
+  bi_view_slice(&lo, 0, h);
+  bi_view_slice(&hi, h, SIZE_MAX);
+  ret = ret || bi_set_view(&lo_c, &lo) || bi_set_view(&hi_c, &hi) || bi_mul_bi(&ref, &hi_c, &lo_c);
+  ret = ret || bi_mul_view(&a, &hi, &lo) || bi_cmp(&a, &ref);
+  bi_view_init(&va, &a);
+  bi_view_slice(&va, 1, SIZE_MAX);
+  ret = ret || bi_set_view(&ref, &va) || bi_set_view(&a, &va) || bi_cmp(&a, &ref);
+
+  if (ret)
+    bi_test_failed("bi_view(%zu limbs split at %zu, base = %" PRIu64 ")\n", n, h, base);
+  else
+    bi_test_passed("bi_view(%zu limbs split at %zu, base = %" PRIu64 ")\n", n, h, base);
+  bi_free(&a);
+  bi_free(&x);
+  bi_free(&y);
+  bi_free(&lo_c);
+  bi_free(&hi_c);
+  bi_free(&ref);
+  return ret;
+}
+
+/**
+ * The overloads that go through big_uints, on a slice of a shifted up
+ * and on a slice of the quotient itself, against the same ops on copies
+ */
+static int test_bi_view_ops(uint64_t base, size_t n, size_t h)
+{
+  struct big_uint a, q, r, cq, cr, ca, cb;
+  struct bi_accum acc;
+  bi_init_base(&a, 0, base);
+  bi_init_base(&q, 0, base);
+  bi_init_base(&r, 0, base);
+  bi_init_base(&cq, 0, base);
+  bi_init_base(&cr, 0, base);
+  bi_init_base(&ca, 0, base);
+  bi_init_base(&cb, 0, base);
+  int ret = bi_accum_init(&acc, base) || test_rand_bi(&a, n);
+
+  struct bi_view va, lo, hi;
+  bi_view_init(&va, &a);
+  lo = hi = va;
+  bi_view_slice(&lo, 0, h);
+  bi_view_slice(&hi, h, SIZE_MAX);
+  bi_view_shift(&hi, 3);
+  ret = ret || bi_set_view(&ca, &hi) || bi_set_view(&cb, &lo);
+
+  // hi is shifted, lo isn't
+  char* s1 = bi_to_str_view(&hi);
+  char* s2 = bi_to_str(&ca);
+  ret = ret || !s1 || !s2 || strcmp(s1, s2);
+  free(s1);
+  free(s2);
+  ret = ret || bi_hash_view(&hi) != bi_hash(&ca) || bi_hash_view(&lo) != bi_hash(&cb);
+  ret = ret || !bi_eq_view(&va, &va) || bi_eq_view(&hi, &lo) != bi_eq(&ca, &cb);
+
+  uint64_t rem1, rem2;
+  ret = ret || bi_divmod_sc_view(&q, &hi, 1000003, &rem1) || bi_set_limbs(&cq, ca.data, ca.size)
+        || bi_divmod_sc(&cq, 1000003, &rem2) || rem1 != rem2 || bi_cmp(&q, &cq);
+  if (cb.size)
+    ret = ret || bi_divmod_view(&q, &r, &hi, &lo) || bi_divmod_bi(&cq, &cr, &ca, &cb)
+          || bi_cmp(&q, &cq) || bi_cmp(&r, &cr);
+
+  // Views into the quotient (q = ca by now) are read before it's written
+  struct bi_view vq, vl;
+  ret = ret || bi_set_limbs(&q, ca.data, ca.size);
+  bi_view_init(&vq, &q);
+  vl = vq;
+  bi_view_slice(&vl, 0, 2);
+  ret = ret || bi_set_view(&cb, &vl);
+  if (cb.size)
+    ret = ret || bi_divmod_view(&q, NULL, &vq, &vl) || bi_divmod_bi(&cq, NULL, &ca, &cb) || bi_cmp(&q, &cq);
+
+  // hi base^3 + lo + hi base^3 through the accumulator
+  ret = ret || bi_accum_add_view(&acc, &hi) || bi_accum_add_view(&acc, &lo) || bi_accum_add_view(&acc, &hi);
+  ret = ret || bi_accum_get(&acc, &q) || bi_set_view(&cq, &lo) || bi_add_bi(&cq, &ca) || bi_add_bi(&cq, &ca)
+        || bi_cmp(&q, &cq);
+
+  if (ret)
+    bi_test_failed("bi_view ops (%zu limbs split at %zu, base = %" PRIu64 ")\n", n, h, base);
+  else
+    bi_test_passed("bi_view ops (%zu limbs split at %zu, base = %" PRIu64 ")\n", n, h, base);
+  bi_accum_free(&acc);
+  bi_free(&a);
+  bi_free(&q);
+  bi_free(&r);
+  bi_free(&cq);
+  bi_free(&cr);
+  bi_free(&ca);
+  bi_free(&cb);
+  return ret;
+}
+
+int test_bi_view()
+{
+  int ret = 0;
+  uint64_t bases[] = { 2, 10, 200, 60000, 1000000000, MAX_BASE, BI_BASE_2_64 };
+  size_t sizes[][2] = { { 1, 0 }, { 1, 1 }, { 2, 1 }, { 10, 3 }, { 10, 20 }, { 100, 50 }, { 1000, 999 }, { 3000, 1500 } };
+  for (size_t b = 0; b < sizeof(bases) / sizeof(bases[0]); ++b)
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+      ret |= test_bi_view_once(bases[b], sizes[s][0], sizes[s][1])
+             | test_bi_view_ops(bases[b], sizes[s][0], sizes[s][1]);
+
+  // Slices past the end or inside the shifted zeros are zero
+  struct big_uint a;
+  struct bi_view v, w, z;
+  bi_init(&a, 123456789, 10);
+  bi_view_init(&v, &a);
+  bi_view_shift(&v, 5);
+  w = v;
+  bi_view_slice(&w, 2, 2);
+  z = v;
+  bi_view_slice(&z, 14, SIZE_MAX);
+  struct bi_view u = v;
+  bi_view_slice(&u, 3, 4);
+  int fail = w.size || z.size || u.size != 2 || u.shift != 2 || limb_get(u.data, 0, u.span) != 9
+             || limb_get(u.data, 1, u.span) != 8;
+  if (fail)
+    bi_test_failed("bi_view_slice edges\n");
+  else
+    bi_test_passed("bi_view_slice edges\n");
+  ret |= fail;
+
+  // Mixed bases are an error, not an answer
+  struct big_uint c;
+  bi_init(&c, 123456789, 100);
+  bi_view_init(&u, &c);
+  fail = bi_cmp(&a, &c) != -2 || bi_cmp_view(&v, &u) != -2 || bi_eq_view(&v, &u);
+  if (fail)
+    bi_test_failed("bi_cmp / bi_cmp_view with different bases\n");
+  else
+    bi_test_passed("bi_cmp / bi_cmp_view with different bases\n");
+  bi_free(&a);
+  bi_free(&c);
+  return -(ret || fail);
 }
 
 /////////////////////////////////////// UTILS
 static uint64_t quick_pow10(uint8_t n)
 {
-  // TODO - make this better
-  return (uint64_t)powf(10, n);
+  // powf loses digits past 10^10, so table it
+  static const uint64_t pow10[20] = {
+    1lu, 10lu, 100lu, 1000lu, 10000lu, 100000lu, 1000000lu, 10000000lu,
+    100000000lu, 1000000000lu, 10000000000lu, 100000000000lu,
+    1000000000000lu, 10000000000000lu, 100000000000000lu,
+    1000000000000000lu, 10000000000000000lu, 100000000000000000lu,
+    1000000000000000000lu, 10000000000000000000lu,
+  };
+  assert(n < 20);
+  return pow10[n];
 }
 
 static void bi_error(const char* msg_fmt, ...)
@@ -393,7 +9000,7 @@ static int test_span_from_base()
 static uint64_t min_decs_needed(const uint64_t num)
 {
   uint64_t count = 0;
-  while (num / quick_pow10(++count))
+  while (++count < 20 && num / quick_pow10(count))
     ;
   return count;
 }
@@ -421,15 +9028,26 @@ static int test_min_decs_needed()
   ret = test_min_decs_needed_once(11, 2) || ret;
   ret = test_min_decs_needed_once(110, 3) || ret;
   ret = test_min_decs_needed_once(10234918, 8) || ret;
+  ret = test_min_decs_needed_once(18446744073709551615lu, 20) || ret;
   return -ret;
 }
 
-static int double_capacity(struct big_uint* bi)
+static int grow_capacity(struct big_uint* bi, size_t new_capacity)
 {
-  size_t new_capacity = 2 * bi->capacity;
-  uint8_t* new_head = realloc(bi->data, new_capacity);
+  STATS_ADD(grow_calls, 1);
+  STATS_ADD(grow_bytes, new_capacity);
+  if (bi->arena)
+    return arena_grow(bi, new_capacity);
+  const struct bi_allocator* alloc = BI_ALLOC(bi);
+  uint8_t* new_head;
+  if (BI_IS_SMALL(bi)) {
+    if ((new_head = alloc->alloc(alloc->ctx, new_capacity)))
+      memcpy(new_head, bi->data, bi->capacity);
+  } else {
+    new_head = alloc->resize(alloc->ctx, bi->data, bi->capacity, new_capacity);
+  }
   if (!new_head) {
-    bi_error("Couldn't reallocate data when doubling capacity\n");
+    bi_error("Couldn't reallocate data when growing capacity\n");
     return -1;
   }
   bi->data = new_head;
@@ -552,6 +9170,11 @@ static uint64_t get_bits(
     bi += 8 - (bi % 8); // Add remainder - only > 0 for first one
   }
 
+  // Nothing left when end is on a byte boundary (and that byte would be
+  // data[-1] for the top bits)
+  if(!(end % 8))
+    return ret;
+
   mask = ~(~0lu << (end % 8)) & (~0lu << (bi % 8)); // 1's from bi to end
   mask &= data[dl - end / 8 - 1]; 
 
@@ -611,15 +9234,13 @@ static void set_bits(
   assert(end - start <= 64);
   
   // val can't take up more bits than end - start
-  uint64_t vval = val & ~(~0ul << (end - start));
-  assert(vval == val);
+  assert(end - start == 64 || !(val >> (end - start)));
   
   size_t bi = start;
 
   while(end / 8 != bi / 8) {
-    uint8_t zero = 0;
     uint8_t byte = data[dl - bi / 8 - 1]; 
-    uint8_t right_ones = ~(~zero << (bi % 8));
+    uint8_t right_ones = (uint8_t)~(0xff << (bi % 8));
     uint8_t data_right = byte & right_ones;
     uint8_t mask_left = (val >> (bi - start)) << (bi % 8); 
 
@@ -628,13 +9249,17 @@ static void set_bits(
     bi += 8 - (bi % 8); // Add remainder - only > 0 for first one
   }
 
+  // Same as get_bits - an end on a byte boundary is already done
+  if(!(end % 8))
+    return;
+
   uint8_t byte = data[dl - bi / 8 - 1]; 
 
-  uint8_t data_left = byte & 0xff << (8 - end % 8);
-  uint8_t mask_right = val >> (bi - start);
-  uint8_t data_right = byte & ~(~0 << (bi % 8));
+  uint8_t data_left = byte & (uint8_t)(0xff << (end % 8));
+  uint8_t mask_mid = (val >> (bi - start)) << (bi % 8);
+  uint8_t data_right = byte & (uint8_t)~(0xff << (bi % 8));
 
-  data[dl - bi / 8 - 1] = data_left | mask_right | data_right;
+  data[dl - bi / 8 - 1] = data_left | mask_mid | data_right;
 }
 
 static void set_bits_span(
@@ -759,7 +9384,7 @@ static int test_set_bits_once(
   else
     bi_test_failed("set_bits(%" PRIu64 ")\n", expected);
   free(data);
-  return 0;
+  return ret;
 }
 
 static int test_set_bits(int verbose) {
@@ -774,6 +9399,8 @@ static int test_set_bits(int verbose) {
   ret = ret | test_set_bits_once(case1, dl, 8, 10, 0b01, verbose);
   ret = ret | test_set_bits_once(case1, dl, 9, 10, 0b0, verbose);
   ret = ret | test_set_bits_once(case1, dl, 9, 24, 0b10110, verbose);
+  ret = ret | test_set_bits_once(case1, dl, 9, 11, 0b10, verbose);
+  ret = ret | test_set_bits_once(case1, dl, 0, 8, 0b1011, verbose);
 
   return -ret;
 }
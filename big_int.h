@@ -6,13 +6,24 @@
 #define C_BIG_INT_BIG_INT_H
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * Base is MAX_UINT64_t / 2 because of carry in add
  */
 #define MAX_BASE (0x7FFFFFFFFFFFFFFF)
 
+/**
+ * Pseudo base for full 64 bit binary limbs (base 2^64, which doesn't fit
+ * in a uint64_t). Only bi_init_bin hands these out
+ */
+#define BI_BASE_2_64 (0)
+
 enum span {
   UI8 = 1,
   UI16 = 2,
@@ -20,14 +31,30 @@ enum span {
   UI64 = 8
 };
 
+/**
+ * Bytes of limbs a big_uint holds inline before going to the heap
+ */
+#define BI_INLINE_BYTES (16)
+
+struct bi_arena;
+struct bi_allocator;
+
+/**
+ * Small values keep their limbs in [small] with data pointing at it, so a
+ * big_uint must not be memcpy'd or moved once initialized
+ */
 struct big_uint {
   uint8_t* data; 
 
   size_t size;          // Number of elements (respects [span])
   size_t capacity;      // Number of bytes in data (doesn't respect [span])
+  struct bi_arena* arena; // Owner of data, NULL if it's on the heap (or small)
+  const struct bi_allocator* alloc; // Heap allocator, the default at init
+  uint64_t small[BI_INLINE_BYTES / 8];
 
   const uint64_t base;  
   const size_t span;    
+  const uint64_t base_inv; // Reciprocal of base (normalized), 0 if not computed
 };
 
 /**
@@ -38,8 +65,123 @@ int bi_init(
     uint64_t start, 
     uint64_t base);
 
+/**
+ * bi_init for base 2^64 (BI_BASE_2_64). Every limb uses the whole word and
+ * add / sub go straight through the carry flag
+ */
+int bi_init_bin(
+    struct big_uint* bi,
+    uint64_t start);
+
 void bi_free(struct big_uint* bi);
 
+/**
+ * Bump allocator for temporaries. Values made with bi_init_in take their
+ * limbs from the arena and give them back all at once on release. A value
+ * at the top of the arena grows in place and bi_free on it pops it; bi_free
+ * on anything else in the arena is a no-op
+ */
+struct bi_arena_block;
+
+struct bi_arena {
+  struct bi_arena_block* top;    // Block being bumped (older ones chain off it)
+  struct bi_arena_block* spare;  // Last released block, kept for reuse
+  size_t block_size;             // Bytes per block (bigger requests get their own)
+
+  struct bi_arena_block* floor;  // Innermost mark, values under it can't
+  size_t floor_used;             // grow inside the arena any more
+};
+
+/**
+ * A position to release back to. Marks nest
+ */
+struct bi_arena_pos {
+  struct bi_arena_block* block;
+  size_t used;
+
+  struct bi_arena_block* floor;
+  size_t floor_used;
+};
+
+int bi_arena_init(
+    struct bi_arena* arena,
+    size_t block_size);
+
+void bi_arena_free(struct bi_arena* arena);
+
+struct bi_arena_pos bi_arena_mark(struct bi_arena* arena);
+
+/**
+ * Drops everything allocated since [pos]. Values from before the mark that
+ * had to grow meanwhile were moved to the heap (their arena is NULL) and
+ * still need bi_free
+ */
+void bi_arena_release(
+    struct bi_arena* arena,
+    struct bi_arena_pos pos);
+
+/**
+ * bi_init with data in [arena]
+ */
+int bi_init_in(
+    struct bi_arena* arena,
+    struct big_uint* bi,
+    uint64_t start,
+    uint64_t base);
+
+/**
+ * Heap allocator for limbs. [resize] keeps the first min(old, new) bytes.
+ * Sizes passed back are always the ones asked for, so an allocator that
+ * rounds up can recompute what it actually mapped. Must outlive every
+ * number using it
+ */
+struct bi_allocator {
+  void* (*alloc)(void* ctx, size_t bytes);
+  void* (*resize)(void* ctx, void* p, size_t old_bytes, size_t new_bytes);
+  void (*free)(void* ctx, void* p, size_t bytes);
+  void* ctx;
+};
+
+/**
+ * malloc / realloc / free (the default)
+ */
+extern const struct bi_allocator bi_allocator_malloc;
+
+/**
+ * malloc below 2 MiB. From there on, anonymous mmaps in whole 2 MiB steps
+ * with transparent huge pages requested, grown with mremap so growth is
+ * remapped instead of copied
+ */
+extern const struct bi_allocator bi_allocator_huge;
+
+/**
+ * Allocator new numbers pick up (NULL goes back to malloc). Numbers
+ * already initialized keep theirs
+ */
+void bi_set_default_allocator(const struct bi_allocator* alloc);
+
+const struct bi_allocator* bi_get_default_allocator(void);
+
+/**
+ * Moves bi's heap limbs (if any) over to [alloc]
+ */
+int bi_set_allocator(
+    struct big_uint* bi,
+    const struct bi_allocator* alloc);
+
+/**
+ * Grows the capacity to at least [limbs] limbs in one step
+ */
+int bi_reserve(
+    struct big_uint* bi,
+    size_t limbs);
+
+/**
+ * Gives back capacity past size (moving back inline when it fits).
+ * Arena values keep theirs
+ */
+int bi_shrink_to_fit(struct big_uint* bi);
+
 /**
  * Returns a string (null terminated and malloced!)
  * that shows the power representation. For example,
@@ -55,6 +197,12 @@ int bi_add_bi(
     struct big_uint* dest,
     const struct big_uint* right);
 
+/**
+ * Limb count of [right] at which bi_add_bi splits the add across the
+ * thread pool (when it has workers)
+ */
+extern size_t bi_add_parallel_threshold;
+
 /**
  * Big Int += Scalar
  */
@@ -62,4 +210,741 @@ int bi_add_sc(
     struct big_uint* dest,
     const uint64_t right);
 
+/**
+ * dest = terms[0] + ... + terms[n - 1] in one pass over the limbs (dest
+ * may be one of the terms). Every term needs dest's base
+ */
+int bi_add_many(
+    struct big_uint* dest,
+    const struct big_uint* const* terms,
+    size_t n);
+
+/**
+ * Limb counts at which bi_mul_bi switches from schoolbook to Karatsuba
+ * and from Karatsuba to Toom-3. Tunable at runtime (values below 8 and 24
+ * respectively are clamped)
+ */
+extern size_t bi_karatsuba_threshold;
+extern size_t bi_toom3_threshold;
+
+/**
+ * Limb count of the smaller operand at which bi_mul_bi switches to a three
+ * prime number theoretic transform
+ */
+extern size_t bi_ntt_threshold;
+
+/**
+ * Big Int = Big Int * Big Int
+ * [dest] must already be initialized with the same base as [left] and [right]
+ * and may alias either of them
+ */
+int bi_mul_bi(
+    struct big_uint* dest,
+    const struct big_uint* left,
+    const struct big_uint* right);
+
+/**
+ * Limb count of the divisor at which bi_divmod_bi switches from long
+ * division to a Newton reciprocal with Barrett reduction
+ */
+extern size_t bi_newton_threshold;
+
+/**
+ * Big Int / Big Int
+ * Sets q = a / b and r = a % b. Either of q or r may be NULL and both
+ * may alias a or b (they must be initialized with the same base)
+ */
+int bi_divmod_bi(
+    struct big_uint* q,
+    struct big_uint* r,
+    const struct big_uint* a,
+    const struct big_uint* b);
+
+/**
+ * Big Int *= Scalar and Big Int = Big Int * mul + add for any words (they
+ * don't need to be below base). Digits are reduced through the reciprocal
+ * of base that bi_init stored, not a hardware divide
+ */
+int bi_mul_sc(
+    struct big_uint* dest,
+    uint64_t right);
+
+int bi_mul_add_sc(
+    struct big_uint* dest,
+    uint64_t mul,
+    uint64_t add);
+
+/**
+ * Big Int /= Scalar for any non zero word, setting [rem] (if not NULL) to
+ * the remainder. The divisor's reciprocal is computed once per call
+ */
+int bi_divmod_sc(
+    struct big_uint* dest,
+    uint64_t divisor,
+    uint64_t* rem);
+
+/**
+ * -1, 0 or 1 as left is below, equal to or above right. -2 (and an error)
+ * if their bases differ
+ */
+int bi_cmp(
+    const struct big_uint* left,
+    const struct big_uint* right);
+
+/**
+ * Whether left and right hold the same value in the same base
+ */
+int bi_eq(
+    const struct big_uint* left,
+    const struct big_uint* right);
+
+/**
+ * 64 bit hash of the value and its base, equal whenever bi_eq is. Fast
+ * rather than collision resistant, don't feed it adversarial keys
+ */
+uint64_t bi_hash(const struct big_uint* bi);
+
+/**
+ * Open addressing (linear probing) map from big_uints of one base to
+ * words, or a set if the values are ignored. Keys are copied in. Every
+ * slot caches its key's hash, so probes and growing rarely touch a key.
+ * Slots with a non zero hash are in use
+ */
+struct bi_hashmap {
+  uint64_t* hashes;
+  struct big_uint* keys;
+  uint64_t* values;
+
+  size_t count;         // Keys in the map
+  size_t capacity;      // Slots, a power of two
+  uint64_t base;
+};
+
+/**
+ * An empty map for keys in base (which can be BI_BASE_2_64)
+ */
+int bi_hashmap_init(
+    struct bi_hashmap* map,
+    uint64_t base);
+
+void bi_hashmap_free(struct bi_hashmap* map);
+
+/**
+ * key's value, inserted as 0 if it's new (so counting is
+ * ++*bi_hashmap_slot(map, key)). NULL on failure. Inserting may move every
+ * value, so don't hold on to the pointer across inserts
+ */
+uint64_t* bi_hashmap_slot(
+    struct bi_hashmap* map,
+    const struct big_uint* key);
+
+/**
+ * Adds key: 1 if it's new, 0 if it was there already, -1 on failure
+ */
+int bi_hashmap_insert(
+    struct bi_hashmap* map,
+    const struct big_uint* key);
+
+/**
+ * key's value, NULL if it isn't in the map
+ */
+uint64_t* bi_hashmap_find(
+    struct bi_hashmap* map,
+    const struct big_uint* key);
+
+/**
+ * Removes key: 1 if it was there, 0 if it wasn't
+ */
+int bi_hashmap_erase(
+    struct bi_hashmap* map,
+    const struct big_uint* key);
+
+/**
+ * Read only view of a range of limbs, worth data * base^shift. The shift
+ * stands for zero limbs that aren't stored anywhere, so slicing and
+ * shifting never copy. A view points into its big_uint and is stale once
+ * that grows, shrinks or is freed
+ */
+struct bi_view {
+  const uint8_t* data;
+  size_t size;          // Limbs at data (the top one is non zero)
+  size_t shift;         // Zero limbs below them
+  uint64_t base;
+  size_t span;
+};
+
+/**
+ * The whole of bi
+ */
+void bi_view_init(
+    struct bi_view* view,
+    const struct big_uint* bi);
+
+/**
+ * Narrows view to its limbs [lo, lo + n) as a number of its own (so
+ * floor(view / base^lo) mod base^n). n can be SIZE_MAX for the rest
+ */
+void bi_view_slice(
+    struct bi_view* view,
+    size_t lo,
+    size_t n);
+
+/**
+ * view *= base^limbs
+ */
+void bi_view_shift(
+    struct bi_view* view,
+    size_t limbs);
+
+/**
+ * Read side operations on views, the bi_x_view version of bi_x.
+ * bi_set_view copies the limbs out, the others read them in place. Views
+ * may point into dest (bi_add_view copies those first, as it writes over
+ * them). bi_cmp_view returns -2 for views of different bases
+ */
+int bi_set_view(
+    struct big_uint* dest,
+    const struct bi_view* src);
+
+int bi_add_view(
+    struct big_uint* dest,
+    const struct bi_view* right);
+
+int bi_mul_view(
+    struct big_uint* dest,
+    const struct bi_view* left,
+    const struct bi_view* right);
+
+int bi_cmp_view(
+    const struct bi_view* left,
+    const struct bi_view* right);
+
+int bi_eq_view(
+    const struct bi_view* left,
+    const struct bi_view* right);
+
+/**
+ * These go through the big_uint versions, so a view with a shift (or
+ * into q, r or dest) is copied out first. Hashes match bi_hash of the
+ * same value
+ */
+uint64_t bi_hash_view(const struct bi_view* view);
+
+int bi_divmod_view(
+    struct big_uint* q,
+    struct big_uint* r,
+    const struct bi_view* a,
+    const struct bi_view* b);
+
+int bi_divmod_sc_view(
+    struct big_uint* dest,
+    const struct bi_view* src,
+    uint64_t divisor,
+    uint64_t* rem);
+
+char* bi_to_str_view(const struct bi_view* view);
+
+/**
+ * Precomputed state for reducing many numbers by the same modulus m:
+ * mu = floor(base^(2n) / m) where n is the limb count of m.
+ * A context owns scratch space, so only use it from one thread at a time
+ */
+struct bi_barrett {
+  uint8_t* m;             // Copy of the modulus (n limbs)
+  uint8_t* mu;            // n + 2 limbs
+  uint8_t* work;          // Space for one reduction step
+  uint8_t* scratch;       // Multiplication scratch
+  size_t scratch_bytes;
+
+  size_t n;
+  uint64_t base;
+  size_t span;
+};
+
+int bi_barrett_init(
+    struct bi_barrett* ctx,
+    const struct big_uint* m);
+
+void bi_barrett_free(struct bi_barrett* ctx);
+
+/**
+ * q = a / m, r = a % m for the modulus of ctx. Either of q or r may be NULL,
+ * and q may be a. Nothing is allocated once q and r have the capacity
+ */
+int bi_barrett_divmod(
+    struct big_uint* q,
+    struct big_uint* r,
+    const struct big_uint* a,
+    struct bi_barrett* ctx);
+
+/**
+ * Montgomery constants for a modulus m of n limbs (R = base^n). m must be
+ * coprime to the base (odd for power of two bases).
+ * A context owns scratch space, so only use it from one thread at a time
+ */
+struct bi_mont_ctx {
+  uint8_t* m;             // Copy of the modulus (n limbs)
+  uint8_t* r2;            // R^2 mod m
+  uint8_t* work;          // Space for one Montgomery product
+  uint64_t minv;          // -m^-1 mod base
+
+  size_t n;
+  uint64_t base;
+  uint64_t base_inv;      // Reciprocal of base (normalized), as in big_uint
+  size_t span;
+};
+
+int bi_mont_init(
+    struct bi_mont_ctx* ctx,
+    const struct big_uint* m);
+
+void bi_mont_free(struct bi_mont_ctx* ctx);
+
+/**
+ * dest = b ^ exp mod m (sliding window). [exp] can be in any base
+ */
+int bi_powmod(
+    struct big_uint* dest,
+    const struct big_uint* b,
+    const struct big_uint* exp,
+    struct bi_mont_ctx* ctx);
+
+/**
+ * dest = src written in dest's base (BI_BASE_2_64 included). dest may be
+ * src. Divide and conquer over a tree of powers of the source base, so
+ * O(M(n) log n)
+ */
+int bi_convert_base(
+    struct big_uint* dest,
+    const struct big_uint* src);
+
+/**
+ * Decimal string of bi (null terminated and malloced!), NULL on failure
+ */
+char* bi_to_str(const struct big_uint* bi);
+
+/**
+ * dest = the decimal number in str (digits only). dest keeps its base
+ */
+int bi_from_str(
+    struct big_uint* dest,
+    const char* str);
+
+/**
+ * dest = the digits read from fd until EOF, in [input_base] (2 to 36,
+ * letters in either case, whitespace skipped). A reader thread fills
+ * chunks of bi_from_fd_chunk digits while this one converts and merges
+ * the previous ones, so only a few chunks are held besides the result.
+ * dest keeps its base
+ */
+extern size_t bi_from_fd_chunk;
+
+int bi_from_fd(
+    struct big_uint* dest,
+    int fd,
+    uint64_t input_base);
+
+/**
+ * Streams bi in decimal to fd / f, formatting whole blocks into the
+ * caller's [buf] (any size) and writing it out each time it fills up
+ */
+int bi_write_fd(
+    const struct big_uint* bi,
+    int fd,
+    char* buf,
+    size_t buflen);
+
+int bi_write_file(
+    const struct big_uint* bi,
+    FILE* f,
+    char* buf,
+    size_t buflen);
+
+/**
+ * Bit packed digits: every digit takes exactly ceil(log2(base)) bits
+ * (4 for base 10, 2 for base 3) instead of a whole limb. Digit i lives at
+ * bits [i * bits, (i + 1) * bits) of data counted from the end of the
+ * buffer (the get_bits / set_bits order). Meant for keeping lots of small
+ * base numbers resident - unpack to a big_uint for anything but add
+ */
+struct bi_packed {
+  uint8_t* data;
+
+  size_t size;          // Number of digits
+  size_t capacity;      // Number of bytes in data
+
+  uint64_t base;
+  size_t bits;          // Bits per digit
+};
+
+int bi_packed_init(
+    struct bi_packed* bp,
+    uint64_t start,
+    uint64_t base);
+
+void bi_packed_free(struct bi_packed* bp);
+
+/**
+ * Packs / unpacks between the two forms. dest must already be initialized
+ * with the same base
+ */
+int bi_pack(
+    struct bi_packed* dest,
+    const struct big_uint* src);
+
+int bi_unpack(
+    struct big_uint* dest,
+    const struct bi_packed* src);
+
+/**
+ * Packed += Packed, done on the packed form a block at a time
+ */
+int bi_packed_add_bi(
+    struct bi_packed* dest,
+    const struct bi_packed* right);
+
+/**
+ * Packed += Scalar
+ */
+int bi_packed_add_sc(
+    struct bi_packed* dest,
+    const uint64_t right);
+
+/**
+ * Many same base numbers side by side: limb i of number j sits at
+ * data[(i * count + j) * span], so a row holds the same limb of every
+ * number and adds run across numbers instead of along limbs
+ */
+struct bi_batch {
+  uint8_t* data;
+
+  size_t count;         // Numbers in the batch
+  size_t limbs;         // Rows in use (at least the limbs of the longest number)
+  size_t rows;          // Rows allocated, the ones past [limbs] are zero
+
+  uint64_t base;
+  size_t span;
+};
+
+/**
+ * [count] zeros. base can be BI_BASE_2_64
+ */
+int bi_batch_init(
+    struct bi_batch* batch,
+    size_t count,
+    uint64_t base);
+
+void bi_batch_free(struct bi_batch* batch);
+
+/**
+ * Copies number j out of / into the batch. dest must already be
+ * initialized with the batch's base
+ */
+int bi_batch_get(
+    const struct bi_batch* batch,
+    size_t j,
+    struct big_uint* dest);
+
+int bi_batch_set(
+    struct bi_batch* batch,
+    size_t j,
+    const struct big_uint* src);
+
+/**
+ * dest[j] += right[j] for every j
+ */
+int bi_batch_add(
+    struct bi_batch* dest,
+    const struct bi_batch* right);
+
+/**
+ * dest[j] += right[j] for every j ([right] holds dest->count scalars)
+ */
+int bi_batch_add_sc(
+    struct bi_batch* dest,
+    const uint64_t* right);
+
+/**
+ * The library's work stealing thread pool. It starts on first use with a
+ * worker per core but one (the caller pitches in). 0 turns it off and runs
+ * everything on the calling thread. Don't resize it while parallel calls
+ * are running
+ */
+int bi_pool_set_threads(size_t nthreads);
+
+size_t bi_pool_threads(void);
+
+/**
+ * dest = values[0] + ... + values[n - 1] (dest = 1 * values[0] * ... for
+ * the product, as a balanced tree). Every value needs dest's base and dest
+ * may be one of them. Work is split [nthreads] ways (0: pool size + 1)
+ */
+int bi_sum_parallel(
+    struct big_uint* dest,
+    const struct big_uint* values,
+    size_t n,
+    size_t nthreads);
+
+int bi_prod_parallel(
+    struct big_uint* dest,
+    const struct big_uint* values,
+    size_t n,
+    size_t nthreads);
+
+/**
+ * Sum with lazy carries. Limbs are full words and adds go limb by limb
+ * without carrying; [bound] tracks the largest a limb can be, and only once
+ * the next add could overflow a word (or on a read) do the carries run
+ */
+struct bi_accum {
+  uint64_t* limbs;
+
+  size_t size;          // Limbs in use
+  size_t capacity;      // Limbs allocated, the ones past [size] are zero
+
+  uint64_t base;
+  uint64_t bound;       // Every limb is <= bound
+};
+
+int bi_accum_init(
+    struct bi_accum* acc,
+    uint64_t base);
+
+void bi_accum_free(struct bi_accum* acc);
+
+/**
+ * Accumulator += Big Int / Scalar. right needs the accumulator's base
+ */
+int bi_accum_add_bi(
+    struct bi_accum* acc,
+    const struct big_uint* right);
+
+int bi_accum_add_sc(
+    struct bi_accum* acc,
+    const uint64_t right);
+
+/**
+ * Accumulator += view, adding its limbs [shift] up in place
+ */
+int bi_accum_add_view(
+    struct bi_accum* acc,
+    const struct bi_view* right);
+
+/**
+ * Normalizes and copies the sum into dest (already initialized in the
+ * accumulator's base)
+ */
+int bi_accum_get(
+    struct bi_accum* acc,
+    struct big_uint* dest);
+
+/**
+ * On disk format: a versioned header (base, span, size, checksum) then the
+ * raw limbs at a page aligned offset. bi_map maps the file read only and
+ * [value] points straight into the mapping, so pages fault in as they're
+ * read. Only ever use &map->value as const and never bi_free it
+ */
+struct bi_mapping {
+  struct big_uint value;
+  void* addr;
+  size_t length;
+};
+
+/**
+ * Writes a fresh path.XXXXXX (mkstemp), syncs it and renames it over path,
+ * so path never holds a partial file, even with saves racing on it, and
+ * mappings of an older one stay intact
+ */
+int bi_save(
+    const struct big_uint* bi,
+    const char* path);
+
+/**
+ * [verify] checks the limbs against the checksum, which reads them all
+ */
+int bi_map(
+    struct bi_mapping* map,
+    const char* path,
+    int verify);
+
+void bi_unmap(struct bi_mapping* map);
+
+/**
+ * Instrumentation, compiled in with -DBI_STATS (cmake -DBI_STATS=ON).
+ * Counters live per thread and are summed (including threads that have
+ * exited) on read. Op times include any nested ops they call
+ */
+enum bi_stats_op {
+  BI_OP_ADD_BI,
+  BI_OP_ADD_SC,
+  BI_OP_MUL_BI,
+  BI_OP_DIVMOD_BI,
+  BI_OP_POWMOD,
+  BI_OP_CONVERT_BASE,
+  BI_OP_TO_STR,
+  BI_OP_FROM_STR,
+  BI_OP_ACCUM_ADD,
+  BI_OP_BATCH_ADD,
+  BI_OP_ADD_MANY,
+  BI_OP_COUNT
+};
+
+#define BI_STATS_CHAIN_BUCKETS (32)
+
+struct bi_stats {
+  uint64_t grow_calls;          // Capacity growths
+  uint64_t grow_bytes;          // Bytes (re)allocated by them
+
+  uint64_t carry_chains;        // Runs of carrying limbs in bi_add_bi
+  uint64_t carry_limbs;         // Their total length
+  uint64_t carry_hist[BI_STATS_CHAIN_BUCKETS]; // Chains of length [2^k, 2^(k+1)), the last open ended
+
+  uint64_t span_limbs[4];       // Limbs processed at UI8, UI16, UI32, UI64
+
+  uint64_t op_calls[BI_OP_COUNT];
+  uint64_t op_limbs[BI_OP_COUNT]; // Input limbs (digits for bi_from_str)
+  uint64_t op_ns[BI_OP_COUNT];
+};
+
+/**
+ * Counts since the last reset. Returns -1 (and zeros) when the library
+ * was built without BI_STATS
+ */
+int bi_stats_get(struct bi_stats* stats);
+
+void bi_stats_reset(void);
+
+/**
+ * Copies between a big_uint and a plain array of n limbs, [width] bytes
+ * each, in [base]. bi_to_limbs zero pads and fails if src doesn't fit
+ */
+int bi_from_limbs(
+    struct big_uint* dest,
+    const void* limbs,
+    size_t n,
+    size_t width,
+    uint64_t base);
+
+int bi_to_limbs(
+    const struct big_uint* src,
+    void* limbs,
+    size_t n,
+    size_t width,
+    uint64_t base);
+
+/**
+ * Fixed width numbers of [limbs] limbs of [type] in a compile time [base]
+ * (BI_BASE_2_64 for full words). Plain structs with no allocation, and
+ * every function is unrolled for the width with the base folded in:
+ *   name_set(x, v)         x = v, returns 1 if v didn't fit
+ *   name_add(d, a, b)      d = a + b, returns the carry out of the top
+ *   name_add_sc(d, v)      d += v, returns 1 on overflow
+ *   name_cmp(a, b)         -1, 0 or 1
+ *   name_from_bi(x, bi)    x = bi (bi must be in [base] and fit)
+ *   name_to_bi(bi, x)      bi = x (bi initialized in [base])
+ * [type] has to hold 2 * base - 1, BI_DEFINE_FIXED picks uint64_t
+ */
+#define BI_DEFINE_FIXED(name, limbs, base) \
+  BI_DEFINE_FIXED_T(name, uint64_t, limbs, base)
+
+/**
+ * Unoptimized builds ignore the hint and warn about it
+ */
+#if defined(__GNUC__) && defined(__OPTIMIZE__)
+#define BI_FIXED_UNROLL _Pragma("GCC unroll 64")
+#else
+#define BI_FIXED_UNROLL
+#endif
+
+#ifdef __cplusplus
+#define BI_STATIC_ASSERT static_assert
+#else
+#define BI_STATIC_ASSERT _Static_assert
+#endif
+
+#define BI_DEFINE_FIXED_T(name, type, limbs, base)                            \
+BI_STATIC_ASSERT((base) == BI_BASE_2_64 ? sizeof(type) == 8                   \
+                 : (uint64_t)(base) >= 2 && (uint64_t)(base) - 1 <= (type)-1 / 2, \
+                 #name ": " #type " can't hold two digits of base " #base);   \
+                                                                              \
+struct name {                                                                 \
+  type limb[limbs];                                                           \
+};                                                                            \
+                                                                              \
+static inline int name##_add_sc(struct name* d, uint64_t v)                   \
+{                                                                             \
+  /* Never 0, so the 2^64 instance still compiles the digit path */          \
+  const uint64_t b_ = (base) == BI_BASE_2_64 ? 1 : (uint64_t)(base);          \
+  BI_FIXED_UNROLL                                                             \
+  for (size_t i = 0; i < (limbs) && v; ++i) {                                 \
+    if ((base) == BI_BASE_2_64) {                                             \
+      uint64_t s;                                                             \
+      v = __builtin_add_overflow((uint64_t)d->limb[i], v, &s);                \
+      d->limb[i] = (type)s;                                                   \
+      continue;                                                               \
+    }                                                                         \
+    /* v can be a whole word, so add one digit of it at a time */             \
+    type s = d->limb[i] + (type)(v % b_);                                     \
+    v /= b_;                                                                  \
+    if (s >= (type)b_) {                                                      \
+      s -= (type)b_;                                                          \
+      v++;                                                                    \
+    }                                                                         \
+    d->limb[i] = s;                                                           \
+  }                                                                           \
+  return v != 0;                                                              \
+}                                                                             \
+                                                                              \
+static inline int name##_set(struct name* x, uint64_t v)                      \
+{                                                                             \
+  for (size_t i = 0; i < (limbs); ++i)                                        \
+    x->limb[i] = 0;                                                           \
+  return name##_add_sc(x, v);                                                 \
+}                                                                             \
+                                                                              \
+static inline int name##_add(                                                 \
+  struct name* d, const struct name* a, const struct name* b)                 \
+{                                                                             \
+  const type b_ = (base) == BI_BASE_2_64 ? 1 : (type)(base);                  \
+  type c = 0;                                                                 \
+  BI_FIXED_UNROLL                                                             \
+  for (size_t i = 0; i < (limbs); ++i) {                                      \
+    if ((base) == BI_BASE_2_64) {                                             \
+      uint64_t s;                                                             \
+      type c1 = __builtin_add_overflow((uint64_t)a->limb[i], (uint64_t)b->limb[i], &s); \
+      type c2 = __builtin_add_overflow(s, (uint64_t)c, &s);                   \
+      d->limb[i] = (type)s;                                                   \
+      c = c1 | c2;                                                            \
+      continue;                                                               \
+    }                                                                         \
+    type s = a->limb[i] + b->limb[i] + c;                                     \
+    c = s >= b_;                                                              \
+    d->limb[i] = c ? s - b_ : s;                                              \
+  }                                                                           \
+  return (int)c;                                                              \
+}                                                                             \
+                                                                              \
+static inline int name##_cmp(const struct name* a, const struct name* b)      \
+{                                                                             \
+  BI_FIXED_UNROLL                                                             \
+  for (size_t i = (limbs); i-- > 0;)                                          \
+    if (a->limb[i] != b->limb[i])                                             \
+      return a->limb[i] < b->limb[i] ? -1 : 1;                                \
+  return 0;                                                                   \
+}                                                                             \
+                                                                              \
+static inline int name##_from_bi(struct name* x, const struct big_uint* bi)   \
+{                                                                             \
+  return bi_to_limbs(bi, x->limb, (limbs), sizeof(type), (base));             \
+}                                                                             \
+                                                                              \
+static inline int name##_to_bi(struct big_uint* bi, const struct name* x)     \
+{                                                                             \
+  return bi_from_limbs(bi, x->limb, (limbs), sizeof(type), (base));           \
+}
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // C_BIG_INT_BIG_INT_H
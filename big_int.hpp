@@ -0,0 +1,281 @@
+//
+// C++17 wrapper over big_int.h
+//
+
+#ifndef C_BIG_INT_BIG_INT_HPP
+#define C_BIG_INT_BIG_INT_HPP
+
+#include "big_int.h"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace bi {
+
+/**
+ * Thrown when the C library reports a failure (it has printed why)
+ */
+struct error : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+class big_uint;
+
+/**
+ * a + b + ... as a list of operands, evaluated by one bi_add_many when it
+ * lands in a big_uint. Holds references, so it must not outlive them
+ */
+template <size_t N>
+struct sum {
+  std::array<const ::big_uint*, N> terms;
+};
+
+/**
+ * Owning big_uint. Moves steal the limbs (or copy the few inline bytes)
+ * and copies only happen through clone()
+ */
+class big_uint {
+ public:
+  explicit big_uint(uint64_t start = 0, uint64_t base = 10)
+  {
+    check(::bi_init(&bi_, start, base), "bi_init");
+  }
+
+  static big_uint bin(uint64_t start = 0)
+  {
+    big_uint ret(zero_tag{}, BI_BASE_2_64);
+    ret += start;
+    return ret;
+  }
+
+  static big_uint from_str(const char* str, uint64_t base = 10)
+  {
+    big_uint ret(zero_tag{}, base);
+    check(::bi_from_str(&ret.bi_, str), "bi_from_str");
+    return ret;
+  }
+
+  template <size_t N>
+  big_uint(const sum<N>& s) : big_uint(zero_tag{}, s.terms[0]->base)
+  {
+    check(::bi_add_many(&bi_, s.terms.data(), N), "bi_add_many");
+  }
+
+  big_uint(big_uint&& other) noexcept { steal(other); }
+
+  big_uint& operator=(big_uint&& other) noexcept
+  {
+    if (this != &other) {
+      ::bi_free(&bi_);
+      steal(other);
+    }
+    return *this;
+  }
+
+  big_uint(const big_uint&) = delete;
+  big_uint& operator=(const big_uint&) = delete;
+
+  ~big_uint() { ::bi_free(&bi_); }
+
+  big_uint clone() const
+  {
+    big_uint ret(zero_tag{}, bi_.base);
+    ret += *this;
+    return ret;
+  }
+
+  /**
+   * x = a + b + ... in place (x may be one of the terms)
+   */
+  template <size_t N>
+  big_uint& operator=(const sum<N>& s)
+  {
+    check(::bi_add_many(&bi_, s.terms.data(), N), "bi_add_many");
+    return *this;
+  }
+
+  big_uint& operator+=(const big_uint& right)
+  {
+    check(::bi_add_bi(&bi_, &right.bi_), "bi_add_bi");
+    return *this;
+  }
+
+  big_uint& operator+=(uint64_t right)
+  {
+    check(::bi_add_sc(&bi_, right), "bi_add_sc");
+    return *this;
+  }
+
+  /**
+   * x += a + b + ... is still a single pass, with x as one more term
+   */
+  template <size_t N>
+  big_uint& operator+=(const sum<N>& s)
+  {
+    std::array<const ::big_uint*, N + 1> terms;
+    terms[0] = &bi_;
+    for (size_t i = 0; i < N; ++i)
+      terms[i + 1] = s.terms[i];
+    check(::bi_add_many(&bi_, terms.data(), N + 1), "bi_add_many");
+    return *this;
+  }
+
+  big_uint& operator*=(uint64_t right)
+  {
+    check(::bi_mul_sc(&bi_, right), "bi_mul_sc");
+    return *this;
+  }
+
+  /**
+   * x /= divisor, returning the remainder
+   */
+  uint64_t divmod(uint64_t divisor)
+  {
+    uint64_t rem;
+    check(::bi_divmod_sc(&bi_, divisor, &rem), "bi_divmod_sc");
+    return rem;
+  }
+
+  friend big_uint operator*(const big_uint& left, const big_uint& right)
+  {
+    big_uint ret(zero_tag{}, left.bi_.base);
+    check(::bi_mul_bi(&ret.bi_, &left.bi_, &right.bi_), "bi_mul_bi");
+    return ret;
+  }
+
+  friend bool operator==(const big_uint& left, const big_uint& right)
+  {
+    return ::bi_eq(&left.bi_, &right.bi_);
+  }
+
+  friend bool operator!=(const big_uint& left, const big_uint& right)
+  {
+    return !(left == right);
+  }
+
+  /**
+   * Ordering needs both sides in the same base (bi::error otherwise)
+   */
+  friend bool operator<(const big_uint& left, const big_uint& right)
+  {
+    int c = ::bi_cmp(&left.bi_, &right.bi_);
+    if (c < -1)
+      throw error("bi_cmp");
+    return c < 0;
+  }
+
+  uint64_t hash() const { return ::bi_hash(&bi_); }
+
+  std::string str() const
+  {
+    std::unique_ptr<char, decltype(&std::free)> s(::bi_to_str(&bi_), &std::free);
+    if (!s)
+      throw error("bi_to_str");
+    return s.get();
+  }
+
+  size_t size() const { return bi_.size; }
+  uint64_t base() const { return bi_.base; }
+
+  /**
+   * For the rest of the C API. Don't bi_free it
+   */
+  ::big_uint* get() { return &bi_; }
+  const ::big_uint* get() const { return &bi_; }
+
+ private:
+  struct zero_tag {};
+
+  /**
+   * Zero in any base, BI_BASE_2_64 included
+   */
+  big_uint(zero_tag, uint64_t base)
+  {
+    if (base == BI_BASE_2_64)
+      check(::bi_init_bin(&bi_, 0), "bi_init_bin");
+    else
+      check(::bi_init(&bi_, 0, base), "bi_init");
+  }
+
+  bool small() const
+  {
+    return bi_.data == reinterpret_cast<const uint8_t*>(bi_.small);
+  }
+
+  static void check(int ret, const char* what)
+  {
+    if (ret)
+      throw error(what);
+  }
+
+  /**
+   * Takes other's limbs as they are and leaves other an empty inline zero
+   */
+  void steal(big_uint& other) noexcept
+  {
+    std::memcpy(static_cast<void*>(&bi_), &other.bi_, sizeof(::big_uint));
+    if (other.small())
+      bi_.data = reinterpret_cast<uint8_t*>(bi_.small);
+    other.bi_.data = reinterpret_cast<uint8_t*>(other.bi_.small);
+    other.bi_.size = 0;
+    other.bi_.capacity = BI_INLINE_BYTES;
+    other.bi_.arena = nullptr;
+  }
+
+  ::big_uint bi_{};
+};
+
+inline sum<2> operator+(const big_uint& left, const big_uint& right)
+{
+  return sum<2>{ { left.get(), right.get() } };
+}
+
+template <size_t N>
+sum<N + 1> operator+(const sum<N>& left, const big_uint& right)
+{
+  sum<N + 1> ret;
+  for (size_t i = 0; i < N; ++i)
+    ret.terms[i] = left.terms[i];
+  ret.terms[N] = right.get();
+  return ret;
+}
+
+template <size_t N>
+sum<N + 1> operator+(const big_uint& left, const sum<N>& right)
+{
+  sum<N + 1> ret;
+  ret.terms[0] = left.get();
+  for (size_t i = 0; i < N; ++i)
+    ret.terms[i + 1] = right.terms[i];
+  return ret;
+}
+
+template <size_t N, size_t M>
+sum<N + M> operator+(const sum<N>& left, const sum<M>& right)
+{
+  sum<N + M> ret;
+  for (size_t i = 0; i < N; ++i)
+    ret.terms[i] = left.terms[i];
+  for (size_t i = 0; i < M; ++i)
+    ret.terms[N + i] = right.terms[i];
+  return ret;
+}
+
+} // namespace bi
+
+namespace std {
+
+template <>
+struct hash<bi::big_uint> {
+  size_t operator()(const bi::big_uint& x) const { return x.hash(); }
+};
+
+} // namespace std
+
+#endif // C_BIG_INT_BIG_INT_HPP
@@ -7,6 +7,29 @@ int main()
   test_various_others();
   test_bi_init();
   test_bi_add_bi();
+  test_bi_add_bi_simd();
+  test_bi_mul_bi();
+  test_bi_divmod_bi();
+  test_bi_barrett();
+  test_bi_powmod();
+  test_bi_bin();
+  test_bi_packed();
+  test_bi_convert_base();
+  test_bi_str();
+  test_bi_arena();
+  test_bi_batch();
+  test_bi_parallel();
+  test_bi_add_bi_parallel();
+  test_bi_accum();
+  test_bi_save();
+  test_bi_stats();
+  test_bi_allocator();
+  test_bi_fixed();
+  test_bi_add_many();
+  test_bi_from_fd();
+  test_bi_scalar();
+  test_bi_hash();
+  test_bi_view();
 
   return 0;
 }
@@ -0,0 +1,122 @@
+#include "big_int.hpp"
+#include <cstdio>
+#include <string>
+#include <unordered_set>
+#include <utility>
+
+static int failures = 0;
+
+static void expect(bool ok, const char* what)
+{
+  if (ok) {
+    printf("c_big_int \033[1;32mTEST PASSED:\033[0m %s\n", what);
+  } else {
+    printf("c_big_int \033[1;31mTEST FAILED:\033[0m %s\n", what);
+    failures++;
+  }
+}
+
+static void test_move()
+{
+  bi::big_uint small(12345);
+  bi::big_uint big = bi::big_uint::from_str("123456789012345678901234567890123456789");
+  const uint8_t* limbs = big.get()->data;
+
+  bi::big_uint a(std::move(big));
+  expect(a.get()->data == limbs && a.str() == "123456789012345678901234567890123456789",
+         "move steals the limbs");
+  expect(big.size() == 0 && big.str() == "0", "moved from is zero");
+
+  bi::big_uint b(std::move(small));
+  expect(b.get()->data == reinterpret_cast<uint8_t*>(b.get()->small) && b.str() == "12345",
+         "move of an inline value");
+
+  a = std::move(b);
+  expect(a.str() == "12345", "move assignment");
+  bi::big_uint c = a.clone();
+  c += 1;
+  expect(a.str() == "12345" && c.str() == "12346", "clone");
+}
+
+static void test_sum()
+{
+  bi::big_uint a = bi::big_uint::from_str("99999999999999999999999999999999");
+  bi::big_uint b(1);
+  bi::big_uint c = bi::big_uint::from_str("123456789123456789123456789");
+  bi::big_uint d(7);
+
+  bi::big_uint s = a + b + c + d;
+  expect(s.str() == "100000123456789123456789123456796", "a + b + c + d");
+
+  bi::big_uint t = (a + b) + (c + d);
+  expect(t.str() == s.str(), "(a + b) + (c + d)");
+
+  a = a + b;
+  expect(a.str() == "100000000000000000000000000000000", "a = a + b");
+
+  a += c + d;
+  expect(a.str() == "100000123456789123456789123456796", "a += c + d");
+
+  bi::big_uint x = bi::big_uint::bin(~0ull);
+  bi::big_uint y = bi::big_uint::bin(1);
+  bi::big_uint z = x + y + y;
+  expect(z.str() == "18446744073709551617", "base 2^64 sum");
+
+  bi::big_uint p = c * d;
+  expect(p.str() == "864197523864197523864197523", "c * d");
+}
+
+static void test_scalar()
+{
+  bi::big_uint a = bi::big_uint::from_str("123456789012345678901234567890");
+  a *= 1000000007;
+  expect(a.str() == "123456789876543201987654320198641975230", "a *= word");
+  uint64_t rem = a.divmod(1000000007);
+  expect(rem == 0 && a.str() == "123456789012345678901234567890", "a.divmod(word)");
+  rem = a.divmod(~0ull);
+  expect(rem == 14083847780529871560ull && a.str() == "6692605942", "a.divmod(2^64 - 1)");
+}
+
+static void test_compare()
+{
+  bi::big_uint a = bi::big_uint::from_str("340282366920938463463374607431768211456");
+  bi::big_uint b = a.clone();
+  expect(a == b && !(a < b) && a.hash() == b.hash(), "clone compares and hashes equal");
+  b += 1;
+  expect(a != b && a < b && !(b < a), "a < a + 1");
+
+  std::unordered_set<bi::big_uint> seen;
+  seen.insert(a.clone());
+  seen.insert(b.clone());
+  seen.insert(a.clone());
+  expect(seen.size() == 2 && seen.count(b), "std::unordered_set of big_uint");
+}
+
+static void test_errors()
+{
+  bool thrown = false;
+  try {
+    bi::big_uint bad(0, 1);
+  } catch (const bi::error&) {
+    thrown = true;
+  }
+  expect(thrown, "bad base throws");
+
+  thrown = false;
+  try {
+    bi::big_uint(5).divmod(0);
+  } catch (const bi::error&) {
+    thrown = true;
+  }
+  expect(thrown, "divmod by zero throws");
+}
+
+int main()
+{
+  test_move();
+  test_sum();
+  test_scalar();
+  test_compare();
+  test_errors();
+  return failures != 0;
+}
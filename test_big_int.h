@@ -11,4 +11,50 @@ int test_bi_init();
 
 int test_bi_add_bi();
 
+int test_bi_add_bi_simd();
+
+int test_bi_mul_bi();
+
+int test_bi_divmod_bi();
+
+int test_bi_barrett();
+
+int test_bi_powmod();
+
+int test_bi_bin();
+
+int test_bi_packed();
+
+int test_bi_convert_base();
+
+int test_bi_str();
+
+int test_bi_arena();
+
+int test_bi_batch();
+
+int test_bi_parallel();
+
+int test_bi_add_bi_parallel();
+
+int test_bi_accum();
+
+int test_bi_save();
+
+int test_bi_stats();
+
+int test_bi_allocator();
+
+int test_bi_fixed();
+
+int test_bi_add_many();
+
+int test_bi_from_fd();
+
+int test_bi_scalar();
+
+int test_bi_hash();
+
+int test_bi_view();
+
 #endif // C_TEST_BIG_INT_BIG_INT_H